@@ -0,0 +1,421 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../src/perlovka.h"
+
+static const char *grid_names[] = { "odd", "even", "both", NULL };
+static const char *matching_names[] = { "soft", "strict", NULL };
+static const char *scan_names[]
+    = { "raster", "alternate", "serpentine", "blocks", NULL };
+static const char *resolver_names[]
+    = { "minimal", "least-of-max", "largest-of-min", "maximal", NULL };
+
+typedef enum
+{
+  SAMPLE_U8,
+  SAMPLE_U16,
+  SAMPLE_INT
+} Sample;
+
+/**
+ * Progress callback of the Python caller: it is called with the GIL taken
+ * after each iteration, and an exception it raises stops the solve
+ */
+typedef struct
+{
+  PyObject *callable;
+  int iteration;
+  bool failed;
+} Progress;
+
+static void
+call_progress (void *context)
+{
+  Progress *progress = (Progress *)context;
+  PyGILState_STATE state = PyGILState_Ensure ();
+  PyObject *result;
+
+  result = PyObject_CallFunction (progress->callable, "i",
+                                  ++progress->iteration);
+
+  if (result == NULL)
+    progress->failed = true;
+
+  Py_XDECREF (result);
+  PyGILState_Release (state);
+}
+
+static bool
+progress_failed (void *context)
+{
+  return ((Progress *)context)->failed;
+}
+
+static bool
+parse_name (const char *value, const char **names, const char *what,
+            int *result)
+{
+  for (int index = 0; names[index]; ++index)
+    {
+      if (strcmp (value, names[index]) == 0)
+        {
+          *result = index;
+          return true;
+        }
+    }
+
+  PyErr_Format (PyExc_ValueError, "unknown %s '%s'", what, value);
+
+  return false;
+}
+
+/**
+ * Sample type of a buffer format: native unsigned 8-bit and 16-bit or signed
+ * 32-bit integers
+ */
+static bool
+parse_format (Py_buffer const *view, Sample *sample)
+{
+  const char *format = view->format ? view->format : "B";
+
+  if (*format == '@' || *format == '=')
+    ++format;
+#if PY_LITTLE_ENDIAN
+  else if (*format == '<')
+    ++format;
+#else
+  else if (*format == '>' || *format == '!')
+    ++format;
+#endif
+
+  if (strlen (format) == 1)
+    {
+      if (view->itemsize == 1 && *format == 'B')
+        *sample = SAMPLE_U8;
+      else if (view->itemsize == 2 && *format == 'H')
+        *sample = SAMPLE_U16;
+      else if (view->itemsize == sizeof (int) && strchr ("il", *format))
+        *sample = SAMPLE_INT;
+      else
+        format = "";
+    }
+
+  if (strlen (format) != 1)
+    {
+      PyErr_Format (PyExc_TypeError,
+                    "expected uint8, uint16 or int32 samples, got '%s'",
+                    view->format);
+      return false;
+    }
+
+  return true;
+}
+
+/**
+ * Copy the buffer rows into `data`
+ */
+static void
+ingest (Py_buffer const *view, Sample sample, int *data, size_t width,
+        size_t height)
+{
+  for (size_t y = 0; y < height; ++y, data += width)
+    {
+      char const *row = (char const *)view->buf + y * view->strides[0];
+
+      if (sample == SAMPLE_U8)
+        {
+          for (size_t x = 0; x < width; ++x)
+            data[x] = ((uint8_t const *)row)[x];
+        }
+      else if (sample == SAMPLE_U16)
+        {
+          for (size_t x = 0; x < width; ++x)
+            data[x] = ((uint16_t const *)row)[x];
+        }
+      else
+        {
+          memcpy (data, row, sizeof (int) * width);
+        }
+    }
+}
+
+/**
+ * Copy `data` back into the buffer rows, clamping narrow samples
+ */
+static void
+egress (Py_buffer const *view, Sample sample, int const *data, size_t width,
+        size_t height, int maxval)
+{
+  int value;
+
+  for (size_t y = 0; y < height; ++y, data += width)
+    {
+      char *row = (char *)view->buf + y * view->strides[0];
+
+      if (sample == SAMPLE_INT)
+        {
+          memcpy (row, data, sizeof (int) * width);
+          continue;
+        }
+
+      for (size_t x = 0; x < width; ++x)
+        {
+          value = data[x] < 0 ? 0 : data[x] > maxval ? maxval : data[x];
+
+          if (sample == SAMPLE_U8)
+            ((uint8_t *)row)[x] = (uint8_t)value;
+          else
+            ((uint16_t *)row)[x] = (uint16_t)value;
+        }
+    }
+}
+
+PyDoc_STRVAR (
+    denoize_doc,
+    "denoize(array, radius=5, iterations=5, grid='odd', matching='soft',\n"
+    "        resolver='minimal', field_matching=False, maxval=None,\n"
+    "        progress=None, scan='raster', prune_below=0, min_gain=0,\n"
+    "        probe_budget=0)\n"
+    "\n"
+    "Reduce grain of a writable 2-D array of uint8, uint16 or int32 samples\n"
+    "in place. Rows may be strided, samples of a row must be contiguous.\n"
+    "Contiguous int32 arrays are denoized without copying. Narrow samples\n"
+    "are clamped to [0, maxval], by default the full range of the type;\n"
+    "a maxval beyond that range raises ValueError.\n"
+    "\n"
+    "The GIL is released while denoizing. `progress` is called with the\n"
+    "iteration number after each iteration; an exception it raises stops\n"
+    "denoizing and is passed on.\n"
+    "\n"
+    "scan is raster, alternate, serpentine or blocks. prune_below and\n"
+    "min_gain are ratios below 1 and probe_budget at most 10000, 0 turning\n"
+    "each off, as the --prune, --min-gain and --probe-budget options of\n"
+    "perlovka-cli.\n"
+    "\n"
+    "Returns a dict with 'iterations_made', 'resolved' and 'converged'.");
+
+static PyObject *
+denoize (PyObject *self, PyObject *args, PyObject *kwargs)
+{
+  static char *keywords[]
+      = { "array",       "radius",   "iterations",   "grid",
+          "matching",    "resolver", "field_matching", "maxval",
+          "progress",    "scan",     "prune_below",    "min_gain",
+          "probe_budget", NULL };
+
+  PerlovkaOptions options;
+  Progress progress = { NULL, 0, false };
+  Py_buffer view;
+  PyObject *array;
+  PyObject *maxval_object = Py_None;
+  PyObject *progress_object = Py_None;
+  const char *grid = "odd";
+  const char *matching = "soft";
+  const char *resolver = "minimal";
+  const char *scan = "raster";
+  int field_matching = 0;
+  int maxval;
+  int value;
+  Sample sample;
+  size_t width;
+  size_t height;
+  int *data;
+  bool in_place;
+
+  (void)self;
+  perlovka_init_options (&options);
+
+  if (!PyArg_ParseTupleAndKeywords (
+          args, kwargs, "O|iisssp$OOsddi", keywords, &array,
+          &options.radius, &options.iterations, &grid, &matching, &resolver,
+          &field_matching, &maxval_object, &progress_object, &scan,
+          &options.prune_below, &options.min_gain, &options.probe_budget))
+    return NULL;
+
+  if (options.radius < 1 || options.iterations < 0)
+    {
+      PyErr_SetString (PyExc_ValueError,
+                       "radius must be positive and iterations not negative");
+      return NULL;
+    }
+
+  if (!parse_name (grid, grid_names, "grid", &value))
+    return NULL;
+
+  options.grid = (Grid)value;
+
+  if (!parse_name (matching, matching_names, "matching", &value))
+    return NULL;
+
+  options.matching = (MatchMode)value;
+
+  if (!parse_name (resolver, resolver_names, "resolver", &value))
+    return NULL;
+
+  options.resolver = (ResolveMode)value;
+  options.field_matching = field_matching != 0;
+
+  if (!parse_name (scan, scan_names, "scan", &value))
+    return NULL;
+
+  options.scan = (ScanOrder)value;
+
+  /* The ranges of the command line, with 0 for off */
+  if (!(options.prune_below >= 0 && options.prune_below < 1)
+      || !(options.min_gain >= 0 && options.min_gain < 1)
+      || options.probe_budget < 0 || options.probe_budget > 10000)
+    {
+      PyErr_SetString (PyExc_ValueError,
+                       "prune_below and min_gain must be from 0 to below 1 "
+                       "and probe_budget from 0 to 10000");
+      return NULL;
+    }
+
+  if (progress_object != Py_None)
+    {
+      if (!PyCallable_Check (progress_object))
+        {
+          PyErr_SetString (PyExc_TypeError, "progress must be callable");
+          return NULL;
+        }
+
+      progress.callable = progress_object;
+      options.progress = call_progress;
+      options.cancelled = progress_failed;
+      options.context = &progress;
+    }
+
+  if (PyObject_GetBuffer (array, &view, PyBUF_RECORDS) != 0)
+    return NULL;
+
+  if (view.ndim != 2 || view.strides[1] != view.itemsize
+      || view.strides[0] < view.shape[1] * view.itemsize)
+    {
+      PyErr_SetString (PyExc_ValueError,
+                       "expected a 2-D array with contiguous rows");
+      PyBuffer_Release (&view);
+      return NULL;
+    }
+
+  if (!parse_format (&view, &sample))
+    {
+      PyBuffer_Release (&view);
+      return NULL;
+    }
+
+  maxval = sample == SAMPLE_U8 ? 255 : 65535;
+
+  if (maxval_object != Py_None)
+    {
+      long number = PyLong_AsLong (maxval_object);
+
+      if (PyErr_Occurred ())
+        {
+          PyBuffer_Release (&view);
+          return NULL;
+        }
+
+      /* Integer samples are not clamped: any maxval goes for them */
+      if (sample != SAMPLE_INT && (number < 1 || number > maxval))
+        {
+          PyErr_Format (PyExc_ValueError, "maxval must be from 1 to %d",
+                        maxval);
+          PyBuffer_Release (&view);
+          return NULL;
+        }
+
+      maxval = (int)number;
+    }
+
+  width = view.shape[1];
+  height = view.shape[0];
+  options.width = width;
+  options.height = height;
+
+  /* The core works on ints: only other samples or padded rows need a copy */
+  in_place = sample == SAMPLE_INT
+             && (size_t)view.strides[0] == sizeof (int) * width;
+
+  if (width > 0 && height > 0)
+    {
+      data = in_place ? (int *)view.buf
+                      : (int *)PyMem_RawMalloc (sizeof (int) * width * height);
+
+      if (data == NULL)
+        {
+          PyBuffer_Release (&view);
+          return PyErr_NoMemory ();
+        }
+
+      options.data = data;
+
+      Py_BEGIN_ALLOW_THREADS;
+
+      if (!in_place)
+        ingest (&view, sample, data, width, height);
+
+      perlovka_denoize (&options);
+
+      if (!in_place)
+        egress (&view, sample, data, width, height, maxval);
+
+      Py_END_ALLOW_THREADS;
+
+      if (!in_place)
+        PyMem_RawFree (data);
+    }
+
+  PyBuffer_Release (&view);
+
+  if (progress.failed)
+    return NULL;
+
+  return Py_BuildValue ("{s:i,s:n,s:O}", "iterations_made",
+                        options.iterations_made, "resolved",
+                        (Py_ssize_t)options.resolved, "converged",
+                        options.converged ? Py_True : Py_False);
+}
+
+static PyMethodDef methods[] = {
+  { "denoize", (PyCFunction)(void (*) (void))denoize,
+    METH_VARARGS | METH_KEYWORDS, denoize_doc },
+  { NULL, NULL, 0, NULL },
+};
+
+static struct PyModuleDef module = {
+  PyModuleDef_HEAD_INIT,
+  "perlovka",
+  "Perlovka grain reduction filter working on buffer protocol arrays",
+  -1,
+  methods,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+};
+
+PyMODINIT_FUNC
+PyInit_perlovka (void)
+{
+  return PyModule_Create (&module);
+}
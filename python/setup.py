@@ -0,0 +1,31 @@
+#    Perlovka - grain reduction filter
+#    Copyright (C) 2025 Alexander Belkov
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+from setuptools import Extension, setup
+
+CORE = ["diff", "perlovka", "position", "solver", "value"]
+
+setup(
+    name="perlovka",
+    version="0.1",
+    description="Perlovka grain reduction filter for buffer protocol arrays",
+    ext_modules=[
+        Extension(
+            "perlovka",
+            sources=["perlovkamodule.c"] + ["../src/%s.c" % name for name in CORE],
+        )
+    ],
+)
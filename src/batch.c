@@ -0,0 +1,673 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "libperlovka.h"
+#include "tiles.h"
+
+/**
+ * Image on its way through the pipeline
+ */
+typedef struct
+{
+  int index;
+  char *input;
+  char *output;
+  Image image;
+  PerlovkaOptions stats;
+  double seconds;
+
+  /**
+   * Sequence mode: a frame that could not be read still passes the stages,
+   * so that the frames after it are not held back
+   */
+  bool failed;
+} BatchJob;
+
+/**
+ * Bounded blocking queue between two stages
+ */
+typedef struct
+{
+  BatchJob **jobs;
+  int capacity;
+  int head;
+  int count;
+
+  /**
+   * Threads of the feeding stage still running
+   */
+  int producers;
+
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+} JobQueue;
+
+/**
+ * Busy and waiting time of a stage summed over its threads
+ */
+typedef struct
+{
+  double busy;
+  double waiting;
+  int images;
+} StageTiming;
+
+typedef struct
+{
+  CliSettings const *settings;
+
+  /**
+   * Input and output file names
+   */
+  char **inputs;
+  char **outputs;
+  int count;
+
+  /**
+   * Next input to read
+   */
+  int next;
+
+  JobQueue decoded;
+  JobQueue denoized;
+
+  /**
+   * Sequence mode: frames denoized ahead of the next one to write. Readers
+   * wait on `written` before taking a frame `queue_size` or more ahead of
+   * it, which bounds the frames kept.
+   */
+  BatchJob **arrived;
+  int next_write;
+  pthread_cond_t written;
+
+  FILE *frame_stats;
+
+  pthread_mutex_t lock;
+  StageTiming reading;
+  StageTiming denoizing;
+  StageTiming writing;
+  size_t resolved;
+  int failed;
+} Batch;
+
+static void
+init_queue (JobQueue *queue, int capacity, int producers)
+{
+  queue->jobs = (BatchJob **)malloc (sizeof (BatchJob *) * capacity);
+  queue->capacity = capacity;
+  queue->head = 0;
+  queue->count = 0;
+  queue->producers = producers;
+  pthread_mutex_init (&queue->lock, NULL);
+  pthread_cond_init (&queue->not_empty, NULL);
+  pthread_cond_init (&queue->not_full, NULL);
+}
+
+static void
+clean_queue (JobQueue *queue)
+{
+  free (queue->jobs);
+  pthread_mutex_destroy (&queue->lock);
+  pthread_cond_destroy (&queue->not_empty);
+  pthread_cond_destroy (&queue->not_full);
+}
+
+/**
+ * Put the job, waiting for room. Returns the time spent waiting
+ */
+static double
+queue_put (JobQueue *queue, BatchJob *job)
+{
+  double started = now ();
+
+  pthread_mutex_lock (&queue->lock);
+
+  while (queue->count == queue->capacity)
+    pthread_cond_wait (&queue->not_full, &queue->lock);
+
+  queue->jobs[(queue->head + queue->count) % queue->capacity] = job;
+  ++queue->count;
+
+  pthread_cond_signal (&queue->not_empty);
+  pthread_mutex_unlock (&queue->lock);
+
+  return now () - started;
+}
+
+/**
+ * Take the next job, NULL when the queue is drained and all its producers
+ * have finished
+ */
+static BatchJob *
+queue_take (JobQueue *queue, double *waiting)
+{
+  BatchJob *job = NULL;
+  double started = now ();
+
+  pthread_mutex_lock (&queue->lock);
+
+  while (queue->count == 0 && queue->producers > 0)
+    pthread_cond_wait (&queue->not_empty, &queue->lock);
+
+  if (queue->count > 0)
+    {
+      job = queue->jobs[queue->head];
+      queue->head = (queue->head + 1) % queue->capacity;
+      --queue->count;
+      pthread_cond_signal (&queue->not_full);
+    }
+
+  pthread_mutex_unlock (&queue->lock);
+
+  *waiting += now () - started;
+
+  return job;
+}
+
+static void
+producer_done (JobQueue *queue)
+{
+  pthread_mutex_lock (&queue->lock);
+
+  --queue->producers;
+  pthread_cond_broadcast (&queue->not_empty);
+
+  pthread_mutex_unlock (&queue->lock);
+}
+
+static void
+add_timing (Batch *batch, StageTiming *stage, StageTiming const *thread)
+{
+  pthread_mutex_lock (&batch->lock);
+
+  stage->busy += thread->busy;
+  stage->waiting += thread->waiting;
+  stage->images += thread->images;
+
+  pthread_mutex_unlock (&batch->lock);
+}
+
+static void
+job_failed (Batch *batch, BatchJob *job, const char *action)
+{
+  fprintf (stderr, "perlovka-cli: cannot %s %s\n", action,
+           strcmp (action, "write") == 0 ? job->output : job->input);
+
+  pthread_mutex_lock (&batch->lock);
+  ++batch->failed;
+  pthread_mutex_unlock (&batch->lock);
+
+  clean_image (&job->image);
+  free (job);
+}
+
+static void *
+reader_thread (void *arg)
+{
+  Batch *batch = (Batch *)arg;
+  StageTiming timing = { 0 };
+  BatchJob *job;
+  double started;
+  int index;
+
+  for (;;)
+    {
+      pthread_mutex_lock (&batch->lock);
+      index = batch->next++;
+
+      if (batch->settings->sequence && index < batch->count
+          && index >= batch->next_write + batch->settings->queue_size)
+        {
+          started = now ();
+
+          while (index >= batch->next_write + batch->settings->queue_size)
+            pthread_cond_wait (&batch->written, &batch->lock);
+
+          timing.waiting += now () - started;
+        }
+
+      pthread_mutex_unlock (&batch->lock);
+
+      if (index >= batch->count)
+        break;
+
+      started = now ();
+
+      job = (BatchJob *)calloc (1, sizeof (BatchJob));
+      job->index = index;
+      job->input = batch->inputs[index];
+      job->output = batch->outputs[index];
+
+      if (!load_image (batch->settings, job->input, &job->image))
+        {
+          if (!batch->settings->sequence)
+            {
+              job_failed (batch, job, "read");
+              continue;
+            }
+
+          fprintf (stderr, "perlovka-cli: cannot read %s\n", job->input);
+          job->failed = true;
+        }
+
+      timing.busy += now () - started;
+      ++timing.images;
+
+      timing.waiting += queue_put (&batch->decoded, job);
+    }
+
+  producer_done (&batch->decoded);
+  add_timing (batch, &batch->reading, &timing);
+
+  return NULL;
+}
+
+/**
+ * Denoize a frame with the context of the worker, which is created for the
+ * first frame and kept while the geometry stays the same. Gives the same
+ * result as `perlovka_denoize_tiled`.
+ */
+static void
+denoize_frame (Batch *batch, BatchJob *job, PerlovkaContext **context,
+               PerlovkaOptions *geometry)
+{
+  PerlovkaStats stats;
+  Image *image = &job->image;
+
+  if (*context == NULL || geometry->width != image->width
+      || geometry->height != image->height)
+    {
+      perlovka_context_free (*context);
+      *geometry = job->stats;
+      *context = perlovka_context_new (geometry, batch->settings->tile_size, 1);
+    }
+
+  job->stats.iterations_made = 0;
+  job->stats.resolved = 0;
+  job->stats.converged = true;
+
+  for (int channel = 0; channel < image->color_channels; ++channel)
+    {
+      perlovka_context_execute (*context, image->planes[channel],
+                                image->planes[channel],
+                                sizeof (int) * image->width,
+                                PERLOVKA_SAMPLE_INT, image->maxval);
+      perlovka_context_stats (*context, &stats);
+
+      if (stats.iterations_made > job->stats.iterations_made)
+        job->stats.iterations_made = stats.iterations_made;
+
+      job->stats.resolved += stats.resolved;
+      job->stats.converged = job->stats.converged && stats.converged;
+    }
+}
+
+static void *
+worker_thread (void *arg)
+{
+  Batch *batch = (Batch *)arg;
+  StageTiming timing = { 0 };
+  PerlovkaContext *context = NULL;
+  PerlovkaOptions geometry;
+  BatchJob *job;
+  double started;
+
+  while ((job = queue_take (&batch->decoded, &timing.waiting)) != NULL)
+    {
+      started = now ();
+
+      /* Parallelism comes from the images, each one is denoized by one
+         thread */
+      job->stats = batch->settings->options;
+      job->stats.width = job->image.width;
+      job->stats.height = job->image.height;
+
+      if (job->failed)
+        {
+          timing.waiting += queue_put (&batch->denoized, job);
+          continue;
+        }
+
+      if (batch->settings->sequence)
+        denoize_frame (batch, job, &context, &geometry);
+      else
+        perlovka_denoize_tiled (&job->stats, job->image.planes,
+                                job->image.color_channels,
+                                batch->settings->tile_size, 1);
+
+      clamp_image (&job->image);
+
+      job->seconds = now () - started;
+      timing.busy += job->seconds;
+      ++timing.images;
+
+      timing.waiting += queue_put (&batch->denoized, job);
+    }
+
+  perlovka_context_free (context);
+  producer_done (&batch->denoized);
+  add_timing (batch, &batch->denoizing, &timing);
+
+  return NULL;
+}
+
+static void
+write_job (Batch *batch, BatchJob *job, StageTiming *timing)
+{
+  double started = now ();
+
+  if (job->failed)
+    {
+      pthread_mutex_lock (&batch->lock);
+      ++batch->failed;
+      pthread_mutex_unlock (&batch->lock);
+
+      clean_image (&job->image);
+      free (job);
+      return;
+    }
+
+  if (!save_image (&job->image, job->output))
+    {
+      job_failed (batch, job, "write");
+      return;
+    }
+
+  timing->busy += now () - started;
+  ++timing->images;
+
+  if (!batch->settings->quiet)
+    fprintf (stderr, "%s: %d iteration(s), %zu compensations\n", job->output,
+             job->stats.iterations_made, job->stats.resolved);
+
+  pthread_mutex_lock (&batch->lock);
+
+  batch->resolved += job->stats.resolved;
+
+  if (batch->frame_stats)
+    fprintf (batch->frame_stats, "%d,%s,%s,%d,%zu,%d,%.6f\n", job->index,
+             job->input, job->output, job->stats.iterations_made,
+             job->stats.resolved, job->stats.converged ? 1 : 0,
+             job->seconds);
+
+  pthread_mutex_unlock (&batch->lock);
+
+  clean_image (&job->image);
+  free (job);
+}
+
+static void *
+writer_thread (void *arg)
+{
+  Batch *batch = (Batch *)arg;
+  StageTiming timing = { 0 };
+  BatchJob *job;
+
+  while ((job = queue_take (&batch->denoized, &timing.waiting)) != NULL)
+    {
+      if (!batch->settings->sequence)
+        {
+          write_job (batch, job, &timing);
+          continue;
+        }
+
+      /* The only writer of a sequence keeps the frames that came early.
+         The readers stay within `queue_size` frames of the next one to
+         write, and failed frames pass too. */
+      batch->arrived[job->index] = job;
+
+      while (batch->next_write < batch->count
+             && batch->arrived[batch->next_write])
+        {
+          write_job (batch, batch->arrived[batch->next_write], &timing);
+
+          pthread_mutex_lock (&batch->lock);
+          ++batch->next_write;
+          pthread_cond_broadcast (&batch->written);
+          pthread_mutex_unlock (&batch->lock);
+        }
+    }
+
+  add_timing (batch, &batch->writing, &timing);
+
+  return NULL;
+}
+
+static void
+add_input (Batch *batch, const char *path, const char *output_dir)
+{
+  const char *name = strrchr (path, '/');
+  size_t length;
+
+  name = name ? name + 1 : path;
+  length = strlen (output_dir) + strlen (name) + 2;
+
+  batch->inputs = (char **)realloc (batch->inputs,
+                                    sizeof (char *) * (batch->count + 1));
+  batch->outputs = (char **)realloc (batch->outputs,
+                                     sizeof (char *) * (batch->count + 1));
+
+  batch->inputs[batch->count] = strdup (path);
+  batch->outputs[batch->count] = (char *)malloc (length);
+  snprintf (batch->outputs[batch->count], length, "%s/%s", output_dir, name);
+
+  ++batch->count;
+}
+
+static bool
+is_image_name (const char *name, bool raw)
+{
+  const char *extension = strrchr (name, '.');
+
+  if (name[0] == '.')
+    return false;
+
+  if (raw)
+    return true;
+
+  return extension
+         && (strcmp (extension, ".pgm") == 0 || strcmp (extension, ".ppm") == 0
+             || strcmp (extension, ".pam") == 0
+             || strcmp (extension, ".pnm") == 0);
+}
+
+static int
+compare_names (const void *lhs, const void *rhs)
+{
+  return strcmp (*(char *const *)lhs, *(char *const *)rhs);
+}
+
+static void
+add_directory (Batch *batch, const char *path, const char *output_dir)
+{
+  DIR *dir = opendir (path);
+  struct dirent *entry;
+  char **names = NULL;
+  size_t count = 0;
+  size_t length;
+  char *full;
+
+  if (dir == NULL)
+    return;
+
+  while ((entry = readdir (dir)) != NULL)
+    {
+      if (!is_image_name (entry->d_name,
+                          batch->settings->layout == IMAGE_RAW))
+        continue;
+
+      length = strlen (path) + strlen (entry->d_name) + 2;
+      full = (char *)malloc (length);
+      snprintf (full, length, "%s/%s", path, entry->d_name);
+
+      names = (char **)realloc (names, sizeof (char *) * (count + 1));
+      names[count++] = full;
+    }
+
+  closedir (dir);
+
+  /* Film rolls are numbered: keep the frames in order */
+  qsort (names, count, sizeof (char *), compare_names);
+
+  for (size_t index = 0; index < count; ++index)
+    {
+      add_input (batch, names[index], output_dir);
+      free (names[index]);
+    }
+
+  free (names);
+}
+
+static void
+add_list (Batch *batch, const char *path, const char *output_dir)
+{
+  FILE *file = fopen (path, "r");
+  char line[4096];
+  size_t length;
+
+  if (file == NULL)
+    return;
+
+  while (fgets (line, sizeof (line), file))
+    {
+      length = strcspn (line, "\r\n");
+      line[length] = '\0';
+
+      if (length > 0)
+        add_input (batch, line, output_dir);
+    }
+
+  fclose (file);
+}
+
+static void
+print_stage (const char *name, StageTiming const *timing, int threads)
+{
+  fprintf (stderr, "%-10s %2d thread(s): busy %8.3f s, waiting %8.3f s, %d "
+                   "image(s)\n",
+           name, threads, timing->busy, timing->waiting, timing->images);
+}
+
+int
+batch_images (CliSettings const *settings)
+{
+  Batch batch;
+  pthread_t *threads;
+  struct stat info;
+  int n_threads;
+  int index;
+  double started;
+  double elapsed;
+
+  memset (&batch, 0, sizeof (batch));
+  batch.settings = settings;
+  pthread_mutex_init (&batch.lock, NULL);
+  pthread_cond_init (&batch.written, NULL);
+
+  for (index = 0; index < settings->batch_count; ++index)
+    {
+      const char *path = settings->batch_inputs[index];
+
+      if (path[0] == '@')
+        add_list (&batch, path + 1, settings->batch_dir);
+      else if (stat (path, &info) == 0 && S_ISDIR (info.st_mode))
+        add_directory (&batch, path, settings->batch_dir);
+      else
+        add_input (&batch, path, settings->batch_dir);
+    }
+
+  if (settings->sequence)
+    batch.arrived = (BatchJob **)calloc (batch.count + 1, sizeof (BatchJob *));
+
+  if (settings->frame_stats)
+    {
+      batch.frame_stats = fopen (settings->frame_stats, "w");
+
+      if (batch.frame_stats == NULL)
+        fprintf (stderr, "perlovka-cli: cannot write %s\n",
+                 settings->frame_stats);
+      else
+        fprintf (batch.frame_stats,
+                 "frame,input,output,iterations,compensations,converged,"
+                 "seconds\n");
+    }
+
+  init_queue (&batch.decoded, settings->queue_size, settings->readers);
+  init_queue (&batch.denoized, settings->queue_size, settings->threads);
+
+  n_threads = settings->readers + settings->threads + settings->writers;
+  threads = (pthread_t *)malloc (sizeof (pthread_t) * n_threads);
+
+  started = now ();
+
+  for (index = 0; index < n_threads; ++index)
+    {
+      void *(*stage) (void *)
+          = index < settings->readers ? reader_thread
+            : index < settings->readers + settings->threads ? worker_thread
+                                                             : writer_thread;
+
+      pthread_create (&threads[index], NULL, stage, &batch);
+    }
+
+  for (index = 0; index < n_threads; ++index)
+    pthread_join (threads[index], NULL);
+
+  elapsed = now () - started;
+
+  if (!settings->quiet)
+    {
+      print_stage ("read", &batch.reading, settings->readers);
+      print_stage ("denoize", &batch.denoizing, settings->threads);
+      print_stage ("write", &batch.writing, settings->writers);
+      fprintf (stderr,
+               "%d image(s) in %.3f s (%.2f images/s), %zu compensations, "
+               "%d failed\n",
+               batch.writing.images, elapsed,
+               elapsed > 0 ? batch.writing.images / elapsed : 0.0,
+               batch.resolved, batch.failed);
+    }
+
+  for (index = 0; index < batch.count; ++index)
+    {
+      free (batch.inputs[index]);
+      free (batch.outputs[index]);
+    }
+
+  if (batch.frame_stats && fclose (batch.frame_stats) != 0)
+    fprintf (stderr, "perlovka-cli: cannot write %s\n", settings->frame_stats);
+
+  free (batch.arrived);
+  free (batch.inputs);
+  free (batch.outputs);
+  free (threads);
+  clean_queue (&batch.decoded);
+  clean_queue (&batch.denoized);
+  pthread_cond_destroy (&batch.written);
+  pthread_mutex_destroy (&batch.lock);
+
+  return batch.failed;
+}
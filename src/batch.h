@@ -0,0 +1,34 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "cli.h"
+
+/**
+ * Denoize every image of `settings->batch_inputs` (files, directories or
+ * `@list` files with one path per line) into `settings->batch_dir`.
+ *
+ * Reader threads decode images, `settings->threads` workers denoize them and
+ * writer threads encode the results. Stages are connected by bounded queues of
+ * `settings->queue_size` images, so a fast stage waits for a slow one instead
+ * of filling the memory. Returns the amount of failed images.
+ */
+int batch_images (CliSettings const *settings);
+
+#endif
@@ -0,0 +1,215 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "image.h"
+#include "tiles.h"
+
+static const char *resolver_names[]
+    = { "minimal", "least-of-max", "largest-of-min", "maximal", NULL };
+static const char *scan_names[]
+    = { "raster", "alternate", "serpentine", "blocks", NULL };
+static const char *grid_names[] = { "odd", "even", "both", NULL };
+
+static void
+usage (void)
+{
+  fprintf (stderr,
+           "Usage: perlovka-bench [OPTIONS] IMAGE\n"
+           "Denoize a PGM, PPM or PAM image with every resolver in every "
+           "scan order\nand report the iterations each needs to converge.\n"
+           "\n"
+           "  -r, --radius=N          maximal grain radius (default 5)\n"
+           "  -i, --iterations=N      iterations limit (default 100)\n"
+           "  -g, --grid=GRID         odd, even or both (default odd)\n"
+           "  -f, --field-matching    compensate pixels around diagonals too\n"
+           "  -h, --help              show this help\n");
+}
+
+static bool
+parse_int (const char *value, int low, int high, int *result)
+{
+  char *end;
+  long number = strtol (value, &end, 10);
+
+  if (*value == '\0' || *end != '\0' || number < low || number > high)
+    return false;
+
+  *result = (int)number;
+
+  return true;
+}
+
+static double
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Denoize a copy of the color planes of `image` with `options`, filling its
+ * statistics. Returns the seconds taken.
+ */
+static double
+run (Image const *image, PerlovkaOptions *options)
+{
+  size_t size = image->width * image->height;
+  int *planes[4];
+  double started;
+  double seconds;
+  int plane;
+
+  for (plane = 0; plane < image->color_channels; ++plane)
+    {
+      planes[plane] = (int *)malloc (sizeof (int) * size);
+      memcpy (planes[plane], image->planes[plane], sizeof (int) * size);
+    }
+
+  started = now ();
+  perlovka_denoize_tiled (options, planes, image->color_channels, 0, 1);
+  seconds = now () - started;
+
+  for (plane = 0; plane < image->color_channels; ++plane)
+    free (planes[plane]);
+
+  return seconds;
+}
+
+int
+main (int argc, char **argv)
+{
+  static struct option long_options[] = {
+    { "radius", required_argument, NULL, 'r' },
+    { "iterations", required_argument, NULL, 'i' },
+    { "grid", required_argument, NULL, 'g' },
+    { "field-matching", no_argument, NULL, 'f' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 },
+  };
+
+  PerlovkaOptions options;
+  Image image;
+  double seconds;
+  int best;
+  int best_iterations;
+  int c;
+  bool ok = true;
+
+  perlovka_init_options (&options);
+  options.iterations = 100;
+
+  while (ok
+         && (c = getopt_long (argc, argv, "r:i:g:fh", long_options, NULL))
+                != -1)
+    {
+      switch (c)
+        {
+        case 'r':
+          ok = parse_int (optarg, 1, 100, &options.radius);
+          break;
+
+        case 'i':
+          ok = parse_int (optarg, 1, 10000, &options.iterations);
+          break;
+
+        case 'g':
+          ok = false;
+
+          for (int grid = 0; grid_names[grid]; ++grid)
+            if (strcmp (optarg, grid_names[grid]) == 0)
+              {
+                options.grid = (Grid)grid;
+                ok = true;
+              }
+          break;
+
+        case 'f':
+          options.field_matching = true;
+          break;
+
+        default:
+          ok = false;
+          break;
+        }
+    }
+
+  if (!ok || optind + 1 != argc)
+    {
+      usage ();
+      return 2;
+    }
+
+  if (!read_pnm (&image, argv[optind]))
+    {
+      fprintf (stderr, "perlovka-bench: cannot read %s\n", argv[optind]);
+      return 1;
+    }
+
+  options.width = image.width;
+  options.height = image.height;
+
+  /* Iterations to converge, ">" the limit if some plane has not */
+  printf ("%-16s", "resolver");
+
+  for (int scan = 0; scan_names[scan]; ++scan)
+    printf ("%18s", scan_names[scan]);
+
+  printf ("  fewest\n");
+
+  for (int resolver = 0; resolver_names[resolver]; ++resolver)
+    {
+      printf ("%-16s", resolver_names[resolver]);
+      best = -1;
+      best_iterations = 0;
+
+      for (int scan = 0; scan_names[scan]; ++scan)
+        {
+          char cell[32];
+
+          options.resolver = (ResolveMode)resolver;
+          options.scan = (ScanOrder)scan;
+          seconds = run (&image, &options);
+
+          snprintf (cell, sizeof (cell), "%s%d %.3fs",
+                    options.converged ? "" : ">",
+                    options.iterations_made, seconds);
+          printf ("%18s", cell);
+
+          if (options.converged
+              && (best < 0 || options.iterations_made < best_iterations))
+            {
+              best = scan;
+              best_iterations = options.iterations_made;
+            }
+        }
+
+      printf ("  %s\n", best < 0 ? "none converged" : scan_names[best]);
+    }
+
+  clean_image (&image);
+
+  return 0;
+}
@@ -0,0 +1,492 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "solver.h"
+
+/**
+ * File layout: the magic, varints of the geometry and settings (the scan
+ * order and probe budget included: they change the result), the hash of
+ * the source planes and the most iterations made by a plane, then for
+ * each plane its iterations made, resolved and converged followed by one
+ * block per row. A block is the varint of its size and the zig-zag varints
+ * of the row samples: the diff is mostly small numbers of both signs. The
+ * file ends with the FNV-1a hash of all the bytes before it.
+ */
+static const char checkpoint_magic[8] = { 'P', 'R', 'L', 'V', 'C', 'K', 'P', 3 };
+
+#define MAX_VARINT 10
+
+typedef struct
+{
+  FILE *file;
+  uint64_t hash;
+  bool ok;
+} Stream;
+
+static void
+hash_bytes (Stream *stream, unsigned char const *bytes, size_t size)
+{
+  for (size_t index = 0; index < size; ++index)
+    {
+      stream->hash ^= bytes[index];
+      stream->hash *= 0x100000001b3ull;
+    }
+}
+
+static void
+put_bytes (Stream *stream, void const *bytes, size_t size)
+{
+  hash_bytes (stream, (unsigned char const *)bytes, size);
+
+  if (stream->ok && fwrite (bytes, 1, size, stream->file) != size)
+    stream->ok = false;
+}
+
+static bool
+get_bytes (Stream *stream, void *bytes, size_t size)
+{
+  if (stream->ok && fread (bytes, 1, size, stream->file) != size)
+    stream->ok = false;
+
+  if (stream->ok)
+    hash_bytes (stream, (unsigned char const *)bytes, size);
+
+  return stream->ok;
+}
+
+static size_t
+encode_varint (unsigned char *buffer, uint64_t value)
+{
+  size_t size = 0;
+
+  while (value >= 0x80)
+    {
+      buffer[size++] = (unsigned char)(value | 0x80);
+      value >>= 7;
+    }
+
+  buffer[size++] = (unsigned char)value;
+
+  return size;
+}
+
+/**
+ * Decode a varint from `buffer` of `size` bytes. Returns the amount of bytes
+ * taken, or 0 if the varint is cut short.
+ */
+static size_t
+decode_varint (unsigned char const *buffer, size_t size, uint64_t *value)
+{
+  size_t length = 0;
+
+  *value = 0;
+
+  while (length < size && length < MAX_VARINT)
+    {
+      *value |= (uint64_t)(buffer[length] & 0x7f) << (7 * length);
+
+      if ((buffer[length++] & 0x80) == 0)
+        return length;
+    }
+
+  return 0;
+}
+
+static void
+put_varint (Stream *stream, uint64_t value)
+{
+  unsigned char buffer[MAX_VARINT];
+
+  put_bytes (stream, buffer, encode_varint (buffer, value));
+}
+
+static bool
+get_varint (Stream *stream, uint64_t *value)
+{
+  unsigned char buffer[MAX_VARINT];
+  size_t length = 0;
+
+  do
+    {
+      if (length == MAX_VARINT || !get_bytes (stream, &buffer[length], 1))
+        return stream->ok = false;
+    }
+  while (buffer[length++] & 0x80);
+
+  decode_varint (buffer, length, value);
+
+  return true;
+}
+
+static uint32_t
+zigzag (int value)
+{
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int
+unzigzag (uint32_t value)
+{
+  return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+uint64_t
+perlovka_checkpoint_source (PerlovkaOptions const *options,
+                            int *const *planes, int n_planes)
+{
+  size_t size = options->width * options->height;
+  uint64_t hash = 0xcbf29ce484222325ull;
+
+  for (int plane = 0; plane < n_planes; ++plane)
+    for (size_t index = 0; index < size; ++index)
+      {
+        hash ^= (uint32_t)planes[plane][index];
+        hash *= 0x100000001b3ull;
+      }
+
+  return hash;
+}
+
+static void
+put_header (Stream *stream, PerlovkaOptions const *options, int n_planes,
+            uint64_t source, PerlovkaOptions const *stats)
+{
+  int iterations_made = 0;
+
+  for (int plane = 0; plane < n_planes; ++plane)
+    if (stats[plane].iterations_made > iterations_made)
+      iterations_made = stats[plane].iterations_made;
+
+  put_bytes (stream, checkpoint_magic, sizeof (checkpoint_magic));
+  put_varint (stream, options->width);
+  put_varint (stream, options->height);
+  put_varint (stream, options->radius);
+  put_varint (stream, options->grid);
+  put_varint (stream, options->matching);
+  put_varint (stream, options->resolver);
+  put_varint (stream, options->field_matching);
+  put_varint (stream, options->scan);
+  put_varint (stream, options->probe_budget);
+  put_varint (stream, n_planes);
+  put_varint (stream, source);
+  put_varint (stream, iterations_made);
+}
+
+/**
+ * Read the header and check that it matches `options` and the `source`
+ * planes, and that the iterations limit of `options` is not exceeded yet
+ */
+static bool
+get_header (Stream *stream, PerlovkaOptions const *options, int n_planes,
+            uint64_t source)
+{
+  uint64_t expected[] = { options->width,          options->height,
+                          options->radius,         options->grid,
+                          options->matching,       options->resolver,
+                          options->field_matching, options->scan,
+                          options->probe_budget,   n_planes };
+  char magic[sizeof (checkpoint_magic)];
+  uint64_t value;
+
+  if (!get_bytes (stream, magic, sizeof (magic))
+      || memcmp (magic, checkpoint_magic, sizeof (magic)) != 0)
+    return false;
+
+  for (size_t index = 0; index < sizeof (expected) / sizeof (uint64_t);
+       ++index)
+    {
+      if (!get_varint (stream, &value) || value != expected[index])
+        return false;
+    }
+
+  return get_varint (stream, &value) && value == source
+         && get_varint (stream, &value)
+         && value <= (uint64_t)options->iterations;
+}
+
+bool
+perlovka_checkpoint_save (PerlovkaOptions const *options,
+                          int *const *planes, int n_planes,
+                          PerlovkaOptions const *stats, uint64_t source,
+                          const char *path)
+{
+  Stream stream = { NULL, 0xcbf29ce484222325ull, true };
+  unsigned char *block;
+  unsigned char trailer[8];
+  size_t temp_size = strlen (path) + 5;
+  char *temp = (char *)malloc (temp_size);
+  size_t size;
+
+  snprintf (temp, temp_size, "%s.tmp", path);
+  stream.file = fopen (temp, "wb");
+
+  if (stream.file == NULL)
+    {
+      free (temp);
+      return false;
+    }
+
+  block = (unsigned char *)malloc (options->width * 5);
+  put_header (&stream, options, n_planes, source, stats);
+
+  for (int plane = 0; plane < n_planes; ++plane)
+    {
+      put_varint (&stream, stats[plane].iterations_made);
+      put_varint (&stream, stats[plane].resolved);
+      put_varint (&stream, stats[plane].converged);
+
+      for (size_t y = 0; y < options->height; ++y)
+        {
+          int const *row = planes[plane] + y * options->width;
+
+          size = 0;
+
+          for (size_t x = 0; x < options->width; ++x)
+            size += encode_varint (block + size, zigzag (row[x]));
+
+          put_varint (&stream, size);
+          put_bytes (&stream, block, size);
+        }
+    }
+
+  for (int index = 0; index < 8; ++index)
+    trailer[index] = (unsigned char)(stream.hash >> (8 * index));
+
+  put_bytes (&stream, trailer, sizeof (trailer));
+
+  /* The old checkpoint is replaced only by a complete new one */
+  stream.ok = stream.ok && fflush (stream.file) == 0
+              && fsync (fileno (stream.file)) == 0;
+  stream.ok = fclose (stream.file) == 0 && stream.ok;
+  stream.ok = stream.ok && rename (temp, path) == 0;
+
+  if (!stream.ok)
+    unlink (temp);
+
+  free (block);
+  free (temp);
+
+  return stream.ok;
+}
+
+/**
+ * Check the hash of the whole file, so that a damaged one is rejected before
+ * the planes are touched
+ */
+static bool
+verify_file (FILE *file)
+{
+  Stream stream = { file, 0xcbf29ce484222325ull, true };
+  unsigned char buffer[65536];
+  unsigned char trailer[8];
+  uint64_t hash = 0;
+  long end;
+  long left;
+  size_t size;
+
+  if (fseek (file, 0, SEEK_END) != 0 || (end = ftell (file)) < 8
+      || fseek (file, 0, SEEK_SET) != 0)
+    return false;
+
+  for (left = end - 8; left > 0; left -= size)
+    {
+      size = left < (long)sizeof (buffer) ? (size_t)left : sizeof (buffer);
+
+      if (!get_bytes (&stream, buffer, size))
+        return false;
+    }
+
+  if (fread (trailer, 1, sizeof (trailer), file) != sizeof (trailer))
+    return false;
+
+  for (int index = 0; index < 8; ++index)
+    hash |= (uint64_t)trailer[index] << (8 * index);
+
+  return hash == stream.hash && fseek (file, 0, SEEK_SET) == 0;
+}
+
+bool
+perlovka_checkpoint_load (PerlovkaOptions const *options,
+                          int *const *planes, int n_planes,
+                          PerlovkaOptions *stats, uint64_t source,
+                          const char *path)
+{
+  Stream stream = { NULL, 0xcbf29ce484222325ull, true };
+  unsigned char *block = NULL;
+  uint64_t value;
+  uint64_t size;
+  size_t offset;
+  size_t length;
+  bool ok;
+
+  stream.file = fopen (path, "rb");
+
+  if (stream.file == NULL)
+    return false;
+
+  ok = verify_file (stream.file) && get_header (&stream, options, n_planes,
+                                                   source);
+
+  if (ok)
+    block = (unsigned char *)malloc (options->width * 5);
+
+  for (int plane = 0; ok && plane < n_planes; ++plane)
+    {
+      ok = get_varint (&stream, &value);
+      stats[plane].iterations_made = (int)value;
+      ok = ok && get_varint (&stream, &value);
+      stats[plane].resolved = value;
+      ok = ok && get_varint (&stream, &value);
+      stats[plane].converged = value != 0;
+
+      for (size_t y = 0; ok && y < options->height; ++y)
+        {
+          int *row = planes[plane] + y * options->width;
+
+          ok = get_varint (&stream, &size) && size <= options->width * 5
+               && get_bytes (&stream, block, size);
+
+          offset = 0;
+
+          for (size_t x = 0; ok && x < options->width; ++x)
+            {
+              length = decode_varint (block + offset, size - offset, &value);
+              row[x] = unzigzag ((uint32_t)value);
+              offset += length;
+              ok = length > 0;
+            }
+        }
+    }
+
+  free (block);
+  fclose (stream.file);
+
+  return ok;
+}
+
+bool
+perlovka_denoize_checkpointed (PerlovkaOptions *options,
+                               int *const *planes, int n_planes,
+                               const char *path, int interval,
+                               int *resumed)
+{
+  PerlovkaOptions *stats;
+  PSolver solver;
+  uint64_t source;
+  int limit = options->iterations;
+  bool saved = true;
+  bool done;
+
+  *resumed = 0;
+
+  if (!perlovka_solve_resumable (options))
+    return false;
+
+  stats = (PerlovkaOptions *)malloc (sizeof (PerlovkaOptions)
+                                     * (n_planes > 0 ? n_planes : 1));
+  source = perlovka_checkpoint_source (options, planes, n_planes);
+
+  for (int plane = 0; plane < n_planes; ++plane)
+    {
+      stats[plane] = *options;
+      stats[plane].data = planes[plane];
+      stats[plane].iterations_made = 0;
+      stats[plane].resolved = 0;
+      stats[plane].converged = false;
+    }
+
+  if (perlovka_checkpoint_load (options, planes, n_planes, stats, source,
+                                path))
+    {
+      for (int plane = 0; plane < n_planes; ++plane)
+        if (stats[plane].iterations_made > *resumed)
+          *resumed = stats[plane].iterations_made;
+    }
+  else
+    {
+      for (int plane = 0; plane < n_planes; ++plane)
+        perlovka_diff (&stats[plane]);
+    }
+
+  solver = build_solver (options->width, options->radius, options->grid,
+                         options->matching, options->resolver,
+                         options->field_matching);
+
+  /*
+     The planes advance together by `interval` iterations. Raising the limit
+     of a solve continues it exactly, so the result does not depend on where
+     the run was split.
+  */
+  do
+    {
+      done = true;
+
+      for (int plane = 0; plane < n_planes; ++plane)
+        {
+          PerlovkaOptions *plane_stats = &stats[plane];
+
+          if (plane_stats->converged || plane_stats->iterations_made >= limit)
+            continue;
+
+          plane_stats->iterations = plane_stats->iterations_made + interval;
+
+          if (plane_stats->iterations > limit)
+            plane_stats->iterations = limit;
+
+          perlovka_solve_plan (plane_stats, solver);
+          done = done && (plane_stats->converged
+                          || plane_stats->iterations_made >= limit);
+        }
+
+      /* A cancelled iteration is left half done: it must not be saved */
+      if (options->cancelled && options->cancelled (options->context))
+        break;
+
+      saved = perlovka_checkpoint_save (options, planes, n_planes, stats,
+                                        source, path)
+              && saved;
+    }
+  while (!done);
+
+  clean_solver (solver);
+
+  options->iterations_made = 0;
+  options->resolved = 0;
+  options->converged = true;
+
+  for (int plane = 0; plane < n_planes; ++plane)
+    {
+      perlovka_undiff (&stats[plane]);
+
+      if (stats[plane].iterations_made > options->iterations_made)
+        options->iterations_made = stats[plane].iterations_made;
+
+      options->resolved += stats[plane].resolved;
+      options->converged = options->converged && stats[plane].converged;
+    }
+
+  free (stats);
+
+  return saved;
+}
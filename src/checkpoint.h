@@ -0,0 +1,76 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+
+#include "perlovka.h"
+
+/**
+ * Checkpoints of a long run: the twofold diffs of the planes between
+ * iterations, so that a restarted run continues where the saved one stopped
+ * and ends with the same result
+ */
+
+/**
+ * Hash of the `n_planes` source planes a checkpoint is taken from, so that
+ * it is never continued on another image of the same size
+ */
+uint64_t perlovka_checkpoint_source (PerlovkaOptions const *options,
+                                     int *const *planes, int n_planes);
+
+/**
+ * Save the twofold diffs `planes` solved by `stats[plane]` with the settings
+ * and geometry of `options` from the planes hashed to `source`. The file is
+ * replaced atomically, so an earlier checkpoint survives a failed save.
+ */
+bool perlovka_checkpoint_save (PerlovkaOptions const *options,
+                               int *const *planes, int n_planes,
+                               PerlovkaOptions const *stats, uint64_t source,
+                               const char *path);
+
+/**
+ * Restore the diffs and the iterations made, resolved and converged of each
+ * plane. Returns false if the file is missing, damaged, saved with other
+ * settings or geometry, taken from other planes than `source`, or beyond the
+ * iterations limit of `options`; the file is checked before `planes` are
+ * written.
+ */
+bool perlovka_checkpoint_load (PerlovkaOptions const *options,
+                               int *const *planes, int n_planes,
+                               PerlovkaOptions *stats, uint64_t source,
+                               const char *path);
+
+/**
+ * Denoize whole planes like `perlovka_denoize_tiled` without tiles, saving a
+ * checkpoint to `path` after every `interval` iterations. A checkpoint left
+ * there by an interrupted run of the same planes with the same settings and
+ * no more iterations than the limit is continued from, any other one is
+ * started over; `resumed` receives its iteration, or 0. The file is kept,
+ * remove it once the result is stored. Returns false if a checkpoint could
+ * not be saved; the planes are denoized anyway. The options must be
+ * resumable (see `perlovka_solve_resumable`), else false is returned and the
+ * planes are left as they are.
+ */
+bool perlovka_denoize_checkpointed (PerlovkaOptions *options,
+                                    int *const *planes, int n_planes,
+                                    const char *path, int interval,
+                                    int *resumed);
+
+#endif
@@ -0,0 +1,1485 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "checkpoint.h"
+#include "cli.h"
+#include "daemon.h"
+#include "farm.h"
+#include "outofcore.h"
+#include "pyramid.h"
+#include "stream.h"
+#include "sweep.h"
+#include "task.h"
+#include "tiles.h"
+
+
+static const char *grid_names[] = { "odd", "even", "both", NULL };
+static const char *matching_names[] = { "soft", "strict", NULL };
+static const char *resolver_names[]
+    = { "minimal", "least-of-max", "largest-of-min", "maximal", NULL };
+static const char *scan_names[]
+    = { "raster", "alternate", "serpentine", "blocks", NULL };
+static const char *priority_names[] = { "interactive", "batch", NULL };
+static const char *io_names[] = { "auto", "uring", "threads", NULL };
+static const char *stop_names[]
+    = { "converged", "gain below limit", "iterations limit", "cancelled" };
+
+static void
+usage (void)
+{
+  fprintf (stderr,
+           "Usage: perlovka-cli [OPTIONS] INPUT OUTPUT\n"
+           "       perlovka-cli [OPTIONS] --batch=DIR INPUT...\n"
+           "Reduce film grain in PGM, PPM, PAM or raw planar images.\n"
+           "\n"
+           "  -r, --radius=N          maximal grain radius (default 5)\n"
+           "  -i, --iterations=N      iterations limit (default 5)\n"
+           "  -g, --grid=GRID         odd, even or both (default odd)\n"
+           "  -m, --matching=MODE     soft or strict (default soft)\n"
+           "  -s, --resolver=MODE     minimal, least-of-max, largest-of-min\n"
+           "                          or maximal (default minimal)\n"
+           "  -f, --field-matching    compensate pixels around diagonals too\n"
+           "      --scan=ORDER        raster, alternate (direction flips every\n"
+           "                          iteration), serpentine or blocks\n"
+           "                          (default raster)\n"
+           "      --adaptive-radius   denoize every tile (default 256) with\n"
+           "                          the radius its grain calls for, up to\n"
+           "                          --radius; tiles without grain are kept\n"
+           "      --prune=RATIO       after each iteration drop the boxes\n"
+           "                          compensating less than RATIO of their\n"
+           "                          probes (faster, slightly different)\n"
+           "      --min-gain=RATIO    stop once an iteration changes less\n"
+           "                          than RATIO of the first one, freezing\n"
+           "                          the pixels flipping back and forth\n"
+           "      --probe-budget=K    probe at most K x ITERATION boxes of\n"
+           "                          the plan at each pixel (bounded cost,\n"
+           "                          slightly different)\n"
+           "  -j, --threads=N         worker threads (default 1)\n"
+           "  -t, --tile=N            denoize in N x N tiles (default whole "
+           "image)\n"
+           "      --raw=WxHxC[xBITS]  headerless planar input and output,\n"
+           "                          BITS is 8 or 16 (little-endian)\n"
+           "      --stream            denoize PNM row by row keeping only a\n"
+           "                          window of rows in memory, \"-\" stands\n"
+           "                          for standard input and output\n"
+           "  -b, --batch=DIR         denoize files, directories and @lists\n"
+           "                          into DIR: reading, denoizing (--threads)\n"
+           "                          and writing run as a pipeline\n"
+           "      --readers=N         batch reader threads (default 1)\n"
+           "      --writers=N         batch writer threads (default 1)\n"
+           "      --queue=N           images waiting between batch stages\n"
+           "                          (default 2 x threads)\n"
+           "      --sequence          batch of film frames: each worker keeps\n"
+           "                          its solver plans and buffers from frame\n"
+           "                          to frame, frames are written in order\n"
+           "      --frame-stats=FILE  write per-frame statistics of a batch\n"
+           "                          as CSV\n"
+           "      --connect[=PATH]    let the perlovkad daemon listening on\n"
+           "                          PATH denoize the image\n"
+           "      --priority=CLASS    interactive or batch daemon job\n"
+           "                          (default interactive)\n"
+           "      --farm=N|ADDRESSES  denoize tiles (default 1024) in N local\n"
+           "                          worker processes or in the workers at\n"
+           "                          comma separated HOST:PORT addresses\n"
+           "      --farm-worker=[HOST:]PORT\n"
+           "                          run as a farm worker\n"
+           "      --out-of-core       denoize tiles (default 1024) file to\n"
+           "                          file keeping two tiles in memory\n"
+           "      --io=BACKEND        out-of-core I/O: auto, uring or threads\n"
+           "                          (default auto)\n"
+           "      --checkpoint=FILE   save the state to FILE between iterations\n"
+           "                          and continue from it when restarted\n"
+           "      --checkpoint-every=N\n"
+           "                          iterations between checkpoints (default 1)\n"
+           "      --deadline=SECONDS  begin no iteration after SECONDS and keep\n"
+           "                          the result so far\n"
+           "      --pyramid=LEVELS    denoize coarse grain on the image halved\n"
+           "                          LEVELS times, then refine at full size\n"
+           "      --fine-radius=N     radius of the pyramid refinement\n"
+           "                          (default 3)\n"
+           "      --sweep-resolvers=LIST\n"
+           "      --sweep-matching=LIST\n"
+           "      --sweep-iterations=LIST\n"
+           "                          denoize with every comma separated\n"
+           "                          resolver and matching mode (default\n"
+           "                          --resolver and --matching), writing\n"
+           "                          OUTPUT-RESOLVER-MATCHING-N after each\n"
+           "                          ascending iteration count N (default\n"
+           "                          --iterations); the image is read and\n"
+           "                          diffed once\n"
+           "  -q, --quiet             do not print statistics\n"
+           "  -h, --help              show this help\n");
+}
+
+static bool
+parse_name (const char *value, const char **names, int *result)
+{
+  for (int index = 0; names[index]; ++index)
+    {
+      if (strcmp (value, names[index]) == 0)
+        {
+          *result = index;
+          return true;
+        }
+    }
+
+  return false;
+}
+
+static bool
+parse_int (const char *value, int low, int high, int *result)
+{
+  char *end;
+  long number = strtol (value, &end, 10);
+
+  if (*value == '\0' || *end != '\0' || number < low || number > high)
+    return false;
+
+  *result = (int)number;
+
+  return true;
+}
+
+/**
+ * Parse comma separated names of `names`, or integers from 1 to `high` when
+ * `names` is NULL, into at most `capacity` items
+ */
+static bool
+parse_list (const char *value, const char **names, int high, int *items,
+            int capacity, int *count)
+{
+  char *copy = strdup (value);
+  char *state;
+  char *token;
+  bool ok = true;
+
+  *count = 0;
+
+  for (token = strtok_r (copy, ",", &state); ok && token;
+       token = strtok_r (NULL, ",", &state))
+    {
+      ok = *count < capacity
+           && (names ? parse_name (token, names, &items[*count])
+                     : parse_int (token, 1, high, &items[*count]));
+      ++*count;
+    }
+
+  free (copy);
+
+  return ok && *count > 0;
+}
+
+static bool
+parse_raw (const char *value, CliSettings *settings)
+{
+  unsigned long width;
+  unsigned long height;
+  int channels;
+  int bits = 8;
+  int count;
+
+  count = sscanf (value, "%lux%lux%dx%d", &width, &height, &channels, &bits);
+
+  if (count < 3 || width == 0 || height == 0 || channels < 1 || channels > 4
+      || (bits != 8 && bits != 16))
+    return false;
+
+  settings->layout = IMAGE_RAW;
+  settings->raw_width = width;
+  settings->raw_height = height;
+  settings->raw_channels = channels;
+  settings->raw_bits = bits;
+
+  return true;
+}
+
+/**
+ * Ways of running, at most one per invocation
+ */
+typedef enum
+{
+  MODE_IMAGE,
+  MODE_STREAM,
+  MODE_BATCH,
+  MODE_DAEMON,
+  MODE_FARM,
+  MODE_FARM_WORKER,
+  MODE_OUT_OF_CORE,
+  MODE_CHECKPOINT,
+  MODE_DEADLINE,
+  MODE_PYRAMID,
+  MODE_ADAPTIVE,
+  MODE_SWEEP,
+  N_MODES
+} CliMode;
+
+/**
+ * Options applying to some of the modes only
+ */
+typedef enum
+{
+  USE_TILE = 1 << 0,
+  USE_RAW = 1 << 1,
+  USE_PRUNE = 1 << 2,
+  USE_MIN_GAIN = 1 << 3,
+  USE_PROBE_BUDGET = 1 << 4,
+  USE_SCAN = 1 << 5,
+  USE_SEQUENCE = 1 << 6,
+  USE_FRAME_STATS = 1 << 7,
+  N_USES = 8
+} CliUse;
+
+/**
+ * Solve options held within one solve call: a mode solving in several calls
+ * would start them over
+ */
+#define USE_ONE_CALL (USE_PRUNE | USE_MIN_GAIN)
+
+/**
+ * Solve options depending only on the iteration number
+ */
+#define USE_ITERATION (USE_PROBE_BUDGET | USE_SCAN)
+
+static const char *use_names[] = { "--tile",         "--raw",
+                                   "--prune",        "--min-gain",
+                                   "--probe-budget", "--scan",
+                                   "--sequence",     "--frame-stats" };
+
+typedef struct
+{
+  const char *name;
+  unsigned uses;
+} ModeRule;
+
+/**
+ * Options each mode takes, in the order of `CliMode`
+ */
+static const ModeRule mode_rules[] = {
+  { "a single image",
+    USE_TILE | USE_RAW | USE_ONE_CALL | USE_ITERATION },
+
+  /* Rows are solved as they arrive, with the whole plan in raster order */
+  { "--stream", 0 },
+
+  { "--batch", USE_TILE | USE_RAW | USE_ONE_CALL | USE_ITERATION
+                   | USE_SEQUENCE | USE_FRAME_STATS },
+
+  { "--connect", USE_TILE | USE_RAW | USE_ONE_CALL | USE_ITERATION },
+
+  { "--farm", USE_TILE | USE_RAW | USE_ONE_CALL | USE_ITERATION },
+
+  /* Every setting comes with the tiles */
+  { "--farm-worker", 0 },
+
+  { "--out-of-core", USE_TILE | USE_RAW | USE_ONE_CALL | USE_ITERATION },
+
+  /* Whole planes are saved between iterations solved in calls of their own,
+     and so are the deadline iterations and the sweep snapshots */
+  { "--checkpoint", USE_RAW | USE_ITERATION },
+  { "--deadline", USE_RAW | USE_ITERATION },
+
+  /* The levels are denoized whole */
+  { "--pyramid", USE_RAW | USE_ONE_CALL | USE_ITERATION },
+
+  { "--adaptive-radius",
+    USE_TILE | USE_RAW | USE_ONE_CALL | USE_ITERATION },
+  { "--sweep-*", USE_RAW | USE_ITERATION },
+};
+
+/**
+ * Reject modes used together and options a mode does not take, telling
+ * which on stderr
+ */
+static bool
+check_mode (CliSettings const *settings)
+{
+  PerlovkaOptions const *options = &settings->options;
+  bool modes[N_MODES] = { false };
+  unsigned uses = 0;
+  CliMode mode = MODE_IMAGE;
+
+  modes[MODE_STREAM] = settings->stream;
+  modes[MODE_BATCH] = settings->batch_dir != NULL;
+  modes[MODE_DAEMON] = settings->daemon_path != NULL;
+  modes[MODE_FARM] = settings->farm != NULL;
+  modes[MODE_FARM_WORKER] = settings->farm_worker != NULL;
+  modes[MODE_OUT_OF_CORE] = settings->out_of_core;
+  modes[MODE_CHECKPOINT] = settings->checkpoint != NULL;
+  modes[MODE_DEADLINE] = settings->deadline > 0;
+  modes[MODE_PYRAMID] = settings->pyramid_levels > 0;
+  modes[MODE_ADAPTIVE] = settings->adaptive;
+  modes[MODE_SWEEP] = settings->n_sweep_resolvers > 0
+                      || settings->n_sweep_matchings > 0
+                      || settings->n_sweep_iterations > 0;
+
+  for (int index = MODE_IMAGE + 1; index < N_MODES; ++index)
+    {
+      if (!modes[index])
+        continue;
+
+      if (mode != MODE_IMAGE)
+        {
+          fprintf (stderr, "perlovka-cli: %s cannot be combined with %s\n",
+                   mode_rules[index].name, mode_rules[mode].name);
+          return false;
+        }
+
+      mode = (CliMode)index;
+    }
+
+  uses |= settings->tile_size > 0 ? USE_TILE : 0;
+  uses |= settings->layout != IMAGE_PNM ? USE_RAW : 0;
+  uses |= options->prune_below > 0 ? USE_PRUNE : 0;
+  uses |= options->min_gain > 0 ? USE_MIN_GAIN : 0;
+  uses |= options->probe_budget > 0 ? USE_PROBE_BUDGET : 0;
+  uses |= options->scan != SCAN_RASTER ? USE_SCAN : 0;
+  uses |= settings->sequence ? USE_SEQUENCE : 0;
+  uses |= settings->frame_stats ? USE_FRAME_STATS : 0;
+
+  for (int use = 0; use < N_USES; ++use)
+    {
+      if ((uses & (1u << use)) && !(mode_rules[mode].uses & (1u << use)))
+        {
+          fprintf (stderr, "perlovka-cli: %s does not apply to %s\n",
+                   use_names[use], mode_rules[mode].name);
+          return false;
+        }
+    }
+
+  return true;
+}
+
+/**
+ * Outcome of the command line: usable, malformed or a combination not
+ * supported
+ */
+typedef enum
+{
+  PARSE_OK,
+  PARSE_USAGE,
+  PARSE_CONFLICT
+} ParseResult;
+
+static ParseResult
+parse_args (int argc, char **argv, CliSettings *settings)
+{
+  static struct option long_options[] = {
+    { "radius", required_argument, NULL, 'r' },
+    { "iterations", required_argument, NULL, 'i' },
+    { "grid", required_argument, NULL, 'g' },
+    { "matching", required_argument, NULL, 'm' },
+    { "resolver", required_argument, NULL, 's' },
+    { "field-matching", no_argument, NULL, 'f' },
+    { "threads", required_argument, NULL, 'j' },
+    { "tile", required_argument, NULL, 't' },
+    { "raw", required_argument, NULL, 'R' },
+    { "stream", no_argument, NULL, 'S' },
+    { "batch", required_argument, NULL, 'b' },
+    { "readers", required_argument, NULL, 'D' },
+    { "writers", required_argument, NULL, 'E' },
+    { "queue", required_argument, NULL, 'Q' },
+    { "sequence", no_argument, NULL, 'L' },
+    { "frame-stats", required_argument, NULL, 'T' },
+    { "connect", optional_argument, NULL, 'C' },
+    { "priority", required_argument, NULL, 'P' },
+    { "farm", required_argument, NULL, 'F' },
+    { "farm-worker", required_argument, NULL, 'W' },
+    { "out-of-core", no_argument, NULL, 'O' },
+    { "io", required_argument, NULL, 'I' },
+    { "checkpoint", required_argument, NULL, 'K' },
+    { "checkpoint-every", required_argument, NULL, 'N' },
+    { "deadline", required_argument, NULL, 'X' },
+    { "pyramid", required_argument, NULL, 'Y' },
+    { "fine-radius", required_argument, NULL, 'Z' },
+    { "prune", required_argument, NULL, 'U' },
+    { "adaptive-radius", no_argument, NULL, 'A' },
+    { "min-gain", required_argument, NULL, 'G' },
+    { "probe-budget", required_argument, NULL, 'B' },
+    { "scan", required_argument, NULL, 'V' },
+    { "sweep-resolvers", required_argument, NULL, 'H' },
+    { "sweep-matching", required_argument, NULL, 'J' },
+    { "sweep-iterations", required_argument, NULL, 'M' },
+    { "quiet", no_argument, NULL, 'q' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 },
+  };
+
+  PerlovkaOptions *options = &settings->options;
+  char *end;
+  int value;
+  int c;
+  bool ok = true;
+
+  while (ok
+         && (c = getopt_long (argc, argv, "r:i:g:m:s:fj:t:b:qh", long_options,
+                              NULL))
+                != -1)
+    {
+      switch (c)
+        {
+        case 'r':
+          ok = parse_int (optarg, 1, 100, &options->radius);
+          break;
+
+        case 'i':
+          ok = parse_int (optarg, 1, 100, &options->iterations);
+          break;
+
+        case 'g':
+          ok = parse_name (optarg, grid_names, &value);
+          options->grid = (Grid)value;
+          break;
+
+        case 'm':
+          ok = parse_name (optarg, matching_names, &value);
+          options->matching = (MatchMode)value;
+          break;
+
+        case 's':
+          ok = parse_name (optarg, resolver_names, &value);
+          options->resolver = (ResolveMode)value;
+          break;
+
+        case 'f':
+          options->field_matching = true;
+          break;
+
+        case 'j':
+          ok = parse_int (optarg, 1, 1024, &settings->threads);
+          break;
+
+        case 't':
+          ok = parse_int (optarg, 0, 1 << 20, &value);
+          settings->tile_size = value;
+          break;
+
+        case 'R':
+          ok = parse_raw (optarg, settings);
+          break;
+
+        case 'S':
+          settings->stream = true;
+          break;
+
+        case 'b':
+          settings->batch_dir = optarg;
+          break;
+
+        case 'D':
+          ok = parse_int (optarg, 1, 64, &settings->readers);
+          break;
+
+        case 'E':
+          ok = parse_int (optarg, 1, 64, &settings->writers);
+          break;
+
+        case 'Q':
+          ok = parse_int (optarg, 1, 1024, &settings->queue_size);
+          break;
+
+        case 'L':
+          settings->sequence = true;
+          break;
+
+        case 'T':
+          settings->frame_stats = optarg;
+          break;
+
+        case 'C':
+          settings->daemon_path = optarg ? optarg : "";
+          break;
+
+        case 'P':
+          ok = parse_name (optarg, priority_names, &settings->priority);
+          break;
+
+        case 'F':
+          settings->farm = optarg;
+          break;
+
+        case 'W':
+          settings->farm_worker = optarg;
+          break;
+
+        case 'O':
+          settings->out_of_core = true;
+          break;
+
+        case 'I':
+          ok = parse_name (optarg, io_names, &settings->io_backend);
+          break;
+
+        case 'K':
+          settings->checkpoint = optarg;
+          break;
+
+        case 'N':
+          ok = parse_int (optarg, 1, 100, &settings->checkpoint_interval);
+          break;
+
+        case 'X':
+          settings->deadline = strtod (optarg, &end);
+          ok = *optarg != '\0' && *end == '\0' && settings->deadline > 0;
+          break;
+
+        case 'Y':
+          ok = parse_int (optarg, 1, 8, &settings->pyramid_levels);
+          break;
+
+        case 'Z':
+          ok = parse_int (optarg, 1, 100, &settings->fine_radius);
+          break;
+
+        case 'U':
+          options->prune_below = strtod (optarg, &end);
+          ok = *optarg != '\0' && *end == '\0' && options->prune_below > 0
+               && options->prune_below < 1;
+          break;
+
+        case 'A':
+          settings->adaptive = true;
+          break;
+
+        case 'G':
+          options->min_gain = strtod (optarg, &end);
+          ok = *optarg != '\0' && *end == '\0' && options->min_gain > 0
+               && options->min_gain < 1;
+          break;
+
+        case 'B':
+          ok = parse_int (optarg, 1, 10000, &options->probe_budget);
+          break;
+
+        case 'V':
+          ok = parse_name (optarg, scan_names, &value);
+          options->scan = (ScanOrder)value;
+          break;
+
+        case 'H':
+          ok = parse_list (optarg, resolver_names, 0,
+                           settings->sweep_resolvers, 4,
+                           &settings->n_sweep_resolvers);
+          break;
+
+        case 'J':
+          ok = parse_list (optarg, matching_names, 0,
+                           settings->sweep_matchings, 2,
+                           &settings->n_sweep_matchings);
+          break;
+
+        case 'M':
+          ok = parse_list (optarg, NULL, 1000, settings->sweep_iterations,
+                           PERLOVKA_SWEEP_SNAPSHOTS,
+                           &settings->n_sweep_iterations);
+
+          for (int index = 1; ok && index < settings->n_sweep_iterations;
+               ++index)
+            ok = settings->sweep_iterations[index]
+                 > settings->sweep_iterations[index - 1];
+          break;
+
+        case 'q':
+          settings->quiet = true;
+          break;
+
+        default:
+          ok = false;
+          break;
+        }
+    }
+
+  if (!ok)
+    return PARSE_USAGE;
+
+  if (!check_mode (settings))
+    return PARSE_CONFLICT;
+
+  if (settings->farm_worker)
+    return optind == argc ? PARSE_OK : PARSE_USAGE;
+
+  if (settings->batch_dir)
+    {
+      settings->batch_inputs = argv + optind;
+      settings->batch_count = argc - optind;
+
+      if (settings->queue_size == 0)
+        settings->queue_size = 2 * settings->threads;
+
+      /* One writer puts the frames in order */
+      if (settings->sequence)
+        settings->writers = 1;
+
+      return settings->batch_count > 0 ? PARSE_OK : PARSE_USAGE;
+    }
+
+  if (optind + 2 != argc)
+    return PARSE_USAGE;
+
+  settings->input = argv[optind];
+  settings->output = argv[optind + 1];
+
+  return PARSE_OK;
+}
+
+double
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+bool
+load_image (CliSettings const *settings, const char *file_name, Image *image)
+{
+  if (settings->layout == IMAGE_PNM)
+    return read_pnm (image, file_name);
+
+  memset (image, 0, sizeof (Image));
+  image->width = settings->raw_width;
+  image->height = settings->raw_height;
+  image->channels = settings->raw_channels;
+  image->maxval = settings->raw_bits == 16 ? 65535 : 255;
+
+  return read_raw (image, file_name);
+}
+
+bool
+save_image (Image const *image, const char *file_name)
+{
+  if (image->layout == IMAGE_PNM)
+    return write_pnm (image, file_name);
+
+  return write_raw (image, file_name);
+}
+
+void
+print_stats (Image const *image, PerlovkaOptions const *options,
+             const char *name, double read_time, double denoize_time,
+             double write_time)
+{
+  double megapixels
+      = image->width * image->height * image->color_channels * 1e-6;
+
+  fprintf (stderr, "%s: %zux%zu, %d channel(s), %d-bit\n", name,
+           image->width, image->height, image->color_channels,
+           image->maxval > 255 ? 16 : 8);
+  fprintf (stderr, "iterations: %d%s, compensations: %zu\n",
+           options->iterations_made, options->converged ? " (converged)" : "",
+           options->resolved);
+
+  if (options->prune_below > 0)
+    fprintf (stderr, "pruned: %zu box(es) below %g compensations per probe\n",
+             options->pruned, options->prune_below);
+
+  if (options->min_gain > 0)
+    fprintf (stderr, "stopped: %s, last gain %.4g, %zu sample(s) frozen\n",
+             stop_names[options->stopped], options->gain, options->frozen);
+
+  fprintf (stderr,
+           "read: %.3f s, denoize: %.3f s (%.2f MP/s), write: %.3f s\n",
+           read_time, denoize_time, megapixels / denoize_time, write_time);
+}
+
+/**
+ * Alpha rows wait here until the color rows are denoized
+ */
+typedef struct
+{
+  int **rows;
+  size_t capacity;
+  size_t head;
+  size_t count;
+} RowQueue;
+
+static void
+queue_push (RowQueue *queue, int const *row, size_t width)
+{
+  size_t index;
+
+  if (queue->count == queue->capacity)
+    {
+      queue->capacity = queue->capacity ? queue->capacity * 2 : 16;
+      queue->rows = (int **)realloc (queue->rows,
+                                     sizeof (int *) * queue->capacity);
+
+      /* Unwrap the ring into the grown array */
+      for (index = 0; index < queue->head; ++index)
+        queue->rows[queue->count + index] = queue->rows[index];
+
+      for (index = 0; index < queue->count; ++index)
+        queue->rows[index] = queue->rows[queue->head + index];
+
+      queue->head = 0;
+    }
+
+  index = (queue->head + queue->count) % queue->capacity;
+  queue->rows[index] = (int *)malloc (sizeof (int) * width);
+  memcpy (queue->rows[index], row, sizeof (int) * width);
+  ++queue->count;
+}
+
+static void
+queue_pop (RowQueue *queue, int *row, size_t width)
+{
+  memcpy (row, queue->rows[queue->head], sizeof (int) * width);
+  free (queue->rows[queue->head]);
+  queue->head = (queue->head + 1) % queue->capacity;
+  --queue->count;
+}
+
+/**
+ * Denoize PNM from input to output row by row
+ */
+static int
+stream_image (CliSettings *settings)
+{
+  Image image;
+  PerlovkaOptions stats;
+  PStream streams[4];
+  RowQueue alpha[4];
+  int *rows[4];
+  FILE *input;
+  FILE *output;
+  double started;
+  size_t ready;
+  size_t written = 0;
+  size_t y;
+  int channel;
+  bool ok;
+
+  input = strcmp (settings->input, "-") == 0 ? stdin
+                                              : fopen (settings->input, "rb");
+  output = strcmp (settings->output, "-") == 0
+               ? stdout
+               : fopen (settings->output, "wb");
+
+  ok = input && output && read_pnm_header (&image, input)
+       && write_pnm_header (&image, output);
+
+  if (!ok)
+    {
+      fprintf (stderr, "perlovka-cli: cannot stream %s to %s\n",
+               settings->input, settings->output);
+      return 1;
+    }
+
+  started = now ();
+  settings->options.width = image.width;
+  memset (alpha, 0, sizeof (alpha));
+
+  for (channel = 0; channel < image.channels; ++channel)
+    {
+      rows[channel] = (int *)malloc (sizeof (int) * image.width);
+
+      if (channel < image.color_channels)
+        streams[channel] = perlovka_stream_new (&settings->options);
+    }
+
+  for (y = 0; ok && y <= image.height; ++y)
+    {
+      if (y < image.height)
+        {
+          ok = read_pnm_row (&image, input, rows);
+
+          for (channel = 0; ok && channel < image.channels; ++channel)
+            {
+              if (channel < image.color_channels)
+                perlovka_stream_push (streams[channel], rows[channel]);
+              else
+                queue_push (&alpha[channel], rows[channel], image.width);
+            }
+        }
+      else
+        {
+          for (channel = 0; channel < image.color_channels; ++channel)
+            perlovka_stream_finish (streams[channel]);
+        }
+
+      ready = image.height;
+
+      for (channel = 0; channel < image.color_channels; ++channel)
+        {
+          if (perlovka_stream_ready (streams[channel]) < ready)
+            ready = perlovka_stream_ready (streams[channel]);
+        }
+
+      for (; ok && ready > 0; --ready, ++written)
+        {
+          for (channel = 0; channel < image.channels; ++channel)
+            {
+              if (channel < image.color_channels)
+                {
+                  perlovka_stream_pull (streams[channel], rows[channel]);
+                  perlovka_clamp_row (rows[channel], image.width, 0,
+                                      image.maxval);
+                }
+              else
+                {
+                  queue_pop (&alpha[channel], rows[channel], image.width);
+                }
+            }
+
+          ok = write_pnm_row (&image, output, rows);
+        }
+    }
+
+  if (output != stdout && fclose (output) != 0)
+    ok = false;
+
+  if (input != stdin)
+    fclose (input);
+
+  perlovka_init_options (&stats);
+
+  if (image.color_channels > 0)
+    perlovka_stream_stats (streams[0], &stats);
+
+  for (channel = 0; channel < image.channels; ++channel)
+    {
+      free (rows[channel]);
+
+      if (channel < image.color_channels)
+        perlovka_stream_free (streams[channel]);
+      else
+        free (alpha[channel].rows);
+    }
+
+  if (!ok || written != image.height)
+    {
+      fprintf (stderr, "perlovka-cli: cannot stream %s to %s\n",
+               settings->input, settings->output);
+      return 1;
+    }
+
+  if (!settings->quiet)
+    print_stats (&image, &stats, settings->input, 0.0, now () - started, 0.0);
+
+  return 0;
+}
+
+/**
+ * Let perlovkad denoize the color planes: they are copied into shared memory
+ * the daemon works on in place
+ */
+static bool
+submit_image (CliSettings *settings, Image *image)
+{
+  PerlovkaOptions *options = &settings->options;
+  PerlovkaJob job;
+  PerlovkaReply reply;
+  char path[256];
+  size_t plane = image->width * image->height;
+  size_t size = sizeof (int) * plane * image->color_channels;
+  int *memory;
+  int socket;
+  int fd;
+  bool ok;
+
+  if (image->color_channels == 0)
+    return true;
+
+  if (*settings->daemon_path)
+    snprintf (path, sizeof (path), "%s", settings->daemon_path);
+  else
+    perlovka_daemon_default_path (path, sizeof (path));
+
+  socket = perlovka_daemon_connect (path);
+
+  if (socket < 0)
+    {
+      fprintf (stderr, "perlovka-cli: cannot connect to %s\n", path);
+      return false;
+    }
+
+  memory = (int *)perlovka_daemon_alloc (size, &fd);
+
+  if (memory == NULL)
+    {
+      close (socket);
+      return false;
+    }
+
+  for (int channel = 0; channel < image->color_channels; ++channel)
+    memcpy (memory + channel * plane, image->planes[channel],
+            sizeof (int) * plane);
+
+  perlovka_job_init (&job, options, image->color_channels,
+                     settings->tile_size, (PerlovkaPriority)settings->priority);
+  ok = perlovka_daemon_submit (socket, &job, fd, &reply)
+       && reply.status == PERLOVKA_DAEMON_OK;
+
+  if (ok)
+    {
+      for (int channel = 0; channel < image->color_channels; ++channel)
+        memcpy (image->planes[channel], memory + channel * plane,
+                sizeof (int) * plane);
+
+      options->iterations_made = reply.stats.iterations_made;
+      options->resolved = reply.stats.resolved;
+      options->converged = reply.stats.converged;
+
+      if (!settings->quiet)
+        fprintf (stderr, "daemon: queued %.3f s, denoized %.3f s, %s\n",
+                 reply.queued, reply.stats.seconds,
+                 reply.stats.runs > 1 ? "warm context" : "new context");
+    }
+  else
+    {
+      fprintf (stderr, "perlovka-cli: daemon at %s has failed the job\n",
+               path);
+    }
+
+  perlovka_daemon_release (memory, size, fd);
+  close (socket);
+
+  return ok;
+}
+
+/**
+ * Denoize the input file into the output file tile by tile without loading
+ * the image
+ */
+static int
+denoize_out_of_core (CliSettings *settings)
+{
+  PerlovkaFile input;
+  PerlovkaFile output;
+  PerlovkaFileStats stats;
+  Image image;
+  TileIO *io;
+  FILE *input_file;
+  FILE *output_file;
+  off_t size;
+  double started;
+  bool ok;
+
+  memset (&image, 0, sizeof (Image));
+  input_file = fopen (settings->input, "rb");
+  output_file = fopen (settings->output, "wb");
+
+  if (settings->layout == IMAGE_PNM)
+    {
+      ok = input_file && output_file
+           && read_pnm_header (&image, input_file)
+           && write_pnm_header (&image, output_file);
+    }
+  else
+    {
+      image.layout = IMAGE_RAW;
+      image.width = settings->raw_width;
+      image.height = settings->raw_height;
+      image.channels = settings->raw_channels;
+      image.color_channels = image.channels <= 2 ? 1 : 3;
+      image.maxval = settings->raw_bits == 16 ? 65535 : 255;
+      ok = input_file && output_file;
+    }
+
+  if (!ok || fflush (output_file) != 0)
+    {
+      fprintf (stderr, "perlovka-cli: cannot open %s and %s\n",
+               settings->input, settings->output);
+
+      if (input_file)
+        fclose (input_file);
+
+      if (output_file)
+        fclose (output_file);
+
+      return 1;
+    }
+
+  input.fd = fileno (input_file);
+  input.offset = settings->layout == IMAGE_PNM ? ftell (input_file) : 0;
+  input.width = image.width;
+  input.height = image.height;
+  input.channels = image.channels;
+  input.color_channels = image.color_channels;
+  input.bytes = image.maxval > 255 ? 2 : 1;
+  input.big_endian = settings->layout == IMAGE_PNM;
+  input.interleaved = settings->layout == IMAGE_PNM;
+  input.maxval = image.maxval;
+
+  output = input;
+  output.fd = fileno (output_file);
+  output.offset = settings->layout == IMAGE_PNM ? ftell (output_file) : 0;
+
+  /* Size the output up front: tiles are written at their offsets */
+  size = output.offset
+         + (off_t)(image.width * image.height * image.channels * input.bytes);
+  ok = ftruncate (output.fd, size) == 0;
+
+  io = tileio_new ((TileIOBackend)settings->io_backend);
+
+  if (io == NULL)
+    {
+      fprintf (stderr, "perlovka-cli: %s I/O is unavailable\n",
+               io_names[settings->io_backend]);
+      ok = false;
+    }
+
+  if (settings->tile_size == 0)
+    settings->tile_size = 1024;
+
+  started = now ();
+
+  ok = ok
+       && perlovka_denoize_file (&settings->options, &input, &output,
+                                 settings->tile_size, io, &stats);
+
+  if (fclose (output_file) != 0)
+    ok = false;
+
+  fclose (input_file);
+
+  if (!ok)
+    {
+      fprintf (stderr, "perlovka-cli: cannot denoize %s into %s\n",
+               settings->input, settings->output);
+      tileio_free (io);
+      return 1;
+    }
+
+  if (!settings->quiet)
+    {
+      print_stats (&image, &settings->options, settings->input, 0.0,
+                   now () - started, 0.0);
+      fprintf (stderr,
+               "out-of-core: %zu tile(s), %s, solve: %.3f s, "
+               "read wait: %.3f s, write wait: %.3f s\n",
+               stats.tiles, tileio_backend_name (io), stats.solve_seconds,
+               stats.read_wait_seconds, stats.write_wait_seconds);
+    }
+
+  tileio_free (io);
+
+  return 0;
+}
+
+/**
+ * Denoize the color planes one by one in pyramid mode
+ */
+static void
+denoize_pyramid (CliSettings *settings, Image *image)
+{
+  PerlovkaOptions *options = &settings->options;
+  PerlovkaOptions plane;
+  int iterations_made = 0;
+  size_t resolved = 0;
+  bool converged = true;
+
+  for (int channel = 0; channel < image->color_channels; ++channel)
+    {
+      plane = *options;
+      plane.data = image->planes[channel];
+      perlovka_denoize_pyramid (&plane, settings->pyramid_levels,
+                                settings->fine_radius);
+
+      if (plane.iterations_made > iterations_made)
+        iterations_made = plane.iterations_made;
+
+      resolved += plane.resolved;
+      converged = converged && plane.converged;
+    }
+
+  options->iterations_made = iterations_made;
+  options->resolved = resolved;
+  options->converged = converged;
+}
+
+/**
+ * Spawn or connect to the farm workers. Spawning forks, so it is done before
+ * any thread is started.
+ */
+static PerlovkaFarm *
+open_farm (CliSettings const *settings)
+{
+  PerlovkaFarm *farm;
+  int workers;
+
+  if (parse_int (settings->farm, 1, 1024, &workers))
+    farm = perlovka_farm_spawn (workers);
+  else
+    farm = perlovka_farm_connect (settings->farm);
+
+  if (farm == NULL)
+    fprintf (stderr, "perlovka-cli: cannot reach farm workers %s\n",
+             settings->farm);
+
+  return farm;
+}
+
+/**
+ * Variants of a sweep waiting to be written, and what became of them
+ */
+typedef struct
+{
+  CliSettings const *settings;
+  Image const *image;
+  PerlovkaSweepConfig const *configs;
+
+  /**
+   * Statistics and file name of each snapshot of each configuration, and
+   * whether it has been written
+   */
+  PerlovkaOptions *stats;
+  char (*names)[4096];
+  bool *written;
+} SweepOutput;
+
+/**
+ * Name the output of a variant: the settings go before the extension
+ */
+static void
+variant_name (const char *output, PerlovkaOptions const *options,
+              int iterations, char *name, size_t size)
+{
+  const char *slash = strrchr (output, '/');
+  const char *dot = strrchr (slash ? slash : output, '.');
+  int stem = dot ? (int)(dot - output) : (int)strlen (output);
+
+  snprintf (name, size, "%.*s-%s-%s-%d%s", stem, output,
+            resolver_names[options->resolver],
+            matching_names[options->matching], iterations, dot ? dot : "");
+}
+
+static void
+write_variant (void *context, int config, int snapshot, int *const *planes,
+               PerlovkaOptions const *stats)
+{
+  SweepOutput *output = (SweepOutput *)context;
+  int variant = config * output->settings->n_sweep_iterations + snapshot;
+  Image image = *output->image;
+
+  for (int channel = 0; channel < image.color_channels; ++channel)
+    image.planes[channel] = planes[channel];
+
+  clamp_image (&image);
+  variant_name (output->settings->output, &output->configs[config].options,
+                stats->iterations, output->names[variant],
+                sizeof (output->names[variant]));
+  output->stats[variant] = *stats;
+  output->written[variant] = save_image (&image, output->names[variant]);
+}
+
+/**
+ * Denoize the input with every configuration of the sweep settings and
+ * write a file per variant
+ */
+static int
+sweep_image (CliSettings *settings)
+{
+  PerlovkaOptions *options = &settings->options;
+  PerlovkaSweepConfig *configs;
+  SweepOutput output;
+  Image image;
+  int n_configs;
+  int n_variants;
+  int config;
+  int failed = 0;
+  double started;
+  double read_time;
+
+  if (settings->n_sweep_resolvers == 0)
+    {
+      settings->sweep_resolvers[0] = options->resolver;
+      settings->n_sweep_resolvers = 1;
+    }
+
+  if (settings->n_sweep_matchings == 0)
+    {
+      settings->sweep_matchings[0] = options->matching;
+      settings->n_sweep_matchings = 1;
+    }
+
+  if (settings->n_sweep_iterations == 0)
+    {
+      settings->sweep_iterations[0] = options->iterations;
+      settings->n_sweep_iterations = 1;
+    }
+
+  started = now ();
+
+  if (!load_image (settings, settings->input, &image))
+    {
+      fprintf (stderr, "perlovka-cli: cannot read %s\n", settings->input);
+      return 1;
+    }
+
+  read_time = now () - started;
+  started = now ();
+
+  n_configs = settings->n_sweep_resolvers * settings->n_sweep_matchings;
+  n_variants = n_configs * settings->n_sweep_iterations;
+  configs = (PerlovkaSweepConfig *)calloc (n_configs,
+                                          sizeof (PerlovkaSweepConfig));
+
+  for (config = 0; config < n_configs; ++config)
+    {
+      configs[config].options = *options;
+      configs[config].options.resolver = (ResolveMode)
+          settings->sweep_resolvers[config / settings->n_sweep_matchings];
+      configs[config].options.matching = (MatchMode)
+          settings->sweep_matchings[config % settings->n_sweep_matchings];
+      configs[config].n_snapshots = settings->n_sweep_iterations;
+      memcpy (configs[config].snapshots, settings->sweep_iterations,
+              sizeof (int) * settings->n_sweep_iterations);
+    }
+
+  output.settings = settings;
+  output.image = &image;
+  output.configs = configs;
+  output.stats = (PerlovkaOptions *)calloc (n_variants,
+                                            sizeof (PerlovkaOptions));
+  output.names = (char (*)[4096])calloc (n_variants, 4096);
+  output.written = (bool *)calloc (n_variants, sizeof (bool));
+
+  if (!perlovka_sweep (configs, n_configs, image.planes,
+                       image.color_channels, image.width, image.height,
+                       settings->threads, write_variant, &output))
+    {
+      fprintf (stderr, "perlovka-cli: cannot sweep %d planes\n",
+               image.color_channels);
+      n_variants = 0;
+      failed = 1;
+    }
+
+  for (int variant = 0; variant < n_variants; ++variant)
+    {
+      if (!output.written[variant])
+        {
+          fprintf (stderr, "perlovka-cli: cannot write %s\n",
+                   output.names[variant]);
+          ++failed;
+        }
+      else if (!settings->quiet)
+        {
+          fprintf (stderr, "%s: iterations: %d%s, compensations: %zu\n",
+                   output.names[variant],
+                   output.stats[variant].iterations_made,
+                   output.stats[variant].converged ? " (converged)" : "",
+                   output.stats[variant].resolved);
+        }
+    }
+
+  if (!settings->quiet && n_variants > 0)
+    fprintf (stderr,
+             "sweep: %d variant(s) of %s, read: %.3f s, denoize and "
+             "write: %.3f s\n",
+             n_variants, settings->input, read_time, now () - started);
+
+  free (output.stats);
+  free (output.names);
+  free (output.written);
+  free (configs);
+  clean_image (&image);
+
+  return failed ? 1 : 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  CliSettings settings;
+  Image image;
+  PerlovkaOptions *options = &settings.options;
+  PerlovkaFarm *farm = NULL;
+  PerlovkaTask *task;
+  PerlovkaProgress progress;
+  PerlovkaAdaptiveStats adaptive;
+  size_t local;
+  int resumed;
+  ParseResult parsed;
+  double started;
+  double read_time;
+  double denoize_time;
+  double write_time;
+
+  memset (&settings, 0, sizeof (settings));
+  perlovka_init_options (options);
+  settings.layout = IMAGE_PNM;
+  settings.threads = 1;
+  settings.readers = 1;
+  settings.writers = 1;
+  settings.checkpoint_interval = 1;
+  settings.fine_radius = 3;
+
+  parsed = parse_args (argc, argv, &settings);
+
+  if (parsed != PARSE_OK)
+    {
+      if (parsed == PARSE_USAGE)
+        usage ();
+
+      return 2;
+    }
+
+  if (settings.stream)
+    return stream_image (&settings);
+
+  if (settings.batch_dir)
+    return batch_images (&settings) ? 1 : 0;
+
+  if (settings.out_of_core)
+    return denoize_out_of_core (&settings);
+
+  if (settings.n_sweep_resolvers > 0 || settings.n_sweep_matchings > 0
+      || settings.n_sweep_iterations > 0)
+    return sweep_image (&settings);
+
+  if (settings.farm_worker)
+    {
+      perlovka_farm_worker (settings.farm_worker);
+      fprintf (stderr, "perlovka-cli: cannot listen on %s\n",
+               settings.farm_worker);
+      return 1;
+    }
+
+  if (settings.farm)
+    {
+      farm = open_farm (&settings);
+
+      if (farm == NULL)
+        return 1;
+
+      if (settings.tile_size == 0)
+        settings.tile_size = 1024;
+    }
+
+  started = now ();
+
+  if (!load_image (&settings, settings.input, &image))
+    {
+      fprintf (stderr, "perlovka-cli: cannot read %s\n", settings.input);
+      perlovka_farm_free (farm);
+      return 1;
+    }
+
+  read_time = now () - started;
+  started = now ();
+
+  options->width = image.width;
+  options->height = image.height;
+
+  if (settings.daemon_path)
+    {
+      if (!submit_image (&settings, &image))
+        {
+          clean_image (&image);
+          return 1;
+        }
+    }
+  else if (farm)
+    {
+      local = perlovka_farm_denoize (farm, options, image.planes,
+                                     image.color_channels, settings.tile_size);
+      perlovka_farm_free (farm);
+
+      if (local > 0 && !settings.quiet)
+        fprintf (stderr, "farm: %zu tile(s) denoized locally\n", local);
+    }
+  else if (settings.checkpoint)
+    {
+      if (!perlovka_denoize_checkpointed (options, image.planes,
+                                          image.color_channels,
+                                          settings.checkpoint,
+                                          settings.checkpoint_interval,
+                                          &resumed))
+        fprintf (stderr, "perlovka-cli: cannot save checkpoint %s\n",
+                 settings.checkpoint);
+
+      if (resumed > 0 && !settings.quiet)
+        fprintf (stderr, "checkpoint: resumed from iteration %d\n", resumed);
+    }
+  else if (settings.deadline > 0)
+    {
+      task = perlovka_task_start (options, image.planes, image.color_channels,
+                                  settings.deadline);
+
+      if (perlovka_task_wait (task, -1) == PERLOVKA_TASK_DEADLINE
+          && !settings.quiet)
+        fprintf (stderr, "deadline: stopped after %.3f s\n",
+                 settings.deadline);
+
+      perlovka_task_progress (task, &progress);
+      perlovka_task_free (task);
+      options->iterations_made = progress.iterations_made;
+      options->resolved = progress.resolved;
+      options->converged = progress.converged;
+    }
+  else if (settings.pyramid_levels > 0)
+    {
+      denoize_pyramid (&settings, &image);
+    }
+  else if (settings.adaptive)
+    {
+      perlovka_denoize_adaptive (
+          options, image.planes, image.color_channels,
+          settings.tile_size > 0 ? settings.tile_size : 256, settings.threads,
+          &adaptive);
+    }
+  else
+    {
+      perlovka_denoize_tiled (options, image.planes, image.color_channels,
+                              settings.tile_size, settings.threads);
+    }
+
+  clamp_image (&image);
+
+  denoize_time = now () - started;
+  started = now ();
+
+  if (!save_image (&image, settings.output))
+    {
+      fprintf (stderr, "perlovka-cli: cannot write %s\n", settings.output);
+      clean_image (&image);
+      return 1;
+    }
+
+  write_time = now () - started;
+
+  /* The result is stored: a restart would have nothing to continue */
+  if (settings.checkpoint)
+    unlink (settings.checkpoint);
+
+  if (!settings.quiet)
+    print_stats (&image, options, settings.input, read_time, denoize_time,
+                 write_time);
+
+  if (settings.adaptive && !settings.quiet)
+    fprintf (stderr, "adaptive: %zu tile(s), %zu without grain, "
+             "mean radius %.1f\n",
+             adaptive.tiles, adaptive.skipped,
+             adaptive.tiles > adaptive.skipped
+                 ? (double)adaptive.radius_sum
+                       / (adaptive.tiles - adaptive.skipped)
+                 : 0.0);
+
+  clean_image (&image);
+
+  return 0;
+}
@@ -0,0 +1,137 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef CLI_H
+#define CLI_H
+
+#include "image.h"
+#include "perlovka.h"
+#include "sweep.h"
+
+/**
+ * Command line settings
+ */
+typedef struct
+{
+  PerlovkaOptions options;
+  const char *input;
+  const char *output;
+  ImageLayout layout;
+  size_t raw_width;
+  size_t raw_height;
+  int raw_channels;
+  int raw_bits;
+  size_t tile_size;
+  int threads;
+  bool stream;
+  bool quiet;
+
+  /**
+   * Batch mode: output directory, inputs are the remaining arguments
+   */
+  const char *batch_dir;
+  char **batch_inputs;
+  int batch_count;
+  int readers;
+  int writers;
+  int queue_size;
+
+  /**
+   * Sequence mode: frames of one geometry written in order, and the file
+   * per-frame statistics go to
+   */
+  bool sequence;
+  const char *frame_stats;
+
+  /**
+   * Daemon mode: socket of perlovkad and priority of the jobs
+   */
+  const char *daemon_path;
+  int priority;
+
+  /**
+   * Tile farm: amount of local workers or their addresses, and the address
+   * of the worker this process should run as
+   */
+  const char *farm;
+  const char *farm_worker;
+
+  /**
+   * Out-of-core mode: denoize file to file with `TileIOBackend`
+   */
+  bool out_of_core;
+  int io_backend;
+
+  /**
+   * Checkpoint file of a long run and iterations between saves
+   */
+  const char *checkpoint;
+  int checkpoint_interval;
+
+  /**
+   * Seconds after which no further iteration is begun, 0 for no limit
+   */
+  double deadline;
+
+  /**
+   * Pyramid mode: halvings of the image and radius of the refinement
+   */
+  int pyramid_levels;
+  int fine_radius;
+
+  /**
+   * Radius of every tile chosen by a grain size analysis, up to the radius
+   * of the options
+   */
+  bool adaptive;
+
+  /**
+   * Sweep mode: the resolvers and matching modes crossed into
+   * configurations, and the iteration counts each one is written at
+   */
+  int sweep_resolvers[4];
+  int n_sweep_resolvers;
+  int sweep_matchings[2];
+  int n_sweep_matchings;
+  int sweep_iterations[PERLOVKA_SWEEP_SNAPSHOTS];
+  int n_sweep_iterations;
+} CliSettings;
+
+/**
+ * Read image in the layout given by `settings`
+ */
+bool load_image (CliSettings const *settings, const char *file_name,
+                 Image *image);
+
+/**
+ * Write image in the layout it has been read in
+ */
+bool save_image (Image const *image, const char *file_name);
+
+/**
+ * Monotonic time in seconds
+ */
+double now (void);
+
+/**
+ * Print image geometry, convergence and timing to stderr
+ */
+void print_stats (Image const *image, PerlovkaOptions const *options,
+                  const char *name, double read_time, double denoize_time,
+                  double write_time);
+
+#endif
@@ -0,0 +1,468 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libperlovka.h"
+#include "tiles.h"
+
+struct PerlovkaContext
+{
+  PerlovkaOptions options;
+
+  size_t tile_size;
+  size_t n_tiles;
+  TileRect *rects;
+
+  /**
+   * Solver plan of each tile: plans depend on the padded tile width, and
+   * there are only a few distinct ones
+   */
+  PSolver *tile_plans;
+  PSolver *plans;
+  int *plan_widths;
+  int n_plans;
+
+  /**
+   * Ingested image and, when tiled, the denoized one
+   */
+  int *source;
+  int *result;
+
+  /**
+   * Padded tile buffer and solver index of each thread, the index reserved
+   * for every tile so that the runs allocate nothing
+   */
+  int **buffers;
+  PSolverIndex *indexes;
+
+  int threads;
+  pthread_t *ids;
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  unsigned generation;
+  int busy;
+  size_t next;
+  bool quit;
+
+  /**
+   * Current run
+   */
+  int iterations_made;
+  size_t resolved;
+  bool converged;
+
+  PerlovkaStats stats;
+};
+
+typedef struct
+{
+  PerlovkaContext *context;
+  int index;
+} ContextThread;
+
+static double
+seconds (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int
+perlovka_abi_version (void)
+{
+  return PERLOVKA_ABI_VERSION;
+}
+
+static PSolver
+plan_for_width (PerlovkaContext *context, int width)
+{
+  PerlovkaOptions const *options = &context->options;
+
+  for (int index = 0; index < context->n_plans; ++index)
+    {
+      if (context->plan_widths[index] == width)
+        return context->plans[index];
+    }
+
+  context->plan_widths[context->n_plans] = width;
+  context->plans[context->n_plans]
+      = build_solver (width, options->radius, options->grid,
+                      options->matching, options->resolver,
+                      options->field_matching);
+
+  return context->plans[context->n_plans++];
+}
+
+static void
+denoize_tile (PerlovkaContext *context, size_t tile, int *buffer,
+              PSolverIndex index)
+{
+  PerlovkaOptions options = context->options;
+  TileRect const *rect = &context->rects[tile];
+  size_t width = context->options.width;
+  size_t tile_width = rect->right - rect->left;
+
+  if (context->n_tiles == 1)
+    {
+      options.data = context->source;
+    }
+  else
+    {
+      for (size_t y = rect->top; y < rect->bottom; ++y)
+        memcpy (buffer + (y - rect->top) * tile_width,
+                context->source + y * width + rect->left,
+                sizeof (int) * tile_width);
+
+      options.data = buffer;
+      options.width = tile_width;
+      options.height = rect->bottom - rect->top;
+    }
+
+  options.iterations_made = 0;
+  options.resolved = 0;
+  options.converged = false;
+  options.pruned = 0;
+  options.gain = 0;
+  options.frozen = 0;
+
+  perlovka_diff (&options);
+  perlovka_solve_indexed (&options, context->tile_plans[tile], index);
+  perlovka_undiff (&options);
+
+  if (context->n_tiles > 1)
+    {
+      for (size_t y = rect->y0; y < rect->y1; ++y)
+        memcpy (context->result + y * width + rect->x0,
+                buffer + (y - rect->top) * tile_width
+                    + (rect->x0 - rect->left),
+                sizeof (int) * (rect->x1 - rect->x0));
+    }
+
+  pthread_mutex_lock (&context->lock);
+
+  if (options.iterations_made > context->iterations_made)
+    context->iterations_made = options.iterations_made;
+
+  context->resolved += options.resolved;
+  context->converged = context->converged && options.converged;
+
+  pthread_mutex_unlock (&context->lock);
+}
+
+static void
+run_tiles (PerlovkaContext *context, int thread)
+{
+  size_t tile;
+
+  for (;;)
+    {
+      pthread_mutex_lock (&context->lock);
+      tile = context->next++;
+      pthread_mutex_unlock (&context->lock);
+
+      if (tile >= context->n_tiles)
+        break;
+
+      denoize_tile (context, tile, context->buffers[thread],
+                    context->indexes[thread]);
+    }
+}
+
+static void *
+context_thread (void *arg)
+{
+  ContextThread *self = (ContextThread *)arg;
+  PerlovkaContext *context = self->context;
+  int index = self->index;
+  unsigned generation = 0;
+
+  free (self);
+
+  for (;;)
+    {
+      pthread_mutex_lock (&context->lock);
+
+      while (!context->quit && context->generation == generation)
+        pthread_cond_wait (&context->start, &context->lock);
+
+      generation = context->generation;
+
+      if (context->quit)
+        {
+          pthread_mutex_unlock (&context->lock);
+          break;
+        }
+
+      pthread_mutex_unlock (&context->lock);
+
+      run_tiles (context, index);
+
+      pthread_mutex_lock (&context->lock);
+
+      if (--context->busy == 0)
+        pthread_cond_signal (&context->done);
+
+      pthread_mutex_unlock (&context->lock);
+    }
+
+  return NULL;
+}
+
+PerlovkaContext *
+perlovka_context_new_abi (int abi_version, size_t options_size,
+                          PerlovkaOptions const *options, size_t tile_size,
+                          int threads)
+{
+  PerlovkaContext *context;
+  ContextThread *thread;
+  size_t size = options->width * options->height;
+  size_t buffer_size = 0;
+  size_t tile;
+  size_t tile_area;
+
+  if (abi_version != PERLOVKA_ABI_VERSION
+      || options_size != sizeof (PerlovkaOptions) || size == 0)
+    return NULL;
+
+  context = (PerlovkaContext *)calloc (1, sizeof (PerlovkaContext));
+
+  context->options = *options;
+  context->options.data = NULL;
+  context->options.progress = NULL;
+  context->options.cancelled = NULL;
+  context->tile_size = tile_size;
+  context->n_tiles = perlovka_tile_count (options, tile_size);
+  context->threads = threads < 1 ? 1 : threads;
+
+  if ((size_t)context->threads > context->n_tiles)
+    context->threads = context->n_tiles;
+
+  context->rects = (TileRect *)malloc (sizeof (TileRect) * context->n_tiles);
+  context->tile_plans = (PSolver *)malloc (sizeof (PSolver) * context->n_tiles);
+  context->plans = (PSolver *)malloc (sizeof (PSolver) * context->n_tiles);
+  context->plan_widths = (int *)malloc (sizeof (int) * context->n_tiles);
+
+  for (tile = 0; tile < context->n_tiles; ++tile)
+    {
+      perlovka_tile_rect (options, tile_size, tile, &context->rects[tile]);
+      context->tile_plans[tile] = plan_for_width (
+          context, context->rects[tile].right - context->rects[tile].left);
+
+      tile_area = (context->rects[tile].right - context->rects[tile].left)
+                  * (context->rects[tile].bottom - context->rects[tile].top);
+
+      if (tile_area > buffer_size)
+        buffer_size = tile_area;
+    }
+
+  context->source = (int *)malloc (sizeof (int) * size);
+  context->buffers = (int **)calloc (context->threads, sizeof (int *));
+  context->indexes
+      = (PSolverIndex *)malloc (sizeof (PSolverIndex) * context->threads);
+
+  for (int index = 0; index < context->threads; ++index)
+    {
+      context->indexes[index] = new_solver_index ();
+
+      for (tile = 0; tile < context->n_tiles; ++tile)
+        reserve_solver_index (
+            context->indexes[index], context->tile_plans[tile],
+            context->rects[tile].right - context->rects[tile].left,
+            context->rects[tile].bottom - context->rects[tile].top);
+    }
+
+  if (context->n_tiles > 1)
+    {
+      context->result = (int *)malloc (sizeof (int) * size);
+
+      for (int index = 0; index < context->threads; ++index)
+        context->buffers[index] = (int *)malloc (sizeof (int) * buffer_size);
+    }
+
+  pthread_mutex_init (&context->lock, NULL);
+  pthread_cond_init (&context->start, NULL);
+  pthread_cond_init (&context->done, NULL);
+
+  /* The calling thread works as the thread number 0 */
+  context->ids = (pthread_t *)malloc (sizeof (pthread_t) * context->threads);
+
+  for (int index = 1; index < context->threads; ++index)
+    {
+      thread = (ContextThread *)malloc (sizeof (ContextThread));
+      thread->context = context;
+      thread->index = index;
+      pthread_create (&context->ids[index], NULL, context_thread, thread);
+    }
+
+  return context;
+}
+
+void
+perlovka_context_free (PerlovkaContext *context)
+{
+  if (context == NULL)
+    return;
+
+  pthread_mutex_lock (&context->lock);
+  context->quit = true;
+  pthread_cond_broadcast (&context->start);
+  pthread_mutex_unlock (&context->lock);
+
+  for (int index = 1; index < context->threads; ++index)
+    pthread_join (context->ids[index], NULL);
+
+  for (int index = 0; index < context->n_plans; ++index)
+    clean_solver (context->plans[index]);
+
+  for (int index = 0; index < context->threads; ++index)
+    {
+      free (context->buffers[index]);
+      clean_solver_index (context->indexes[index]);
+    }
+
+  pthread_mutex_destroy (&context->lock);
+  pthread_cond_destroy (&context->start);
+  pthread_cond_destroy (&context->done);
+
+  free (context->ids);
+  free (context->buffers);
+  free (context->indexes);
+  free (context->source);
+  free (context->result);
+  free (context->rects);
+  free (context->tile_plans);
+  free (context->plans);
+  free (context->plan_widths);
+  free (context);
+}
+
+static void
+ingest (PerlovkaContext *context, void const *input, size_t stride,
+        PerlovkaSample sample)
+{
+  size_t width = context->options.width;
+  int *target = context->source;
+
+  for (size_t y = 0; y < context->options.height; ++y, target += width)
+    {
+      unsigned char const *row = (unsigned char const *)input + y * stride;
+
+      if (sample == PERLOVKA_SAMPLE_U8)
+        {
+          for (size_t x = 0; x < width; ++x)
+            target[x] = row[x];
+        }
+      else if (sample == PERLOVKA_SAMPLE_U16)
+        {
+          for (size_t x = 0; x < width; ++x)
+            target[x] = ((uint16_t const *)row)[x];
+        }
+      else
+        {
+          memcpy (target, row, sizeof (int) * width);
+        }
+    }
+}
+
+static void
+egress (PerlovkaContext *context, int const *source, void *output,
+        size_t stride, PerlovkaSample sample, int maxval)
+{
+  size_t width = context->options.width;
+  int value;
+
+  for (size_t y = 0; y < context->options.height; ++y, source += width)
+    {
+      unsigned char *row = (unsigned char *)output + y * stride;
+
+      if (sample == PERLOVKA_SAMPLE_INT)
+        {
+          memcpy (row, source, sizeof (int) * width);
+          continue;
+        }
+
+      for (size_t x = 0; x < width; ++x)
+        {
+          value = source[x];
+
+          if (value < 0)
+            value = 0;
+          else if (value > maxval)
+            value = maxval;
+
+          if (sample == PERLOVKA_SAMPLE_U8)
+            row[x] = (unsigned char)value;
+          else
+            ((uint16_t *)row)[x] = (uint16_t)value;
+        }
+    }
+}
+
+void
+perlovka_context_execute (PerlovkaContext *context, void const *input,
+                          void *output, size_t stride, PerlovkaSample sample,
+                          int maxval)
+{
+  double started = seconds ();
+
+  ingest (context, input, stride, sample);
+
+  context->iterations_made = 0;
+  context->resolved = 0;
+  context->converged = true;
+
+  pthread_mutex_lock (&context->lock);
+  context->next = 0;
+  context->busy = context->threads - 1;
+  ++context->generation;
+  pthread_cond_broadcast (&context->start);
+  pthread_mutex_unlock (&context->lock);
+
+  run_tiles (context, 0);
+
+  pthread_mutex_lock (&context->lock);
+
+  while (context->busy > 0)
+    pthread_cond_wait (&context->done, &context->lock);
+
+  pthread_mutex_unlock (&context->lock);
+
+  egress (context, context->n_tiles > 1 ? context->result : context->source,
+          output, stride, sample, maxval);
+
+  context->stats.iterations_made = context->iterations_made;
+  context->stats.resolved = context->resolved;
+  context->stats.converged = context->converged;
+  context->stats.seconds = seconds () - started;
+  context->stats.total_seconds += context->stats.seconds;
+  ++context->stats.runs;
+}
+
+void
+perlovka_context_stats (PerlovkaContext const *context, PerlovkaStats *stats)
+{
+  *stats = context->stats;
+}
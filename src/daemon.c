@@ -0,0 +1,775 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "daemon.h"
+
+/**
+ * Job waiting for a worker; lives on the stack of its connection thread
+ */
+typedef struct DaemonJob
+{
+  PerlovkaJob request;
+  unsigned char *data;
+  double queued_at;
+  bool done;
+  PerlovkaReply reply;
+  pthread_cond_t finished;
+  struct DaemonJob *next;
+} DaemonJob;
+
+/**
+ * Context kept for jobs with the same settings and geometry
+ */
+typedef struct
+{
+  PerlovkaJob key;
+  PerlovkaContext *context;
+  bool busy;
+  unsigned long used;
+} CachedContext;
+
+typedef struct
+{
+  PerlovkaDaemon *daemon;
+  int fd;
+} Connection;
+
+struct PerlovkaDaemon
+{
+  char path[sizeof (((struct sockaddr_un *)NULL)->sun_path)];
+  int listener;
+  pthread_t acceptor;
+
+  int n_workers;
+  pthread_t *workers;
+  int threads;
+
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t idle;
+
+  /**
+   * Queue of each priority
+   */
+  DaemonJob *heads[2];
+  DaemonJob *tails[2];
+  bool quit;
+
+  /**
+   * Open connections: stopping shuts them down and waits for their threads
+   */
+  int *connections;
+  int n_connections;
+  int connections_size;
+
+  CachedContext *cache;
+  int cache_size;
+  unsigned long clock;
+};
+
+static double
+seconds (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t
+sample_size (int sample)
+{
+  if (sample == PERLOVKA_SAMPLE_U8)
+    return 1;
+
+  if (sample == PERLOVKA_SAMPLE_U16)
+    return 2;
+
+  return sizeof (int);
+}
+
+void
+perlovka_daemon_default_path (char *path, size_t size)
+{
+  const char *runtime = getenv ("XDG_RUNTIME_DIR");
+
+  if (runtime && *runtime)
+    snprintf (path, size, "%s/perlovkad.sock", runtime);
+  else
+    snprintf (path, size, "/tmp/perlovkad-%u.sock", (unsigned)getuid ());
+}
+
+static bool
+same_key (PerlovkaJob const *lhs, PerlovkaJob const *rhs)
+{
+  return lhs->radius == rhs->radius && lhs->iterations == rhs->iterations
+         && lhs->grid == rhs->grid && lhs->matching == rhs->matching
+         && lhs->resolver == rhs->resolver
+         && lhs->field_matching == rhs->field_matching
+         && lhs->scan == rhs->scan && lhs->probe_budget == rhs->probe_budget
+         && lhs->prune_below == rhs->prune_below
+         && lhs->min_gain == rhs->min_gain
+         && lhs->width == rhs->width && lhs->height == rhs->height
+         && lhs->tile_size == rhs->tile_size;
+}
+
+/**
+ * Total size of the shared memory the job refers to, 0 if the job is invalid
+ */
+static size_t
+job_size (PerlovkaJob const *job)
+{
+  size_t bytes = sample_size (job->sample);
+  size_t plane;
+  size_t size;
+
+  if (job->magic != PERLOVKA_DAEMON_MAGIC
+      || job->abi_version != PERLOVKA_ABI_VERSION
+      || job->priority < PERLOVKA_PRIORITY_INTERACTIVE
+      || job->priority > PERLOVKA_PRIORITY_BATCH || job->radius < 1
+      || job->iterations < 0 || job->grid < GRID_ODD || job->grid > GRID_BOTH
+      || job->matching < MATCHING_SOFT || job->matching > MATCHING_STRICT
+      || job->resolver < RESOLVER_MINIMAL || job->resolver > RESOLVER_MAXIMAL
+      || job->scan < SCAN_RASTER || job->scan > SCAN_BLOCKS
+      || job->probe_budget < 0 || !(job->prune_below >= 0)
+      || job->prune_below >= 1 || !(job->min_gain >= 0)
+      || job->min_gain >= 1
+      || job->sample < PERLOVKA_SAMPLE_U8 || job->sample > PERLOVKA_SAMPLE_INT
+      || (job->sample != PERLOVKA_SAMPLE_INT && job->maxval < 1)
+      || job->width == 0 || job->height == 0 || job->planes == 0
+      || job->stride < job->width * bytes || job->stride % bytes
+      || job->offset % bytes || job->width > SIZE_MAX / bytes)
+    return 0;
+
+  if (__builtin_mul_overflow (job->height, job->stride, &plane)
+      || __builtin_mul_overflow (plane, job->planes, &size)
+      || __builtin_add_overflow (size, job->offset, &size))
+    return 0;
+
+  return size;
+}
+
+static CachedContext *
+acquire_context (PerlovkaDaemon *daemon, PerlovkaJob const *job)
+{
+  CachedContext *slot = NULL;
+  PerlovkaContext *stale;
+  PerlovkaOptions options;
+
+  pthread_mutex_lock (&daemon->lock);
+
+  for (int index = 0; index < daemon->cache_size; ++index)
+    {
+      CachedContext *entry = &daemon->cache[index];
+
+      if (entry->context && !entry->busy && same_key (&entry->key, job))
+        {
+          entry->busy = true;
+          entry->used = ++daemon->clock;
+          pthread_mutex_unlock (&daemon->lock);
+          return entry;
+        }
+    }
+
+  /* An empty slot or the least recently used idle one: there are at least as
+     many slots as workers, so one is always idle */
+  for (int index = 0; index < daemon->cache_size; ++index)
+    {
+      CachedContext *entry = &daemon->cache[index];
+
+      if (!entry->busy
+          && (slot == NULL || !entry->context
+              || (slot->context && entry->used < slot->used)))
+        slot = entry;
+    }
+
+  stale = slot->context;
+  slot->context = NULL;
+  slot->key = *job;
+  slot->busy = true;
+  slot->used = ++daemon->clock;
+
+  pthread_mutex_unlock (&daemon->lock);
+
+  perlovka_context_free (stale);
+
+  perlovka_init_options (&options);
+  options.width = job->width;
+  options.height = job->height;
+  options.radius = job->radius;
+  options.iterations = job->iterations;
+  options.grid = (Grid)job->grid;
+  options.matching = (MatchMode)job->matching;
+  options.resolver = (ResolveMode)job->resolver;
+  options.field_matching = job->field_matching != 0;
+  options.scan = (ScanOrder)job->scan;
+  options.probe_budget = job->probe_budget;
+  options.prune_below = job->prune_below;
+  options.min_gain = job->min_gain;
+
+  stale = perlovka_context_new (&options, job->tile_size, daemon->threads);
+
+  pthread_mutex_lock (&daemon->lock);
+  slot->context = stale;
+  pthread_mutex_unlock (&daemon->lock);
+
+  return slot;
+}
+
+static void
+release_context (PerlovkaDaemon *daemon, CachedContext *entry)
+{
+  pthread_mutex_lock (&daemon->lock);
+  entry->busy = false;
+  pthread_mutex_unlock (&daemon->lock);
+}
+
+static void
+run_job (PerlovkaDaemon *daemon, DaemonJob *job)
+{
+  PerlovkaJob const *request = &job->request;
+  PerlovkaStats *stats = &job->reply.stats;
+  PerlovkaStats plane_stats;
+  CachedContext *entry;
+  double started = seconds ();
+  size_t plane_size = request->height * request->stride;
+
+  job->reply.queued = started - job->queued_at;
+  entry = acquire_context (daemon, request);
+
+  stats->iterations_made = 0;
+  stats->resolved = 0;
+  stats->converged = true;
+
+  for (size_t plane = 0; plane < request->planes; ++plane)
+    {
+      unsigned char *data = job->data + request->offset + plane * plane_size;
+
+      perlovka_context_execute (entry->context, data, data, request->stride,
+                                (PerlovkaSample)request->sample,
+                                request->maxval);
+      perlovka_context_stats (entry->context, &plane_stats);
+
+      if (plane_stats.iterations_made > stats->iterations_made)
+        stats->iterations_made = plane_stats.iterations_made;
+
+      stats->resolved += plane_stats.resolved;
+      stats->converged = stats->converged && plane_stats.converged;
+    }
+
+  stats->runs = plane_stats.runs;
+  stats->total_seconds = plane_stats.total_seconds;
+  stats->seconds = seconds () - started;
+
+  release_context (daemon, entry);
+}
+
+static void *
+worker_thread (void *arg)
+{
+  PerlovkaDaemon *daemon = (PerlovkaDaemon *)arg;
+  DaemonJob *job;
+  int priority;
+
+  for (;;)
+    {
+      pthread_mutex_lock (&daemon->lock);
+
+      while (!daemon->quit && !daemon->heads[0] && !daemon->heads[1])
+        pthread_cond_wait (&daemon->wake, &daemon->lock);
+
+      priority = daemon->heads[PERLOVKA_PRIORITY_INTERACTIVE]
+                     ? PERLOVKA_PRIORITY_INTERACTIVE
+                     : PERLOVKA_PRIORITY_BATCH;
+      job = daemon->heads[priority];
+
+      if (job == NULL)
+        {
+          pthread_mutex_unlock (&daemon->lock);
+          break;
+        }
+
+      daemon->heads[priority] = job->next;
+
+      if (job->next == NULL)
+        daemon->tails[priority] = NULL;
+
+      pthread_mutex_unlock (&daemon->lock);
+
+      run_job (daemon, job);
+
+      pthread_mutex_lock (&daemon->lock);
+      job->done = true;
+      pthread_cond_signal (&job->finished);
+      pthread_mutex_unlock (&daemon->lock);
+    }
+
+  return NULL;
+}
+
+/**
+ * Queue the job and wait until a worker has denoized it
+ */
+static void
+execute_job (PerlovkaDaemon *daemon, DaemonJob *job)
+{
+  int priority = job->request.priority;
+
+  pthread_cond_init (&job->finished, NULL);
+  job->done = false;
+  job->next = NULL;
+  job->queued_at = seconds ();
+
+  pthread_mutex_lock (&daemon->lock);
+
+  if (daemon->tails[priority])
+    daemon->tails[priority]->next = job;
+  else
+    daemon->heads[priority] = job;
+
+  daemon->tails[priority] = job;
+  pthread_cond_signal (&daemon->wake);
+
+  while (!job->done)
+    pthread_cond_wait (&job->finished, &daemon->lock);
+
+  pthread_mutex_unlock (&daemon->lock);
+  pthread_cond_destroy (&job->finished);
+}
+
+/**
+ * Receive a job record with its shared memory descriptor. Returns the size of
+ * the record, 0 when the peer has gone.
+ */
+static ssize_t
+receive_job (int socket, PerlovkaJob *job, int *fd)
+{
+  union
+  {
+    char buffer[CMSG_SPACE (sizeof (int))];
+    struct cmsghdr align;
+  } control;
+  struct iovec iov = { job, sizeof (PerlovkaJob) };
+  struct msghdr message;
+  struct cmsghdr *header;
+  ssize_t received;
+
+  memset (&message, 0, sizeof (message));
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.buffer;
+  message.msg_controllen = sizeof (control.buffer);
+
+  *fd = -1;
+  received = recvmsg (socket, &message, MSG_CMSG_CLOEXEC);
+
+  if (received <= 0)
+    return 0;
+
+  for (header = CMSG_FIRSTHDR (&message); header;
+       header = CMSG_NXTHDR (&message, header))
+    {
+      if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS
+          && header->cmsg_len == CMSG_LEN (sizeof (int)))
+        memcpy (fd, CMSG_DATA (header), sizeof (int));
+    }
+
+  if (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC))
+    return -1;
+
+  return received;
+}
+
+static void
+serve_job (PerlovkaDaemon *daemon, DaemonJob *job, ssize_t received, int fd)
+{
+  struct stat status;
+  size_t size = received == sizeof (PerlovkaJob) ? job_size (&job->request)
+                                                  : 0;
+
+  memset (&job->reply, 0, sizeof (PerlovkaReply));
+  job->reply.magic = PERLOVKA_DAEMON_MAGIC;
+
+  if (size == 0)
+    {
+      job->reply.status = PERLOVKA_DAEMON_BAD_JOB;
+      return;
+    }
+
+  if (fd < 0 || fstat (fd, &status) != 0 || (size_t)status.st_size < size)
+    {
+      job->reply.status = PERLOVKA_DAEMON_BAD_MEMORY;
+      return;
+    }
+
+  job->data = (unsigned char *)mmap (NULL, size, PROT_READ | PROT_WRITE,
+                                     MAP_SHARED, fd, 0);
+
+  if (job->data == MAP_FAILED)
+    {
+      job->reply.status = PERLOVKA_DAEMON_BAD_MEMORY;
+      return;
+    }
+
+  execute_job (daemon, job);
+  munmap (job->data, size);
+
+  job->reply.status = PERLOVKA_DAEMON_OK;
+}
+
+/**
+ * Close the connection socket under the lock, so that stopping does not shut
+ * down a descriptor that has been reused meanwhile
+ */
+static void
+forget_connection (PerlovkaDaemon *daemon, int socket)
+{
+  pthread_mutex_lock (&daemon->lock);
+
+  for (int index = 0; index < daemon->n_connections; ++index)
+    {
+      if (daemon->connections[index] == socket)
+        {
+          daemon->connections[index]
+              = daemon->connections[--daemon->n_connections];
+          break;
+        }
+    }
+
+  close (socket);
+  pthread_cond_signal (&daemon->idle);
+  pthread_mutex_unlock (&daemon->lock);
+}
+
+static void *
+connection_thread (void *arg)
+{
+  Connection *connection = (Connection *)arg;
+  PerlovkaDaemon *daemon = connection->daemon;
+  int socket = connection->fd;
+  DaemonJob job;
+  ssize_t received;
+  int fd;
+
+  free (connection);
+
+  while ((received = receive_job (socket, &job.request, &fd)) != 0)
+    {
+      serve_job (daemon, &job, received, fd);
+
+      if (fd >= 0)
+        close (fd);
+
+      if (send (socket, &job.reply, sizeof (PerlovkaReply), MSG_NOSIGNAL)
+          != sizeof (PerlovkaReply))
+        break;
+    }
+
+  forget_connection (daemon, socket);
+
+  return NULL;
+}
+
+static void *
+accept_thread (void *arg)
+{
+  PerlovkaDaemon *daemon = (PerlovkaDaemon *)arg;
+  Connection *connection;
+  pthread_t id;
+  int socket;
+
+  /* Stopping shuts the listener down, which makes accept fail */
+  while ((socket = accept4 (daemon->listener, NULL, NULL, SOCK_CLOEXEC)) >= 0
+         || errno == EINTR || errno == ECONNABORTED)
+    {
+      if (socket < 0)
+        continue;
+
+      pthread_mutex_lock (&daemon->lock);
+
+      if (daemon->n_connections == daemon->connections_size)
+        {
+          daemon->connections_size = daemon->connections_size
+                                         ? daemon->connections_size * 2
+                                         : 8;
+          daemon->connections = (int *)realloc (
+              daemon->connections, sizeof (int) * daemon->connections_size);
+        }
+
+      daemon->connections[daemon->n_connections++] = socket;
+      pthread_mutex_unlock (&daemon->lock);
+
+      connection = (Connection *)malloc (sizeof (Connection));
+      connection->daemon = daemon;
+      connection->fd = socket;
+
+      if (pthread_create (&id, NULL, connection_thread, connection) == 0)
+        {
+          pthread_detach (id);
+          continue;
+        }
+
+      free (connection);
+      forget_connection (daemon, socket);
+    }
+
+  return NULL;
+}
+
+static bool
+make_address (const char *path, struct sockaddr_un *address)
+{
+  memset (address, 0, sizeof (struct sockaddr_un));
+  address->sun_family = AF_UNIX;
+
+  if (strlen (path) >= sizeof (address->sun_path))
+    return false;
+
+  strcpy (address->sun_path, path);
+
+  return true;
+}
+
+PerlovkaDaemon *
+perlovka_daemon_start (const char *path, int workers, int threads,
+                       int cache_size)
+{
+  PerlovkaDaemon *daemon;
+  struct sockaddr_un address;
+  int listener;
+  int live;
+
+  if (!make_address (path, &address))
+    return NULL;
+
+  /* A socket nobody answers on is left over from a daemon that has died */
+  live = perlovka_daemon_connect (path);
+
+  if (live >= 0)
+    {
+      close (live);
+      return NULL;
+    }
+
+  unlink (path);
+  listener = socket (AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+  if (listener < 0)
+    return NULL;
+
+  if (bind (listener, (struct sockaddr *)&address, sizeof (address)) != 0
+      || chmod (path, 0600) != 0 || listen (listener, 64) != 0)
+    {
+      close (listener);
+      return NULL;
+    }
+
+  daemon = (PerlovkaDaemon *)calloc (1, sizeof (PerlovkaDaemon));
+  strcpy (daemon->path, path);
+  daemon->listener = listener;
+  daemon->threads = threads < 1 ? 1 : threads;
+  daemon->n_workers = workers < 1 ? 1 : workers;
+  daemon->cache_size
+      = cache_size < daemon->n_workers ? daemon->n_workers : cache_size;
+  daemon->cache
+      = (CachedContext *)calloc (daemon->cache_size, sizeof (CachedContext));
+
+  pthread_mutex_init (&daemon->lock, NULL);
+  pthread_cond_init (&daemon->wake, NULL);
+  pthread_cond_init (&daemon->idle, NULL);
+
+  daemon->workers = (pthread_t *)malloc (sizeof (pthread_t) * daemon->n_workers);
+
+  for (int index = 0; index < daemon->n_workers; ++index)
+    pthread_create (&daemon->workers[index], NULL, worker_thread, daemon);
+
+  pthread_create (&daemon->acceptor, NULL, accept_thread, daemon);
+
+  return daemon;
+}
+
+void
+perlovka_daemon_stop (PerlovkaDaemon *daemon)
+{
+  if (daemon == NULL)
+    return;
+
+  shutdown (daemon->listener, SHUT_RDWR);
+  pthread_join (daemon->acceptor, NULL);
+  close (daemon->listener);
+  unlink (daemon->path);
+
+  /* Jobs being served still finish: workers run until the connections end */
+  pthread_mutex_lock (&daemon->lock);
+
+  for (int index = 0; index < daemon->n_connections; ++index)
+    shutdown (daemon->connections[index], SHUT_RD);
+
+  while (daemon->n_connections > 0)
+    pthread_cond_wait (&daemon->idle, &daemon->lock);
+
+  daemon->quit = true;
+  pthread_cond_broadcast (&daemon->wake);
+  pthread_mutex_unlock (&daemon->lock);
+
+  for (int index = 0; index < daemon->n_workers; ++index)
+    pthread_join (daemon->workers[index], NULL);
+
+  for (int index = 0; index < daemon->cache_size; ++index)
+    perlovka_context_free (daemon->cache[index].context);
+
+  pthread_mutex_destroy (&daemon->lock);
+  pthread_cond_destroy (&daemon->wake);
+  pthread_cond_destroy (&daemon->idle);
+
+  free (daemon->workers);
+  free (daemon->connections);
+  free (daemon->cache);
+  free (daemon);
+}
+
+int
+perlovka_daemon_connect (const char *path)
+{
+  struct sockaddr_un address;
+  int fd;
+
+  if (!make_address (path, &address))
+    return -1;
+
+  fd = socket (AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+  if (fd >= 0
+      && connect (fd, (struct sockaddr *)&address, sizeof (address)) != 0)
+    {
+      close (fd);
+      fd = -1;
+    }
+
+  return fd;
+}
+
+void *
+perlovka_daemon_alloc (size_t size, int *fd)
+{
+  void *memory;
+
+  *fd = memfd_create ("perlovka", MFD_CLOEXEC);
+
+  if (*fd < 0)
+    return NULL;
+
+  if (ftruncate (*fd, size) == 0)
+    {
+      memory = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+
+      if (memory != MAP_FAILED)
+        return memory;
+    }
+
+  close (*fd);
+  *fd = -1;
+
+  return NULL;
+}
+
+void
+perlovka_daemon_release (void *memory, size_t size, int fd)
+{
+  if (memory)
+    munmap (memory, size);
+
+  if (fd >= 0)
+    close (fd);
+}
+
+void
+perlovka_job_init (PerlovkaJob *job, PerlovkaOptions const *options,
+                   size_t planes, size_t tile_size, PerlovkaPriority priority)
+{
+  memset (job, 0, sizeof (PerlovkaJob));
+  job->magic = PERLOVKA_DAEMON_MAGIC;
+  job->abi_version = PERLOVKA_ABI_VERSION;
+  job->priority = priority;
+  job->radius = options->radius;
+  job->iterations = options->iterations;
+  job->grid = options->grid;
+  job->matching = options->matching;
+  job->resolver = options->resolver;
+  job->field_matching = options->field_matching;
+  job->scan = options->scan;
+  job->probe_budget = options->probe_budget;
+  job->prune_below = options->prune_below;
+  job->min_gain = options->min_gain;
+  job->sample = PERLOVKA_SAMPLE_INT;
+  job->width = options->width;
+  job->height = options->height;
+  job->stride = sizeof (int) * options->width;
+  job->planes = planes;
+  job->tile_size = tile_size;
+}
+
+bool
+perlovka_daemon_submit (int socket, PerlovkaJob const *job, int fd,
+                        PerlovkaReply *reply)
+{
+  union
+  {
+    char buffer[CMSG_SPACE (sizeof (int))];
+    struct cmsghdr align;
+  } control;
+  struct iovec iov = { (void *)job, sizeof (PerlovkaJob) };
+  struct msghdr message;
+  struct cmsghdr *header;
+
+  memset (&message, 0, sizeof (message));
+  memset (&control, 0, sizeof (control));
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.buffer;
+  message.msg_controllen = sizeof (control.buffer);
+
+  header = CMSG_FIRSTHDR (&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN (sizeof (int));
+  memcpy (CMSG_DATA (header), &fd, sizeof (int));
+
+  if (sendmsg (socket, &message, MSG_NOSIGNAL) != sizeof (PerlovkaJob))
+    return false;
+
+  return recv (socket, reply, sizeof (PerlovkaReply), 0)
+             == sizeof (PerlovkaReply)
+         && reply->magic == PERLOVKA_DAEMON_MAGIC;
+}
@@ -0,0 +1,147 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdint.h>
+
+#include "libperlovka.h"
+
+/**
+ * Denoizing daemon: jobs come over a Unix domain socket together with a
+ * shared memory file descriptor holding the pixels, which are denoized in
+ * place. Nothing but the small job and reply records crosses the socket.
+ */
+typedef struct PerlovkaDaemon PerlovkaDaemon;
+
+#define PERLOVKA_DAEMON_MAGIC 0x6b6c7270u
+
+/**
+ * Interactive jobs always go before the batch ones waiting in the queue
+ */
+typedef enum
+{
+  PERLOVKA_PRIORITY_INTERACTIVE,
+  PERLOVKA_PRIORITY_BATCH
+} PerlovkaPriority;
+
+typedef enum
+{
+  PERLOVKA_DAEMON_OK,
+  PERLOVKA_DAEMON_BAD_JOB,
+  PERLOVKA_DAEMON_BAD_MEMORY,
+  PERLOVKA_DAEMON_STOPPED
+} PerlovkaDaemonStatus;
+
+/**
+ * Job record: `planes` planes of `width` x `height` samples, rows `stride`
+ * bytes apart, planes `height * stride` bytes apart starting at `offset` of
+ * the shared memory
+ */
+typedef struct
+{
+  uint32_t magic;
+  int32_t abi_version;
+  int32_t priority;
+
+  int32_t radius;
+  int32_t iterations;
+  int32_t grid;
+  int32_t matching;
+  int32_t resolver;
+  int32_t field_matching;
+  int32_t scan;
+  int32_t probe_budget;
+  int32_t reserved;
+
+  int32_t sample;
+  int32_t maxval;
+  uint64_t width;
+  uint64_t height;
+  uint64_t stride;
+  uint64_t planes;
+  uint64_t offset;
+  uint64_t tile_size;
+
+  double prune_below;
+  double min_gain;
+} PerlovkaJob;
+
+/**
+ * Reply record. `stats` are those of the job (iterations and convergence over
+ * all planes), `stats.runs` counts the runs of the reused context, so it
+ * shows whether the job found a warm one.
+ */
+typedef struct
+{
+  uint32_t magic;
+  int32_t status;
+  double queued;
+  PerlovkaStats stats;
+} PerlovkaReply;
+
+/**
+ * Default socket path: `$XDG_RUNTIME_DIR/perlovkad.sock` or
+ * `/tmp/perlovkad-UID.sock`
+ */
+void perlovka_daemon_default_path (char *path, size_t size);
+
+/**
+ * Listen on `path` (replacing a stale socket) and start `workers` job workers
+ * using contexts of `threads` threads. Up to `cache_size` contexts with their
+ * solver plans and buffers are kept for later jobs with the same settings and
+ * geometry. Returns NULL if the socket cannot be created.
+ */
+PerlovkaDaemon *perlovka_daemon_start (const char *path, int workers,
+                                       int threads, int cache_size);
+
+/**
+ * Stop accepting jobs, finish the queued ones, close the connections and free
+ * the daemon
+ */
+void perlovka_daemon_stop (PerlovkaDaemon *daemon);
+
+/**
+ * Connect to the daemon listening on `path`. Returns the socket or -1.
+ */
+int perlovka_daemon_connect (const char *path);
+
+/**
+ * Shared memory of `size` bytes for the job pixels: returns the mapping and
+ * stores the descriptor to `fd`, or returns NULL
+ */
+void *perlovka_daemon_alloc (size_t size, int *fd);
+
+void perlovka_daemon_release (void *memory, size_t size, int fd);
+
+/**
+ * Fill the job record with the settings of `options` and the geometry of an
+ * int plane of `options->width` x `options->height`
+ */
+void perlovka_job_init (PerlovkaJob *job, PerlovkaOptions const *options,
+                        size_t planes, size_t tile_size,
+                        PerlovkaPriority priority);
+
+/**
+ * Send the job with the shared memory `fd` over `socket` and wait for the
+ * reply. Returns false if the daemon could not be reached.
+ */
+bool perlovka_daemon_submit (int socket, PerlovkaJob const *job, int fd,
+                             PerlovkaReply *reply);
+
+#endif
@@ -0,0 +1,833 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "farm.h"
+#include "tiles.h"
+
+/**
+ * Both records are sent in the byte order of the coordinator: a worker with
+ * another one, or with another layout of the records, sees a wrong magic and
+ * drops the connection
+ */
+#define FARM_MAGIC 0x326d7266u
+
+/**
+ * Most iterations a worker runs on a tile: the coordinator denoizes the tiles
+ * asking for more itself
+ */
+#define FARM_MAX_ITERATIONS 1000
+
+/**
+ * Padded tile of `width` x `height` samples followed by its pixels. Its core,
+ * which is sent back after denoizing, starts at (`x`, `y`).
+ */
+typedef struct
+{
+  uint32_t magic;
+  int32_t radius;
+  int32_t iterations;
+  int32_t grid;
+  int32_t matching;
+  int32_t resolver;
+  int32_t field_matching;
+  int32_t scan;
+  int32_t probe_budget;
+  uint32_t width;
+  uint32_t height;
+  uint32_t x;
+  uint32_t y;
+  uint32_t core_width;
+  uint32_t core_height;
+  uint32_t reserved;
+  double prune_below;
+  double min_gain;
+} FarmTile;
+
+/**
+ * Outcome of a tile followed by the core pixels
+ */
+typedef struct
+{
+  uint32_t magic;
+  int32_t iterations_made;
+  int32_t converged;
+  uint32_t reserved;
+  uint64_t resolved;
+} FarmResult;
+
+struct PerlovkaFarm
+{
+  int n_workers;
+  int *sockets;
+
+  /**
+   * Spawned worker processes, NULL when connected to running workers
+   */
+  pid_t *pids;
+};
+
+/**
+ * Work shared by the coordinator threads, one per worker
+ */
+typedef struct
+{
+  PerlovkaOptions *options;
+  int *const *planes;
+  int **results;
+
+  size_t tile_size;
+  size_t tiles_per_plane;
+  size_t n_tiles;
+
+  pthread_mutex_t lock;
+  size_t next;
+
+  /**
+   * Tiles of the failed workers
+   */
+  size_t *retry;
+  size_t n_retry;
+
+  int iterations_made;
+  size_t resolved;
+  bool converged;
+
+  /**
+   * Tiles denoized by the coordinator threads as the workers would refuse
+   */
+  size_t n_local;
+} FarmWork;
+
+typedef struct
+{
+  FarmWork *work;
+  int *socket;
+} FarmThread;
+
+static bool
+send_all (int socket, void const *data, size_t size)
+{
+  char const *bytes = (char const *)data;
+  ssize_t sent;
+
+  while (size > 0)
+    {
+      sent = send (socket, bytes, size, MSG_NOSIGNAL);
+
+      if (sent <= 0)
+        return false;
+
+      bytes += sent;
+      size -= sent;
+    }
+
+  return true;
+}
+
+static bool
+receive_all (int socket, void *data, size_t size)
+{
+  char *bytes = (char *)data;
+  ssize_t received;
+
+  while (size > 0)
+    {
+      received = recv (socket, bytes, size, 0);
+
+      if (received <= 0)
+        return false;
+
+      bytes += received;
+      size -= received;
+    }
+
+  return true;
+}
+
+/**
+ * Split `[HOST:]PORT` into a resolved address
+ */
+static struct addrinfo *
+resolve (const char *address, bool passive)
+{
+  struct addrinfo hints;
+  struct addrinfo *result = NULL;
+  char host[256] = "127.0.0.1";
+  const char *port = address;
+  const char *colon = strrchr (address, ':');
+
+  if (colon)
+    {
+      snprintf (host, sizeof (host), "%.*s", (int)(colon - address), address);
+      port = colon + 1;
+    }
+
+  memset (&hints, 0, sizeof (hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+  if (getaddrinfo (host, port, &hints, &result) != 0)
+    return NULL;
+
+  return result;
+}
+
+static int
+connect_to (struct sockaddr const *address, socklen_t length)
+{
+  int one = 1;
+  int fd = socket (address->sa_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+  if (fd < 0)
+    return -1;
+
+  if (connect (fd, address, length) != 0)
+    {
+      close (fd);
+      return -1;
+    }
+
+  setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+
+  return fd;
+}
+
+/* Worker side */
+
+/**
+ * Solver plans of the tile widths met so far: a farm sends only a few
+ */
+typedef struct
+{
+  FarmTile settings;
+  int widths[8];
+  PSolver plans[8];
+  int n_plans;
+} PlanCache;
+
+static bool
+same_settings (FarmTile const *lhs, FarmTile const *rhs)
+{
+  return lhs->radius == rhs->radius && lhs->grid == rhs->grid
+         && lhs->matching == rhs->matching && lhs->resolver == rhs->resolver
+         && lhs->field_matching == rhs->field_matching;
+}
+
+static void
+clear_plans (PlanCache *cache)
+{
+  for (int index = 0; index < cache->n_plans; ++index)
+    clean_solver (cache->plans[index]);
+
+  cache->n_plans = 0;
+}
+
+static PSolver
+plan_for (PlanCache *cache, FarmTile const *tile)
+{
+  if (!same_settings (&cache->settings, tile)
+      || cache->n_plans == sizeof (cache->plans) / sizeof (PSolver))
+    clear_plans (cache);
+
+  cache->settings = *tile;
+
+  for (int index = 0; index < cache->n_plans; ++index)
+    {
+      if (cache->widths[index] == (int)tile->width)
+        return cache->plans[index];
+    }
+
+  cache->widths[cache->n_plans] = tile->width;
+  cache->plans[cache->n_plans]
+      = build_solver (tile->width, tile->radius, (Grid)tile->grid,
+                      (MatchMode)tile->matching, (ResolveMode)tile->resolver,
+                      tile->field_matching != 0);
+
+  return cache->plans[cache->n_plans++];
+}
+
+/**
+ * Whether a worker takes `tile`. A radius of half the tile or more leaves no
+ * pixel to compensate, and a larger one would only make the plan huge.
+ */
+static bool
+valid_tile (FarmTile const *tile)
+{
+  return tile->magic == FARM_MAGIC && tile->radius >= 1
+         && (uint32_t)tile->radius
+                < (tile->width < tile->height ? tile->width : tile->height) / 2
+         && tile->iterations >= 0 && tile->iterations <= FARM_MAX_ITERATIONS
+         && tile->grid >= GRID_ODD
+         && tile->grid <= GRID_BOTH && tile->matching >= MATCHING_SOFT
+         && tile->matching <= MATCHING_STRICT
+         && tile->resolver >= RESOLVER_MINIMAL
+         && tile->resolver <= RESOLVER_MAXIMAL && tile->scan >= SCAN_RASTER
+         && tile->scan <= SCAN_BLOCKS && tile->probe_budget >= 0
+         && tile->prune_below >= 0 && tile->prune_below <= 1
+         && tile->min_gain >= 0 && tile->width > 0
+         && tile->height > 0 && tile->width <= (1u << 20)
+         && tile->height <= (1u << 20) && tile->core_width > 0
+         && tile->core_height > 0 && tile->x < tile->width
+         && tile->core_width <= tile->width - tile->x
+         && tile->y < tile->height
+         && tile->core_height <= tile->height - tile->y;
+}
+
+/**
+ * Denoize the tiles of one coordinator until it disconnects
+ */
+static void
+serve (int socket)
+{
+  PlanCache cache;
+  PerlovkaOptions options;
+  FarmTile tile;
+  FarmResult result;
+  int *buffer = NULL;
+  size_t capacity = 0;
+  size_t size;
+  bool sent;
+
+  memset (&cache, 0, sizeof (cache));
+
+  while (receive_all (socket, &tile, sizeof (tile)) && valid_tile (&tile))
+    {
+      size = (size_t)tile.width * tile.height;
+
+      if (capacity < size)
+        {
+          free (buffer);
+          buffer = (int *)malloc (sizeof (int) * size);
+          capacity = buffer ? size : 0;
+        }
+
+      if (!buffer || !receive_all (socket, buffer, sizeof (int) * size))
+        break;
+
+      perlovka_init_options (&options);
+      options.data = buffer;
+      options.width = tile.width;
+      options.height = tile.height;
+      options.radius = tile.radius;
+      options.iterations = tile.iterations;
+      options.grid = (Grid)tile.grid;
+      options.matching = (MatchMode)tile.matching;
+      options.resolver = (ResolveMode)tile.resolver;
+      options.field_matching = tile.field_matching != 0;
+      options.scan = (ScanOrder)tile.scan;
+      options.prune_below = tile.prune_below;
+      options.min_gain = tile.min_gain;
+      options.probe_budget = tile.probe_budget;
+
+      perlovka_diff (&options);
+      perlovka_solve_plan (&options, plan_for (&cache, &tile));
+      perlovka_undiff (&options);
+
+      memset (&result, 0, sizeof (result));
+      result.magic = FARM_MAGIC;
+      result.iterations_made = options.iterations_made;
+      result.converged = options.converged;
+      result.resolved = options.resolved;
+
+      sent = send_all (socket, &result, sizeof (result));
+
+      for (size_t y = tile.y; sent && y < tile.y + tile.core_height; ++y)
+        sent = send_all (socket, buffer + y * tile.width + tile.x,
+                         sizeof (int) * tile.core_width);
+
+      /* The coordinator would take the next tile for the rest of this one */
+      if (!sent)
+        break;
+    }
+
+  clear_plans (&cache);
+  free (buffer);
+}
+
+static int
+listen_on (struct addrinfo const *address)
+{
+  int one = 1;
+  int fd = socket (address->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+  if (fd < 0)
+    return -1;
+
+  setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+
+  if (bind (fd, address->ai_addr, address->ai_addrlen) != 0
+      || listen (fd, 16) != 0)
+    {
+      close (fd);
+      return -1;
+    }
+
+  return fd;
+}
+
+static void
+serve_connections (int listener, bool once)
+{
+  int one = 1;
+  int socket;
+
+  do
+    {
+      socket = accept (listener, NULL, NULL);
+
+      if (socket < 0)
+        continue;
+
+      setsockopt (socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+      serve (socket);
+      close (socket);
+    }
+  while (!once);
+}
+
+bool
+perlovka_farm_worker (const char *address)
+{
+  struct addrinfo *addresses = resolve (address, true);
+  int listener = addresses ? listen_on (addresses) : -1;
+
+  if (addresses)
+    freeaddrinfo (addresses);
+
+  if (listener < 0)
+    return false;
+
+  serve_connections (listener, false);
+
+  return false;
+}
+
+/* Coordinator side */
+
+PerlovkaFarm *
+perlovka_farm_spawn (int workers)
+{
+  PerlovkaFarm *farm;
+  struct sockaddr_in address;
+  socklen_t length = sizeof (address);
+  int listener;
+
+  farm = (PerlovkaFarm *)calloc (1, sizeof (PerlovkaFarm));
+  farm->sockets = (int *)malloc (sizeof (int) * workers);
+  farm->pids = (pid_t *)malloc (sizeof (pid_t) * workers);
+
+  for (int index = 0; index < workers; ++index)
+    {
+      memset (&address, 0, sizeof (address));
+      address.sin_family = AF_INET;
+      address.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+      listener = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+      if (listener < 0
+          || bind (listener, (struct sockaddr *)&address, sizeof (address))
+                 != 0
+          || listen (listener, 1) != 0
+          || getsockname (listener, (struct sockaddr *)&address, &length)
+                 != 0)
+        {
+          if (listener >= 0)
+            close (listener);
+          break;
+        }
+
+      farm->pids[farm->n_workers] = fork ();
+
+      if (farm->pids[farm->n_workers] == 0)
+        {
+          /* The worker must not hold the connections to its siblings */
+          for (int sibling = 0; sibling < farm->n_workers; ++sibling)
+            close (farm->sockets[sibling]);
+
+          serve_connections (listener, true);
+          _exit (0);
+        }
+
+      if (farm->pids[farm->n_workers] < 0)
+        {
+          close (listener);
+          break;
+        }
+
+      farm->sockets[farm->n_workers]
+          = connect_to ((struct sockaddr *)&address, sizeof (address));
+      close (listener);
+      ++farm->n_workers;
+    }
+
+  return farm;
+}
+
+PerlovkaFarm *
+perlovka_farm_connect (const char *addresses)
+{
+  PerlovkaFarm *farm;
+  struct addrinfo *resolved;
+  struct addrinfo *candidate;
+  char *list = strdup (addresses);
+  char *next = list;
+  char *address;
+  int fd;
+
+  farm = (PerlovkaFarm *)calloc (1, sizeof (PerlovkaFarm));
+
+  while ((address = strsep (&next, ",")) != NULL)
+    {
+      if (*address == '\0' || (resolved = resolve (address, false)) == NULL)
+        continue;
+
+      fd = -1;
+
+      for (candidate = resolved; candidate && fd < 0;
+           candidate = candidate->ai_next)
+        fd = connect_to (candidate->ai_addr, candidate->ai_addrlen);
+
+      freeaddrinfo (resolved);
+
+      if (fd < 0)
+        continue;
+
+      farm->sockets = (int *)realloc (farm->sockets,
+                                      sizeof (int) * (farm->n_workers + 1));
+      farm->sockets[farm->n_workers++] = fd;
+    }
+
+  free (list);
+
+  if (farm->n_workers == 0)
+    {
+      perlovka_farm_free (farm);
+      return NULL;
+    }
+
+  return farm;
+}
+
+void
+perlovka_farm_free (PerlovkaFarm *farm)
+{
+  if (farm == NULL)
+    return;
+
+  for (int index = 0; index < farm->n_workers; ++index)
+    {
+      if (farm->sockets[index] >= 0)
+        close (farm->sockets[index]);
+    }
+
+  for (int index = 0; farm->pids && index < farm->n_workers; ++index)
+    waitpid (farm->pids[index], NULL, 0);
+
+  free (farm->sockets);
+  free (farm->pids);
+  free (farm);
+}
+
+static bool
+take_tile (FarmWork *work, size_t *tile)
+{
+  bool taken = true;
+
+  pthread_mutex_lock (&work->lock);
+
+  if (work->n_retry > 0)
+    *tile = work->retry[--work->n_retry];
+  else if (work->next < work->n_tiles)
+    *tile = work->next++;
+  else
+    taken = false;
+
+  pthread_mutex_unlock (&work->lock);
+
+  return taken;
+}
+
+static void
+collect_stats (FarmWork *work, int iterations_made, size_t resolved,
+               bool converged)
+{
+  pthread_mutex_lock (&work->lock);
+
+  if (iterations_made > work->iterations_made)
+    work->iterations_made = iterations_made;
+
+  work->resolved += resolved;
+  work->converged = work->converged && converged;
+
+  pthread_mutex_unlock (&work->lock);
+}
+
+/**
+ * Copy the padded tile into `buffer` and describe it in `header`. Returns the
+ * plane the denoized core goes to.
+ */
+static int *
+pad_tile (FarmWork *work, size_t tile, int **buffer, size_t *capacity,
+          FarmTile *header)
+{
+  PerlovkaOptions const *options = work->options;
+  TileRect rect;
+  size_t plane = tile / work->tiles_per_plane;
+  size_t width = options->width;
+  size_t tile_width;
+  size_t size;
+
+  perlovka_tile_rect (options, work->tile_size, tile % work->tiles_per_plane,
+                      &rect);
+  tile_width = rect.right - rect.left;
+  size = tile_width * (rect.bottom - rect.top);
+
+  if (*capacity < size)
+    {
+      free (*buffer);
+      *buffer = (int *)malloc (sizeof (int) * size);
+      *capacity = size;
+    }
+
+  for (size_t y = rect.top; y < rect.bottom; ++y)
+    memcpy (*buffer + (y - rect.top) * tile_width,
+            work->planes[plane] + y * width + rect.left,
+            sizeof (int) * tile_width);
+
+  memset (header, 0, sizeof (FarmTile));
+  header->magic = FARM_MAGIC;
+  header->radius = options->radius;
+  header->iterations = options->iterations;
+  header->grid = options->grid;
+  header->matching = options->matching;
+  header->resolver = options->resolver;
+  header->field_matching = options->field_matching;
+  header->scan = options->scan;
+  header->probe_budget = options->probe_budget;
+  header->prune_below = options->prune_below;
+  header->min_gain = options->min_gain;
+  header->width = tile_width;
+  header->height = rect.bottom - rect.top;
+  header->x = rect.x0 - rect.left;
+  header->y = rect.y0 - rect.top;
+  header->core_width = rect.x1 - rect.x0;
+  header->core_height = rect.y1 - rect.y0;
+
+  /* A whole plane has no neighbours reading its halo */
+  return (work->tiles_per_plane > 1 ? work->results[plane]
+                                    : work->planes[plane])
+         + rect.y0 * width + rect.x0;
+}
+
+/**
+ * Denoize the tile padded in `buffer` here and copy its core to `target`
+ */
+static void
+denoize_padded (FarmWork *work, FarmTile const *header, int *buffer,
+                int *target)
+{
+  PerlovkaOptions options = *work->options;
+
+  options.data = buffer;
+  options.width = header->width;
+  options.height = header->height;
+  options.progress = NULL;
+  options.cancelled = NULL;
+
+  perlovka_denoize (&options);
+
+  for (size_t y = 0; y < header->core_height; ++y)
+    memcpy (target + y * work->options->width,
+            buffer + (header->y + y) * header->width + header->x,
+            sizeof (int) * header->core_width);
+
+  collect_stats (work, options.iterations_made, options.resolved,
+                 options.converged);
+}
+
+static void
+local_tile (FarmWork *work, size_t tile, int **buffer, size_t *capacity)
+{
+  FarmTile header;
+  int *target = pad_tile (work, tile, buffer, capacity, &header);
+
+  denoize_padded (work, &header, *buffer, target);
+}
+
+static bool
+farm_tile (FarmWork *work, int socket, size_t tile, int **buffer,
+           size_t *capacity)
+{
+  FarmTile header;
+  FarmResult result;
+  int *target = pad_tile (work, tile, buffer, capacity, &header);
+
+  if (!valid_tile (&header))
+    {
+      denoize_padded (work, &header, *buffer, target);
+
+      pthread_mutex_lock (&work->lock);
+      ++work->n_local;
+      pthread_mutex_unlock (&work->lock);
+
+      return true;
+    }
+
+  if (!send_all (socket, &header, sizeof (header))
+      || !send_all (socket, *buffer,
+                    sizeof (int) * header.width * header.height)
+      || !receive_all (socket, &result, sizeof (result))
+      || result.magic != FARM_MAGIC)
+    return false;
+
+  /* The core is received into the buffer first: a worker failing in the
+     middle must not leave a half-written tile behind */
+  for (size_t y = 0; y < header.core_height; ++y)
+    {
+      if (!receive_all (socket, *buffer + y * header.core_width,
+                        sizeof (int) * header.core_width))
+        return false;
+    }
+
+  for (size_t y = 0; y < header.core_height; ++y)
+    memcpy (target + y * work->options->width,
+            *buffer + y * header.core_width,
+            sizeof (int) * header.core_width);
+
+  collect_stats (work, result.iterations_made, result.resolved,
+                 result.converged != 0);
+
+  return true;
+}
+
+static void *
+farm_thread (void *arg)
+{
+  FarmThread *self = (FarmThread *)arg;
+  FarmWork *work = self->work;
+  int *buffer = NULL;
+  size_t capacity = 0;
+  size_t tile;
+
+  while (*self->socket >= 0 && take_tile (work, &tile))
+    {
+      if (farm_tile (work, *self->socket, tile, &buffer, &capacity))
+        continue;
+
+      /* The worker is gone: its tile goes to the others */
+      close (*self->socket);
+      *self->socket = -1;
+
+      pthread_mutex_lock (&work->lock);
+      work->retry[work->n_retry++] = tile;
+      pthread_mutex_unlock (&work->lock);
+    }
+
+  free (buffer);
+
+  return NULL;
+}
+
+size_t
+perlovka_farm_denoize (PerlovkaFarm *farm, PerlovkaOptions *options,
+                       int *const *planes, int n_planes, size_t tile_size)
+{
+  FarmWork work;
+  FarmThread *threads;
+  pthread_t *ids;
+  int *buffer = NULL;
+  size_t capacity = 0;
+  size_t size = options->width * options->height;
+  size_t local = 0;
+  size_t tile;
+  int plane;
+
+  memset (&work, 0, sizeof (work));
+  work.options = options;
+  work.planes = planes;
+  work.tile_size = tile_size;
+  work.tiles_per_plane = perlovka_tile_count (options, tile_size);
+  work.n_tiles = work.tiles_per_plane * n_planes;
+  work.converged = true;
+  work.retry = (size_t *)malloc (sizeof (size_t) * (farm->n_workers + 1));
+  work.results = (int **)malloc (sizeof (int *) * n_planes);
+  pthread_mutex_init (&work.lock, NULL);
+
+  for (plane = 0; plane < n_planes; ++plane)
+    work.results[plane] = work.tiles_per_plane > 1
+                              ? (int *)malloc (sizeof (int) * size)
+                              : NULL;
+
+  threads = (FarmThread *)malloc (sizeof (FarmThread) * farm->n_workers);
+  ids = (pthread_t *)malloc (sizeof (pthread_t) * farm->n_workers);
+
+  for (int index = 0; index < farm->n_workers; ++index)
+    {
+      threads[index].work = &work;
+      threads[index].socket = &farm->sockets[index];
+      pthread_create (&ids[index], NULL, farm_thread, &threads[index]);
+    }
+
+  for (int index = 0; index < farm->n_workers; ++index)
+    pthread_join (ids[index], NULL);
+
+  /* Tiles nobody could take when all workers have failed */
+  while (take_tile (&work, &tile))
+    {
+      local_tile (&work, tile, &buffer, &capacity);
+      ++local;
+    }
+
+  for (plane = 0; plane < n_planes; ++plane)
+    {
+      if (work.results[plane] == NULL)
+        continue;
+
+      memcpy (planes[plane], work.results[plane], sizeof (int) * size);
+      free (work.results[plane]);
+    }
+
+  free (buffer);
+  free (work.results);
+  free (work.retry);
+  free (threads);
+  free (ids);
+  pthread_mutex_destroy (&work.lock);
+
+  options->iterations_made = work.iterations_made;
+  options->resolved = work.resolved;
+  options->converged = work.converged;
+
+  return local + work.n_local;
+}
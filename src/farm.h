@@ -0,0 +1,65 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef FARM_H
+#define FARM_H
+
+#include "perlovka.h"
+
+/**
+ * Tile farm: halo-padded tiles are sent over TCP to worker processes, which
+ * may run on this or other machines, and the denoized tiles are stitched back
+ * by the coordinator
+ */
+typedef struct PerlovkaFarm PerlovkaFarm;
+
+/**
+ * Fork `workers` worker processes listening on ephemeral localhost ports and
+ * connect to them. Call before starting any thread.
+ */
+PerlovkaFarm *perlovka_farm_spawn (int workers);
+
+/**
+ * Connect to the workers at comma separated `HOST:PORT` addresses. Returns
+ * NULL if none of them could be reached.
+ */
+PerlovkaFarm *perlovka_farm_connect (const char *addresses);
+
+/**
+ * Disconnect from the workers and reap the spawned ones
+ */
+void perlovka_farm_free (PerlovkaFarm *farm);
+
+/**
+ * Same as `perlovka_denoize_tiled` with the tiles denoized by the workers.
+ * Tiles of a worker that has failed are taken by the others, and those left
+ * when all have failed are denoized by the calling process, so the result is
+ * always the same. So are the tiles the workers refuse: those with a radius
+ * of half their size or more, or more than 1000 iterations. Returns the
+ * amount of tiles denoized locally.
+ */
+size_t perlovka_farm_denoize (PerlovkaFarm *farm, PerlovkaOptions *options,
+                              int *const *planes, int n_planes,
+                              size_t tile_size);
+
+/**
+ * Run a worker: listen on `[HOST:]PORT` (localhost by default) and denoize
+ * the tiles of one coordinator after another. Returns only on failure.
+ */
+bool perlovka_farm_worker (const char *address);
+
+#endif
@@ -219,6 +219,7 @@ process (GeglOperation *operation, GeglBuffer *input, GeglBuffer *output,
   position_context.tick_size = 1 / components;
   position_context.position = -position_context.tick_size;
 
+  perlovka_init_options (&options);
   options.width = width;
   options.height = height;
   options.progress = progress;
@@ -0,0 +1,223 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "grain.h"
+#include "grain_signs.h"
+
+/**
+ * Correlations weaker than 1 / GRAIN_PEAK_SHARE of the strongest one past
+ * the first lag are ignored however many signs they are taken from: clusters
+ * of grains leave a weak tail beyond the diameter
+ */
+#define GRAIN_PEAK_SHARE 4
+
+/**
+ * Standard deviations a correlation must be away from zero: the sum of `n`
+ * products of independent signs stays within sqrt (n) or so
+ */
+#define GRAIN_SIGMAS 4
+
+/**
+ * Products of sign pairs: how many are positive and how many are not zero
+ */
+typedef struct
+{
+  long sum;
+  long count;
+} Correlation;
+
+void
+pack_signs (PerlovkaOptions const *options, SignRows *rows)
+{
+  int const *row;
+  uint64_t positive;
+  uint64_t negative;
+  uint64_t bit;
+  size_t first;
+  size_t end;
+
+  rows->words = (options->width + 63) / 64;
+  rows->positive = (uint64_t *)calloc (rows->words * options->height * 2,
+                                       sizeof (uint64_t));
+  rows->negative = rows->positive + rows->words * options->height;
+
+  for (size_t y = 0; y + 1 < options->height; ++y)
+    {
+      row = options->data + y * options->width;
+
+      for (size_t word = 0; word < rows->words; ++word)
+        {
+          positive = 0;
+          negative = 0;
+          first = word == 0 ? 1 : word * 64;
+          end = word * 64 + 64 < options->width ? word * 64 + 64
+                                                : options->width;
+
+          for (size_t x = first; x < end; ++x)
+            {
+              bit = (uint64_t)1 << (x % 64);
+              positive |= row[x] > 0 ? bit : 0;
+              negative |= row[x] < 0 ? bit : 0;
+            }
+
+          rows->positive[y * rows->words + word] = positive;
+          rows->negative[y * rows->words + word] = negative;
+        }
+    }
+}
+
+/**
+ * 64 bits of a row starting at bit `first`, zeros past the row end
+ */
+static inline uint64_t
+row_bits (uint64_t const *row, size_t words, size_t first)
+{
+  size_t word = first / 64;
+  int shift = first % 64;
+  uint64_t result;
+
+  if (word >= words)
+    return 0;
+
+  result = row[word] >> shift;
+
+  if (shift > 0 && word + 1 < words)
+    result |= row[word + 1] << (64 - shift);
+
+  return result;
+}
+
+static inline void
+correlate (uint64_t positive, uint64_t negative, uint64_t other_positive,
+           uint64_t other_negative, Correlation *correlation)
+{
+  long same = __builtin_popcountll ((positive & other_positive)
+                                    | (negative & other_negative));
+  long opposite = __builtin_popcountll ((positive & other_negative)
+                                        | (negative & other_positive));
+
+  correlation->sum += same - opposite;
+  correlation->count += same + opposite;
+}
+
+static void
+correlate_rows (SignRows const *rows, size_t height, size_t lag,
+                Correlation *correlation)
+{
+  uint64_t const *positive;
+  uint64_t const *negative;
+
+  for (size_t y = 0; y < height; ++y)
+    {
+      positive = rows->positive + y * rows->words;
+      negative = rows->negative + y * rows->words;
+
+      for (size_t word = 0; word < rows->words; ++word)
+        correlate (positive[word], negative[word],
+                   row_bits (positive, rows->words, word * 64 + lag),
+                   row_bits (negative, rows->words, word * 64 + lag),
+                   correlation);
+    }
+}
+
+static void
+correlate_columns (SignRows const *rows, size_t height, size_t lag,
+                   Correlation *correlation)
+{
+  size_t size = (height - lag) * rows->words;
+  size_t offset = lag * rows->words;
+
+  for (size_t word = 0; word < size; ++word)
+    correlate (rows->positive[word], rows->negative[word],
+               rows->positive[word + offset], rows->negative[word + offset],
+               correlation);
+}
+
+/**
+ * Strength of the correlation, 0 if it may be noise
+ */
+static double
+strength (Correlation const *correlation)
+{
+  double sum = correlation->sum;
+
+  if (correlation->count == 0
+      || sum * sum <= (double)GRAIN_SIGMAS * GRAIN_SIGMAS * correlation->count)
+    return 0.0;
+
+  return labs (correlation->sum) / (double)correlation->count;
+}
+
+int
+perlovka_grain_radius (PerlovkaOptions const *options)
+{
+  SignRows rows;
+  Correlation along;
+  Correlation across;
+  size_t max_lag = 2 * (size_t)options->radius + 1;
+  size_t extent = 0;
+  double *strengths;
+  double peak = 0.0;
+  int radius;
+
+  strengths = (double *)malloc (sizeof (double) * (max_lag + 1));
+  pack_signs (options, &rows);
+
+  for (size_t lag = 1; lag <= max_lag; ++lag)
+    {
+      along.sum = along.count = 0;
+      across.sum = across.count = 0;
+
+      if (lag < options->width)
+        correlate_rows (&rows, options->height, lag, &along);
+
+      if (lag < options->height)
+        correlate_columns (&rows, options->height, lag, &across);
+
+      strengths[lag] = strength (&along) > strength (&across)
+                           ? strength (&along)
+                           : strength (&across);
+
+      /* Neighbours are anticorrelated by the diff itself */
+      if (lag > 1 && strengths[lag] > peak)
+        peak = strengths[lag];
+    }
+
+  /* Some lags within the diameter happen to be uncorrelated, but a lag far
+     beyond the correlated ones is some regular texture instead */
+  for (size_t lag = 1; lag <= max_lag && lag - extent <= extent + 1; ++lag)
+    if (strengths[lag] > 0.0
+        && (lag == 1 || strengths[lag] * GRAIN_PEAK_SHARE >= peak))
+      extent = lag;
+
+  free (strengths);
+  free (rows.positive);
+
+  if (extent == 0)
+    return 0;
+
+  /* A grain of radius r spans 2 r + 1 samples */
+  radius = extent / 2;
+
+  if (radius < 1)
+    radius = 1;
+
+  return radius < options->radius ? radius : options->radius;
+}
@@ -0,0 +1,32 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef GRAIN_H
+#define GRAIN_H
+
+#include "perlovka.h"
+
+/**
+ * Estimate the grain radius of the twofold diff in `options->data`. A grain
+ * leaves a pattern of signs around it, so the signs stay correlated up to
+ * about its diameter along rows and columns. The radius is half of the
+ * largest lag at which the correlation is distinguishable from noise. The
+ * result is at most `options->radius`, and 0 when no lag is.
+ */
+int perlovka_grain_radius (PerlovkaOptions const *options);
+
+#endif
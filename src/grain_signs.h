@@ -0,0 +1,53 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef GRAIN_SIGNS_H
+#define GRAIN_SIGNS_H
+
+#include <stdint.h>
+
+#include "perlovka.h"
+
+/**
+ * Internal to the grain analysis, declared apart for the tests: kept out of
+ * the symbols exported by libperlovka
+ */
+#if defined(__GNUC__) && !defined(_WIN32)
+#define GRAIN_INTERNAL __attribute__ ((visibility ("hidden")))
+#else
+#define GRAIN_INTERNAL
+#endif
+
+/**
+ * Signs of the diff packed one bit per sample, each row starting a word
+ */
+typedef struct
+{
+  size_t words;
+  uint64_t *positive;
+  uint64_t *negative;
+} SignRows;
+
+/**
+ * Pack the signs of the twofold diff in `options->data`. The first column
+ * and the last row hold plain differences: they are left out. The caller
+ * frees `rows->positive`.
+ */
+GRAIN_INTERNAL void pack_signs (PerlovkaOptions const *options,
+                                SignRows *rows);
+
+#endif
@@ -0,0 +1,748 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "image.h"
+
+static inline int
+bytes_per_sample (const Image *image)
+{
+  return image->maxval > 255 ? 2 : 1;
+}
+
+/**
+ * Whether the geometry from a header can be held: the solver takes int
+ * positions, and the planes must not wrap `size_t`
+ */
+static bool
+sizes_fit (const Image *image)
+{
+  size_t size;
+
+  return image->width <= INT_MAX && image->height <= INT_MAX
+         && !__builtin_mul_overflow (image->width, image->height, &size)
+         && !__builtin_mul_overflow (size, (size_t)image->channels, &size)
+         && !__builtin_mul_overflow (size, sizeof (int), &size);
+}
+
+static bool
+alloc_planes (Image *image)
+{
+  size_t size = image->width * image->height;
+
+  memset (image->planes, 0, sizeof (image->planes));
+
+  if (image->width == 0 || image->height == 0 || image->channels < 1
+      || image->channels > 4 || image->maxval < 1 || image->maxval > 65535
+      || !sizes_fit (image))
+    return false;
+
+  for (int channel = 0; channel < image->channels; ++channel)
+    {
+      image->planes[channel] = (int *)malloc (sizeof (int) * size);
+
+      if (image->planes[channel] == NULL)
+        {
+          clean_image (image);
+          return false;
+        }
+    }
+
+  image->color_channels = image->channels <= 2 ? 1 : 3;
+
+  return true;
+}
+
+/**
+ * Map the whole input file for one sequential pass. Returns NULL if it is not
+ * a regular file or cannot be mapped, the caller falls back to stdio then.
+ */
+static unsigned char *
+map_input (const char *file_name, size_t *size)
+{
+  struct stat info;
+  void *map;
+  int fd = open (file_name, O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0)
+    return NULL;
+
+  if (fstat (fd, &info) != 0 || !S_ISREG (info.st_mode) || info.st_size == 0)
+    {
+      close (fd);
+      return NULL;
+    }
+
+  *size = info.st_size;
+  map = mmap (NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+
+  if (map == MAP_FAILED)
+    return NULL;
+
+  madvise (map, *size, MADV_SEQUENTIAL);
+
+  return (unsigned char *)map;
+}
+
+/**
+ * Create the output file of `size` bytes and map it for writing. The blocks
+ * are allocated up front, so a full disk is reported here rather than by a
+ * SIGBUS later. Returns NULL if this is impossible.
+ */
+static unsigned char *
+map_output (const char *file_name, size_t size)
+{
+  struct stat info;
+  void *map;
+  int fd;
+
+  /* Special files such as /dev/stdout are written with stdio */
+  if (stat (file_name, &info) == 0 && !S_ISREG (info.st_mode))
+    return NULL;
+
+  fd = open (file_name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+  if (fd < 0)
+    return NULL;
+
+  if (posix_fallocate (fd, 0, size) != 0)
+    {
+      close (fd);
+      return NULL;
+    }
+
+  map = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+
+  if (map == MAP_FAILED)
+    return NULL;
+
+  madvise (map, size, MADV_SEQUENTIAL);
+
+  return (unsigned char *)map;
+}
+
+/**
+ * Skip whitespace and comments in the PNM header
+ */
+static void
+skip_space (FILE *file)
+{
+  int c;
+
+  while ((c = fgetc (file)) != EOF)
+    {
+      if (c == '#')
+        {
+          while ((c = fgetc (file)) != EOF && c != '\n')
+            ;
+        }
+      else if (!isspace (c))
+        {
+          ungetc (c, file);
+          break;
+        }
+    }
+}
+
+static bool
+read_number (FILE *file, size_t *value)
+{
+  unsigned long number;
+
+  skip_space (file);
+
+  if (fscanf (file, "%lu", &number) != 1)
+    return false;
+
+  *value = number;
+
+  return true;
+}
+
+static bool
+read_pam_header (Image *image, FILE *file)
+{
+  char line[256];
+  char key[32];
+  char value[64];
+  unsigned long number;
+
+  image->channels = 0;
+
+  while (fgets (line, sizeof (line), file))
+    {
+      if (line[0] == '#')
+        continue;
+
+      if (sscanf (line, "%31s", key) != 1)
+        continue;
+
+      if (strcmp (key, "ENDHDR") == 0)
+        return true;
+
+      if (sscanf (line, "%*s %63s", value) != 1)
+        return false;
+
+      if (strcmp (key, "TUPLTYPE") == 0)
+        {
+          /* Not copied with strncpy from `value`: a longer tuple type was
+             truncated without a terminating NUL */
+          sscanf (line, "%*s %31s", image->tuple_type);
+          continue;
+        }
+
+      number = strtoul (value, NULL, 10);
+
+      if (number > INT_MAX)
+        return false;
+
+      if (strcmp (key, "WIDTH") == 0)
+        image->width = number;
+      else if (strcmp (key, "HEIGHT") == 0)
+        image->height = number;
+      else if (strcmp (key, "DEPTH") == 0)
+        image->channels = number;
+      else if (strcmp (key, "MAXVAL") == 0)
+        image->maxval = number;
+    }
+
+  return false;
+}
+
+static bool
+parse_header (Image *image, FILE *file)
+{
+  size_t width;
+  size_t height;
+  size_t maxval;
+  int c;
+
+  if (fgetc (file) != 'P')
+    return false;
+
+  image->pnm_type = fgetc (file) - '0';
+
+  if (image->pnm_type == 7)
+    {
+      if (fgetc (file) != '\n')
+        return false;
+
+      return read_pam_header (image, file);
+    }
+
+  if (image->pnm_type != 5 && image->pnm_type != 6)
+    return false;
+
+  if (!read_number (file, &width) || !read_number (file, &height)
+      || !read_number (file, &maxval))
+    return false;
+
+  /* Single whitespace separates the header from the samples */
+  c = fgetc (file);
+  if (!isspace (c))
+    return false;
+
+  if (maxval > 65535)
+    return false;
+
+  image->width = width;
+  image->height = height;
+  image->maxval = maxval;
+  image->channels = image->pnm_type == 5 ? 1 : 3;
+
+  return true;
+}
+
+bool
+read_pnm_header (Image *image, FILE *file)
+{
+  memset (image, 0, sizeof (Image));
+  image->layout = IMAGE_PNM;
+
+  if (!parse_header (image, file))
+    return false;
+
+  image->color_channels = image->channels <= 2 ? 1 : 3;
+
+  return image->width > 0 && image->height > 0 && image->channels >= 1
+         && image->channels <= 4 && image->maxval >= 1
+         && image->maxval <= 65535 && sizes_fit (image);
+}
+
+/**
+ * Split interleaved samples of `count` pixels into the planes
+ */
+static void
+deinterleave (Image *image, const unsigned char *buffer, size_t offset,
+              size_t count)
+{
+  const unsigned char *ptr = buffer;
+  int channel;
+
+  if (bytes_per_sample (image) == 1)
+    {
+      for (size_t index = offset; index < offset + count; ++index)
+        for (channel = 0; channel < image->channels; ++channel)
+          image->planes[channel][index] = *ptr++;
+    }
+  else
+    {
+      for (size_t index = offset; index < offset + count; ++index)
+        for (channel = 0; channel < image->channels; ++channel)
+          {
+            image->planes[channel][index] = (ptr[0] << 8) | ptr[1];
+            ptr += 2;
+          }
+    }
+}
+
+/**
+ * Join samples of `count` pixels from the planes into big-endian tuples
+ */
+static void
+interleave (const Image *image, unsigned char *buffer, size_t offset,
+            size_t count)
+{
+  unsigned char *ptr = buffer;
+  int channel;
+  int value;
+
+  if (bytes_per_sample (image) == 1)
+    {
+      for (size_t index = offset; index < offset + count; ++index)
+        for (channel = 0; channel < image->channels; ++channel)
+          *ptr++ = (unsigned char)image->planes[channel][index];
+    }
+  else
+    {
+      for (size_t index = offset; index < offset + count; ++index)
+        for (channel = 0; channel < image->channels; ++channel)
+          {
+            value = image->planes[channel][index];
+            *ptr++ = (unsigned char)(value >> 8);
+            *ptr++ = (unsigned char)value;
+          }
+    }
+}
+
+/**
+ * Read PNM with stdio row by row
+ */
+static bool
+read_pnm_file (Image *image, const char *file_name)
+{
+  FILE *file;
+  unsigned char *row;
+  size_t row_size;
+  bool result = true;
+
+  memset (image, 0, sizeof (Image));
+
+  file = fopen (file_name, "rb");
+  if (file == NULL)
+    return false;
+
+  if (!read_pnm_header (image, file) || !alloc_planes (image))
+    {
+      fclose (file);
+      return false;
+    }
+
+  row_size = image->width * image->channels * bytes_per_sample (image);
+  row = (unsigned char *)malloc (row_size);
+
+  for (size_t y = 0; result && y < image->height; ++y)
+    {
+      result = fread (row, 1, row_size, file) == row_size;
+
+      if (result)
+        deinterleave (image, row, y * image->width, image->width);
+    }
+
+  free (row);
+  fclose (file);
+
+  if (!result)
+    clean_image (image);
+
+  return result;
+}
+
+bool
+read_pnm (Image *image, const char *file_name)
+{
+  FILE *header;
+  unsigned char *map;
+  size_t size;
+  long offset;
+  size_t samples;
+  bool result;
+
+  map = map_input (file_name, &size);
+
+  if (map == NULL)
+    return read_pnm_file (image, file_name);
+
+  /* The header is parsed by the stdio code from the mapped pages */
+  header = fmemopen (map, size, "r");
+  result = header && read_pnm_header (image, header);
+  offset = header ? ftell (header) : -1;
+
+  if (header)
+    fclose (header);
+
+  samples = image->width * image->height * image->channels;
+  result = result && offset > 0
+           && (size - offset) / bytes_per_sample (image) >= samples
+           && alloc_planes (image);
+
+  /* Samples go from the mapped pages straight into the planes */
+  if (result)
+    deinterleave (image, map + offset, 0, image->width * image->height);
+
+  munmap (map, size);
+
+  return result;
+}
+
+bool
+write_pnm_header (Image const *image, FILE *file)
+{
+  if (image->pnm_type == 7)
+    {
+      fprintf (file, "P7\nWIDTH %zu\nHEIGHT %zu\nDEPTH %d\nMAXVAL %d\n",
+               image->width, image->height, image->channels, image->maxval);
+
+      if (image->tuple_type[0])
+        fprintf (file, "TUPLTYPE %s\n", image->tuple_type);
+
+      return fprintf (file, "ENDHDR\n") > 0;
+    }
+
+  return fprintf (file, "P%d\n%zu %zu\n%d\n", image->pnm_type, image->width,
+                  image->height, image->maxval)
+         > 0;
+}
+
+bool
+read_pnm_row (Image const *image, FILE *file, int *const *rows)
+{
+  Image row_image = *image;
+  unsigned char *buffer;
+  size_t row_size = image->width * image->channels * bytes_per_sample (image);
+  bool result;
+
+  for (int channel = 0; channel < image->channels; ++channel)
+    row_image.planes[channel] = rows[channel];
+
+  buffer = (unsigned char *)malloc (row_size);
+  result = buffer && fread (buffer, 1, row_size, file) == row_size;
+
+  if (result)
+    deinterleave (&row_image, buffer, 0, image->width);
+
+  free (buffer);
+
+  return result;
+}
+
+bool
+write_pnm_row (Image const *image, FILE *file, int *const *rows)
+{
+  Image row_image = *image;
+  unsigned char *buffer;
+  size_t row_size = image->width * image->channels * bytes_per_sample (image);
+  bool result;
+
+  for (int channel = 0; channel < image->channels; ++channel)
+    row_image.planes[channel] = rows[channel];
+
+  buffer = (unsigned char *)malloc (row_size);
+
+  if (buffer)
+    interleave (&row_image, buffer, 0, image->width);
+
+  result = buffer && fwrite (buffer, 1, row_size, file) == row_size;
+
+  free (buffer);
+
+  return result;
+}
+
+/**
+ * Write PNM with stdio row by row
+ */
+static bool
+write_pnm_file (const Image *image, const char *file_name)
+{
+  FILE *file;
+  unsigned char *row;
+  size_t row_size;
+  bool result = true;
+
+  file = fopen (file_name, "wb");
+  if (file == NULL)
+    return false;
+
+  write_pnm_header (image, file);
+
+  row_size = image->width * image->channels * bytes_per_sample (image);
+  row = (unsigned char *)malloc (row_size);
+
+  for (size_t y = 0; result && y < image->height; ++y)
+    {
+      interleave (image, row, y * image->width, image->width);
+      result = fwrite (row, 1, row_size, file) == row_size;
+    }
+
+  free (row);
+
+  if (fclose (file) != 0)
+    result = false;
+
+  return result;
+}
+
+bool
+write_pnm (const Image *image, const char *file_name)
+{
+  char header[256];
+  FILE *file;
+  unsigned char *map;
+  size_t header_size;
+  size_t size;
+  bool result;
+
+  file = fmemopen (header, sizeof (header), "w");
+
+  if (file == NULL)
+    return write_pnm_file (image, file_name);
+
+  result = write_pnm_header (image, file);
+  header_size = ftell (file);
+  fclose (file);
+
+  size = header_size
+         + image->width * image->height * image->channels
+               * bytes_per_sample (image);
+  map = result ? map_output (file_name, size) : NULL;
+
+  if (map == NULL)
+    return write_pnm_file (image, file_name);
+
+  memcpy (map, header, header_size);
+  interleave (image, map + header_size, 0, image->width * image->height);
+
+  return munmap (map, size) == 0;
+}
+
+/**
+ * Convert a little-endian raw plane into samples
+ */
+static void
+read_raw_plane (Image const *image, int *plane, unsigned char const *buffer)
+{
+  size_t size = image->width * image->height;
+
+  if (bytes_per_sample (image) == 1)
+    {
+      for (size_t index = 0; index < size; ++index)
+        plane[index] = buffer[index];
+    }
+  else
+    {
+      for (size_t index = 0; index < size; ++index)
+        plane[index] = buffer[index * 2] | (buffer[index * 2 + 1] << 8);
+    }
+}
+
+/**
+ * Convert samples into a little-endian raw plane
+ */
+static void
+write_raw_plane (Image const *image, int const *plane, unsigned char *buffer)
+{
+  size_t size = image->width * image->height;
+
+  if (bytes_per_sample (image) == 1)
+    {
+      for (size_t index = 0; index < size; ++index)
+        buffer[index] = (unsigned char)plane[index];
+    }
+  else
+    {
+      for (size_t index = 0; index < size; ++index)
+        {
+          buffer[index * 2] = (unsigned char)plane[index];
+          buffer[index * 2 + 1] = (unsigned char)(plane[index] >> 8);
+        }
+    }
+}
+
+bool
+read_raw (Image *image, const char *file_name)
+{
+  FILE *file;
+  unsigned char *buffer;
+  unsigned char *map;
+  size_t plane_size;
+  size_t size;
+  int channel;
+  bool result = true;
+
+  image->layout = IMAGE_RAW;
+
+  if (!alloc_planes (image))
+    return false;
+
+  plane_size = image->width * image->height * bytes_per_sample (image);
+  map = map_input (file_name, &size);
+
+  if (map)
+    {
+      result = size / image->channels >= plane_size;
+
+      for (channel = 0; result && channel < image->channels; ++channel)
+        read_raw_plane (image, image->planes[channel],
+                        map + channel * plane_size);
+
+      munmap (map, size);
+
+      if (!result)
+        clean_image (image);
+
+      return result;
+    }
+
+  file = fopen (file_name, "rb");
+  if (file == NULL)
+    {
+      clean_image (image);
+      return false;
+    }
+
+  buffer = (unsigned char *)malloc (plane_size);
+
+  for (channel = 0; result && channel < image->channels; ++channel)
+    {
+      result = buffer && fread (buffer, 1, plane_size, file) == plane_size;
+
+      if (result)
+        read_raw_plane (image, image->planes[channel], buffer);
+    }
+
+  free (buffer);
+  fclose (file);
+
+  if (!result)
+    clean_image (image);
+
+  return result;
+}
+
+bool
+write_raw (const Image *image, const char *file_name)
+{
+  FILE *file;
+  unsigned char *buffer;
+  unsigned char *map;
+  size_t plane_size = image->width * image->height * bytes_per_sample (image);
+  int channel;
+  bool result = true;
+
+  map = map_output (file_name, plane_size * image->channels);
+
+  if (map)
+    {
+      for (channel = 0; channel < image->channels; ++channel)
+        write_raw_plane (image, image->planes[channel],
+                         map + channel * plane_size);
+
+      return munmap (map, plane_size * image->channels) == 0;
+    }
+
+  file = fopen (file_name, "wb");
+  if (file == NULL)
+    return false;
+
+  buffer = (unsigned char *)malloc (plane_size);
+
+  for (channel = 0; result && channel < image->channels; ++channel)
+    {
+      if (buffer)
+        write_raw_plane (image, image->planes[channel], buffer);
+
+      result = buffer && fwrite (buffer, 1, plane_size, file) == plane_size;
+    }
+
+  free (buffer);
+
+  if (fclose (file) != 0)
+    result = false;
+
+  return result;
+}
+
+void
+clamp_image (Image *image)
+{
+  size_t size = image->width * image->height;
+  int *ptr;
+  int *pend;
+
+  for (int channel = 0; channel < image->color_channels; ++channel)
+    {
+      ptr = image->planes[channel];
+      pend = ptr + size;
+
+      while (ptr < pend)
+        {
+          if (*ptr < 0)
+            *ptr = 0;
+          else if (*ptr > image->maxval)
+            *ptr = image->maxval;
+          ++ptr;
+        }
+    }
+}
+
+void
+clean_image (Image *image)
+{
+  for (int channel = 0; channel < 4; ++channel)
+    {
+      if (image->planes[channel])
+        free (image->planes[channel]);
+    }
+
+  memset (image->planes, 0, sizeof (image->planes));
+}
@@ -0,0 +1,137 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * File layout of the image samples
+ */
+typedef enum
+{
+  /**
+   * Netpbm PGM (P5), PPM (P6) or PAM (P7)
+   */
+  IMAGE_PNM,
+
+  /**
+   * Headerless planar samples: one full plane per channel, 16-bit samples
+   * are little-endian
+   */
+  IMAGE_RAW
+} ImageLayout;
+
+/**
+ * Image split into planes of int samples ready for denoizing
+ */
+typedef struct
+{
+  ImageLayout layout;
+
+  /**
+   * Netpbm magic number: 5, 6 or 7
+   */
+  int pnm_type;
+
+  /**
+   * PAM tuple type, empty if absent
+   */
+  char tuple_type[32];
+
+  size_t width;
+  size_t height;
+
+  /**
+   * Total amount of channels including alpha
+   */
+  int channels;
+
+  /**
+   * Amount of color channels to denoize (alpha is left as is)
+   */
+  int color_channels;
+
+  /**
+   * Maximal sample value: up to 255 for 8-bit and up to 65535 for 16-bit
+   * images
+   */
+  int maxval;
+
+  /**
+   * One plane of `width * height` samples per channel
+   */
+  int *planes[4];
+} Image;
+
+/**
+ * Read PGM, PPM or PAM file. Returns false on error
+ */
+bool read_pnm (Image *image, const char *file_name);
+
+/**
+ * Write `image` as PNM file of the same type it has been read from
+ */
+bool write_pnm (const Image *image, const char *file_name);
+
+/**
+ * Read PNM header leaving `file` at the first sample. Planes are not
+ * allocated: the samples may be read row by row with `read_pnm_row`.
+ */
+bool read_pnm_header (Image *image, FILE *file);
+
+/**
+ * Read the next row of samples into `rows`, one array of `width` samples per
+ * channel
+ */
+bool read_pnm_row (Image const *image, FILE *file, int *const *rows);
+
+/**
+ * Write PNM header for `image`
+ */
+bool write_pnm_header (Image const *image, FILE *file);
+
+/**
+ * Write one row of samples taken from `rows`, one array per channel
+ */
+bool write_pnm_row (Image const *image, FILE *file, int *const *rows);
+
+/**
+ * Read headerless planar file with the geometry given by `image` fields
+ * `width`, `height`, `channels` and `maxval`
+ */
+bool read_raw (Image *image, const char *file_name);
+
+/**
+ * Write the planes one after another with no header
+ */
+bool write_raw (const Image *image, const char *file_name);
+
+/**
+ * Bring color samples into [0, maxval]
+ */
+void clamp_image (Image *image);
+
+/**
+ * Free and null the image planes
+ */
+void clean_image (Image *image);
+
+#endif
@@ -0,0 +1,111 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef LIBPERLOVKA_H
+#define LIBPERLOVKA_H
+
+#include "perlovka.h"
+
+/**
+ * Version of the library binary interface. Changes whenever the layout of
+ * `PerlovkaOptions` or `PerlovkaStats` or the semantics of a call change.
+ */
+#define PERLOVKA_ABI_VERSION 3
+
+/**
+ * Denoizing context: settings, geometry, solver plans, buffers and threads
+ * prepared once and reused for every image of the same size
+ */
+typedef struct PerlovkaContext PerlovkaContext;
+
+/**
+ * Sample format of the images passed to the context
+ */
+typedef enum
+{
+  PERLOVKA_SAMPLE_U8,
+  PERLOVKA_SAMPLE_U16,
+  PERLOVKA_SAMPLE_INT
+} PerlovkaSample;
+
+/**
+ * Outcome of the context runs
+ */
+typedef struct
+{
+  /**
+   * Last run: iterations (maximum over the tiles), compensations and whether
+   * all tiles have converged
+   */
+  int iterations_made;
+  size_t resolved;
+  bool converged;
+
+  /**
+   * Last run wall time in seconds
+   */
+  double seconds;
+
+  /**
+   * All runs so far
+   */
+  size_t runs;
+  double total_seconds;
+} PerlovkaStats;
+
+/**
+ * ABI version of the library the program is running with
+ */
+int perlovka_abi_version (void);
+
+/**
+ * Create context for images of `options->width` x `options->height` with the
+ * settings of `options`. Images are split into tiles of `tile_size` (0 for
+ * whole images) denoized by a pool of `threads` threads owned by the context.
+ * Returns NULL if the caller was built against another ABI version.
+ */
+#define perlovka_context_new(options, tile_size, threads)                     \
+  perlovka_context_new_abi (PERLOVKA_ABI_VERSION, sizeof (PerlovkaOptions),   \
+                            (options), (tile_size), (threads))
+
+PerlovkaContext *perlovka_context_new_abi (int abi_version,
+                                           size_t options_size,
+                                           PerlovkaOptions const *options,
+                                           size_t tile_size, int threads);
+
+/**
+ * Stop the threads and free the context
+ */
+void perlovka_context_free (PerlovkaContext *context);
+
+/**
+ * Denoize one plane. `input` and `output` rows are `stride` bytes apart and
+ * may be the same buffer. Integer samples are written back as they are,
+ * others are clamped to [0, maxval]. Nothing is allocated unless `min_gain`
+ * is set, whose per-sample tracking lives for one plane.
+ */
+void perlovka_context_execute (PerlovkaContext *context, void const *input,
+                               void *output, size_t stride,
+                               PerlovkaSample sample, int maxval);
+
+/**
+ * Statistics of the runs
+ */
+void perlovka_context_stats (PerlovkaContext const *context,
+                             PerlovkaStats *stats);
+
+#endif
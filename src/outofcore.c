@@ -0,0 +1,300 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "outofcore.h"
+#include "tiles.h"
+
+/**
+ * Buffers of a tile: the padded input and the denoized core, both in the
+ * sample layout of the file
+ */
+typedef struct
+{
+  TileRect rect;
+  unsigned char *input;
+  unsigned char *output;
+  TileIOBatch reads;
+  TileIOBatch writes;
+} TileSlot;
+
+static double
+seconds (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Index of a sample in a `width` x `height` region stored the way the file
+ * stores samples
+ */
+static size_t
+region_index (PerlovkaFile const *file, int channel, size_t x, size_t y,
+              size_t width, size_t height)
+{
+  if (file->interleaved)
+    return (y * width + x) * file->channels + channel;
+
+  return (channel * height + y) * width + x;
+}
+
+static int
+get_sample (PerlovkaFile const *file, unsigned char const *buffer,
+            size_t index)
+{
+  if (file->bytes == 1)
+    return buffer[index];
+
+  buffer += index * 2;
+
+  return file->big_endian ? (buffer[0] << 8) | buffer[1]
+                          : buffer[0] | (buffer[1] << 8);
+}
+
+static void
+put_sample (PerlovkaFile const *file, unsigned char *buffer, size_t index,
+            int value)
+{
+  if (file->bytes == 1)
+    {
+      buffer[index] = (unsigned char)value;
+      return;
+    }
+
+  buffer += index * 2;
+  buffer[file->big_endian ? 0 : 1] = (unsigned char)(value >> 8);
+  buffer[file->big_endian ? 1 : 0] = (unsigned char)value;
+}
+
+/**
+ * Queue reading or writing of the region [x0, x1) x [y0, y1) of all channels:
+ * a request per row and plane, or per plane when the rows are whole
+ */
+static void
+queue_region (TileIO *io, TileIOBatch *batch, PerlovkaFile const *file,
+              unsigned char *buffer, size_t x0, size_t y0, size_t x1,
+              size_t y1, bool write)
+{
+  size_t width = x1 - x0;
+  size_t height = y1 - y0;
+  size_t pixel = file->interleaved ? file->channels : 1;
+  size_t rows = width == file->width ? height : 1;
+  int planes = file->interleaved ? 1 : file->channels;
+
+  for (int channel = 0; channel < planes; ++channel)
+    {
+      for (size_t y = y0; y < y1; y += rows)
+        {
+          unsigned char *data
+              = buffer
+                + region_index (file, channel, 0, y - y0, width, height)
+                      * file->bytes;
+          size_t size = width * rows * pixel * file->bytes;
+          off_t offset = file->offset
+                         + region_index (file, channel, x0, y, file->width,
+                                         file->height)
+                               * file->bytes;
+
+          if (write)
+            tileio_write (io, batch, file->fd, data, size, offset);
+          else
+            tileio_read (io, batch, file->fd, data, size, offset);
+        }
+    }
+
+  tileio_submit (io);
+}
+
+/**
+ * Denoize the tile read into `slot->input` and put the core into
+ * `slot->output`
+ */
+static void
+denoize_slot (PerlovkaOptions *options, PerlovkaFile const *input,
+              PerlovkaFile const *output, TileSlot *slot, int *plane)
+{
+  PerlovkaOptions tile = *options;
+  TileRect const *rect = &slot->rect;
+  size_t width = rect->right - rect->left;
+  size_t height = rect->bottom - rect->top;
+  size_t core_width = rect->x1 - rect->x0;
+  size_t core_height = rect->y1 - rect->y0;
+  size_t x;
+  size_t y;
+  int value;
+
+  tile.width = width;
+  tile.height = height;
+  tile.data = plane;
+  tile.progress = NULL;
+  tile.cancelled = NULL;
+
+  for (int channel = 0; channel < input->channels; ++channel)
+    {
+      for (y = 0; y < height; ++y)
+        for (x = 0; x < width; ++x)
+          plane[y * width + x] = get_sample (
+              input, slot->input,
+              region_index (input, channel, x, y, width, height));
+
+      if (channel < input->color_channels)
+        {
+          perlovka_denoize (&tile);
+
+          if (tile.iterations_made > options->iterations_made)
+            options->iterations_made = tile.iterations_made;
+
+          options->resolved += tile.resolved;
+          options->converged = options->converged && tile.converged;
+        }
+
+      for (y = 0; y < core_height; ++y)
+        for (x = 0; x < core_width; ++x)
+          {
+            value = plane[(rect->y0 - rect->top + y) * width
+                          + (rect->x0 - rect->left + x)];
+
+            if (value < 0)
+              value = 0;
+            else if (value > output->maxval)
+              value = output->maxval;
+
+            put_sample (output, slot->output,
+                        region_index (output, channel, x, y, core_width,
+                                      core_height),
+                        value);
+          }
+    }
+}
+
+bool
+perlovka_denoize_file (PerlovkaOptions *options, PerlovkaFile const *input,
+                       PerlovkaFile const *output, size_t tile_size,
+                       TileIO *io, PerlovkaFileStats *stats)
+{
+  TileSlot slots[2];
+  TileRect rect;
+  size_t n_tiles;
+  size_t padded = 0;
+  size_t core = 0;
+  size_t rows = 0;
+  size_t tile;
+  double started;
+  int *plane;
+  bool ok = true;
+
+  options->width = input->width;
+  options->height = input->height;
+  options->iterations_made = 0;
+  options->resolved = 0;
+  options->converged = true;
+  memset (stats, 0, sizeof (PerlovkaFileStats));
+
+  n_tiles = perlovka_tile_count (options, tile_size);
+
+  for (tile = 0; tile < n_tiles; ++tile)
+    {
+      perlovka_tile_rect (options, tile_size, tile, &rect);
+
+      if ((rect.right - rect.left) * (rect.bottom - rect.top) > padded)
+        padded = (rect.right - rect.left) * (rect.bottom - rect.top);
+
+      if ((rect.x1 - rect.x0) * (rect.y1 - rect.y0) > core)
+        core = (rect.x1 - rect.x0) * (rect.y1 - rect.y0);
+
+      if (rect.bottom - rect.top > rows)
+        rows = rect.bottom - rect.top;
+    }
+
+  plane = (int *)malloc (sizeof (int) * padded);
+
+  for (int index = 0; index < 2; ++index)
+    {
+      slots[index].input = (unsigned char *)malloc (
+          padded * input->channels * input->bytes);
+      slots[index].output = (unsigned char *)malloc (
+          core * output->channels * output->bytes);
+      tileio_init_batch (&slots[index].reads, rows * input->channels);
+      tileio_init_batch (&slots[index].writes, rows * output->channels);
+    }
+
+  perlovka_tile_rect (options, tile_size, 0, &slots[0].rect);
+  queue_region (io, &slots[0].reads, input, slots[0].input,
+                slots[0].rect.left, slots[0].rect.top, slots[0].rect.right,
+                slots[0].rect.bottom, false);
+
+  for (tile = 0; ok && tile < n_tiles; ++tile)
+    {
+      TileSlot *slot = &slots[tile % 2];
+      TileSlot *next = &slots[(tile + 1) % 2];
+
+      /* Prefetch the next tile while this one is denoized */
+      if (tile + 1 < n_tiles)
+        {
+          perlovka_tile_rect (options, tile_size, tile + 1, &next->rect);
+          queue_region (io, &next->reads, input, next->input,
+                        next->rect.left, next->rect.top, next->rect.right,
+                        next->rect.bottom, false);
+        }
+
+      started = seconds ();
+      ok = tileio_wait (io, &slot->reads);
+      stats->read_wait_seconds += seconds () - started;
+
+      /* The output buffer of the slot still holds the tile before the
+         previous one */
+      started = seconds ();
+      ok = tileio_wait (io, &slot->writes) && ok;
+      stats->write_wait_seconds += seconds () - started;
+
+      if (!ok)
+        break;
+
+      started = seconds ();
+      denoize_slot (options, input, output, slot, plane);
+      stats->solve_seconds += seconds () - started;
+      ++stats->tiles;
+
+      queue_region (io, &slot->writes, output, slot->output, slot->rect.x0,
+                    slot->rect.y0, slot->rect.x1, slot->rect.y1, true);
+    }
+
+  /* Nothing may be left in flight when the buffers are freed */
+  for (int index = 0; index < 2; ++index)
+    {
+      started = seconds ();
+      ok = tileio_wait (io, &slots[index].reads) && ok;
+      ok = tileio_wait (io, &slots[index].writes) && ok;
+      stats->write_wait_seconds += seconds () - started;
+
+      free (slots[index].input);
+      free (slots[index].output);
+      tileio_clean_batch (&slots[index].reads);
+      tileio_clean_batch (&slots[index].writes);
+    }
+
+  free (plane);
+
+  return ok;
+}
@@ -0,0 +1,90 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef OUTOFCORE_H
+#define OUTOFCORE_H
+
+#include <sys/types.h>
+
+#include "perlovka.h"
+#include "tileio.h"
+
+/**
+ * Image samples stored in a file
+ */
+typedef struct
+{
+  int fd;
+
+  /**
+   * Position of the first sample
+   */
+  off_t offset;
+
+  size_t width;
+  size_t height;
+  int channels;
+
+  /**
+   * Channels to denoize, the others (alpha) are copied as they are
+   */
+  int color_channels;
+
+  /**
+   * Sample size (1 or 2 bytes) and byte order
+   */
+  int bytes;
+  bool big_endian;
+
+  /**
+   * Channels of a pixel are adjacent (PNM) rather than stored as planes one
+   * after another (raw)
+   */
+  bool interleaved;
+
+  int maxval;
+} PerlovkaFile;
+
+/**
+ * Where the time of an out-of-core run went
+ */
+typedef struct
+{
+  size_t tiles;
+  double solve_seconds;
+
+  /**
+   * Time the solver spent waiting for the input of a tile and for the
+   * buffer of an earlier tile to be written
+   */
+  double read_wait_seconds;
+  double write_wait_seconds;
+} PerlovkaFileStats;
+
+/**
+ * Denoize `input` into `output` of the same geometry tile by tile, keeping
+ * only two padded tiles in memory. While a tile is denoized, the next one is
+ * read and the previous one is written by `io`. The result is the same as
+ * that of `perlovka_denoize_tiled` with clamping. Returns false on an I/O
+ * error.
+ */
+bool perlovka_denoize_file (PerlovkaOptions *options,
+                            PerlovkaFile const *input,
+                            PerlovkaFile const *output, size_t tile_size,
+                            TileIO *io, PerlovkaFileStats *stats);
+
+#endif
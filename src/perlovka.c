@@ -15,63 +15,355 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
+#include <stdlib.h>
 #include <string.h>
 
 #include "diff.h"
 #include "perlovka.h"
 #include "solver.h"
 
+/**
+ * Reversals of the direction a sample changes in between iterations after
+ * which it is frozen
+ */
+#define OSCILLATION_FLIPS 2
+
+/**
+ * Convergence tracking of `min_gain`: the diff after the last iteration, and
+ * for every sample the direction of its last change, the reversals of it and
+ * whether it is frozen
+ */
+typedef struct
+{
+  int *previous;
+  signed char *directions;
+  unsigned char *flips;
+  unsigned char *frozen;
+  double first_change;
+} Controller;
+
 void
-perlovka_denoize (PerlovkaOptions *options)
+perlovka_init_options (PerlovkaOptions *options)
 {
-  PSolver solver;
-  size_t size = options->width * options->height;
+  memset (options, 0, sizeof (PerlovkaOptions));
 
-  int max_height = options->height - options->radius - 1;
-  int max_width = options->width - options->radius - 1;
+  options->radius = 5;
+  options->iterations = 5;
+  options->grid = GRID_ODD;
+  options->matching = MATCHING_SOFT;
+  options->resolver = RESOLVER_MINIMAL;
+}
 
-  size_t resolved = 0;
-  int iteration = 0;
-  int solved_in_one_go;
-  int position;
-  int x, y;
-  int grid_index;
-  int solver_index;
+void
+perlovka_diff (PerlovkaOptions *options)
+{
+  size_t size = options->width * options->height;
 
   diff_horizontal (options->data, size);
   diff_vertical (options->data, size, options->width);
+}
+
+void
+perlovka_undiff (PerlovkaOptions *options)
+{
+  size_t size = options->width * options->height;
+
+  undiff_vertical (options->data, size, options->width);
+  undiff_horizontal (options->data, size);
+}
+
+/**
+ * Whether no iteration is left to run, setting `stopped` to the reason
+ */
+static bool
+solve_finished (PerlovkaOptions *options)
+{
+  if (options->converged)
+    options->stopped = PERLOVKA_STOP_CONVERGED;
+  else if (options->iterations_made >= options->iterations)
+    options->stopped = PERLOVKA_STOP_LIMIT;
+  else
+    return false;
+
+  return true;
+}
+
+void
+perlovka_solve (PerlovkaOptions *options)
+{
+  PSolver solver;
+
+  if (solve_finished (options))
+    return;
 
   solver = build_solver (options->width, options->radius, options->grid,
                          options->matching, options->resolver,
                          options->field_matching);
 
+  perlovka_solve_plan (options, solver);
+
+  clean_solver (solver);
+}
+
+static void
+start_controller (Controller *controller, PerlovkaOptions const *options)
+{
+  size_t size = options->width * options->height;
+
+  controller->previous = (int *)malloc (sizeof (int) * size);
+  controller->directions = (signed char *)calloc (size * 3, 1);
+  controller->flips = (unsigned char *)controller->directions + size;
+  controller->frozen = controller->flips + size;
+  controller->first_change = 0;
+
+  memcpy (controller->previous, options->data, sizeof (int) * size);
+}
+
+static void
+clean_controller (Controller *controller)
+{
+  free (controller->previous);
+  free (controller->directions);
+}
+
+/**
+ * Take the changes of the diff by the iteration just done: freeze the samples
+ * oscillating and return whether the iterations may go on
+ */
+static bool
+control_iteration (Controller *controller, PerlovkaOptions *options)
+{
+  size_t size = options->width * options->height;
+  double change = 0;
+  int delta;
+  signed char direction;
+
+  for (size_t position = 0; position < size; ++position)
+    {
+      delta = options->data[position] - controller->previous[position];
+
+      if (delta == 0)
+        continue;
+
+      change += delta > 0 ? delta : -delta;
+      direction = delta > 0 ? 1 : -1;
+
+      if (controller->directions[position] == -direction
+          && ++controller->flips[position] == OSCILLATION_FLIPS)
+        {
+          controller->frozen[position] = 1;
+          ++options->frozen;
+        }
+
+      controller->directions[position] = direction;
+      controller->previous[position] = options->data[position];
+    }
+
+  if (controller->first_change == 0)
+    {
+      controller->first_change = change;
+      options->gain = 1;
+      return true;
+    }
+
+  options->gain = change / controller->first_change;
+
+  return options->gain >= options->min_gain;
+}
+
+/**
+ * Run the blocks of one checkerboard pass of `SCAN_BLOCKS` over the rows
+ * from `y`, one block high
+ */
+static int
+scan_block_row (PerlovkaOptions const *options, PSolver solver,
+                PSolverIndex index, int y, int end, int pass)
+{
+  int width = options->width;
+  int left = options->radius + 1;
+  int right = width - options->radius;
+  int parity = (pass + (y - options->radius) / SCAN_BLOCK) % 2;
+  int result = 0;
+  int x;
+  int row;
+
+  for (x = left + parity * SCAN_BLOCK; x < right; x += 2 * SCAN_BLOCK)
+    for (row = y; row < end; ++row)
+      result += apply_indexed_solver_span (
+          solver, index, options->data, row * width + x,
+          row * width + (x + SCAN_BLOCK < right ? x + SCAN_BLOCK : right),
+          false);
+
+  return result;
+}
+
+/**
+ * Run iteration `iteration` over the rows in the scan order of `options`,
+ * adding its compensations to `*solved`. Returns false once cancelled.
+ */
+static bool
+scan_iteration (PerlovkaOptions *options, PSolver solver, PSolverIndex index,
+                int iteration, int *solved)
+{
+  int width = options->width;
+  int top = options->radius;
+  int bottom = options->height - options->radius - 1;
+  int left = options->radius + 1;
+  int right = width - options->radius;
+  bool reverse = options->scan == SCAN_ALTERNATE && iteration % 2 == 1;
+  int row;
+  int y;
+
+  if (options->scan == SCAN_BLOCKS)
+    {
+      for (int pass = 0; pass < 2; ++pass)
+        for (y = top; y < bottom; y += SCAN_BLOCK)
+          {
+            if (options->cancelled && options->cancelled (options->context))
+              return false;
+
+            *solved += scan_block_row (
+                options, solver, index, y,
+                y + SCAN_BLOCK < bottom ? y + SCAN_BLOCK : bottom, pass);
+          }
+
+      return true;
+    }
+
+  for (row = 0; top + row < bottom; ++row)
+    {
+      if (options->cancelled && options->cancelled (options->context))
+        return false;
+
+      y = reverse ? bottom - 1 - row : top + row;
+      *solved += apply_indexed_solver_span (
+          solver, index, options->data, y * width + left, y * width + right,
+          reverse || (options->scan == SCAN_SERPENTINE && row % 2 == 1));
+    }
+
+  return true;
+}
+
+/**
+ * Iterate over the diff indexed in `index`, which is left to the caller
+ */
+static void
+solve_indexed (PerlovkaOptions *options, PSolver solver, PSolverIndex index)
+{
+  size_t resolved = options->resolved;
+  int iteration = options->iterations_made;
+  int solved_in_one_go;
+  bool gaining = true;
+  Controller controller = { 0 };
+
+  if (options->prune_below > 0)
+    track_solver_hits (index);
+
+  if (options->min_gain > 0)
+    {
+      start_controller (&controller, options);
+      freeze_solver_samples (index, controller.frozen);
+    }
+
   do
     {
       solved_in_one_go = 0;
 
-      for (y = options->radius; y < max_height; ++y)
+      if (options->probe_budget > 0)
+        limit_solver_probes (index, options->probe_budget * (iteration + 1));
+
+      if (!scan_iteration (options, solver, index, iteration,
+                           &solved_in_one_go))
         {
-          position = y * options->width + options->radius;
-
-          for (int x = options->radius; x < max_width; ++x)
-            {
-              ++position;
-              solved_in_one_go
-                  += apply_solver (solver, options->data, position);
-            }
+          options->iterations_made = iteration;
+          options->resolved = resolved + solved_in_one_go;
+          options->stopped = PERLOVKA_STOP_CANCELLED;
+
+          if (options->min_gain > 0)
+            clean_controller (&controller);
+          return;
         }
       resolved += solved_in_one_go;
 
+      if (options->min_gain > 0 && solved_in_one_go > 0)
+        gaining = control_iteration (&controller, options);
+
+      /* Only the iterations still to come can use the pruned plan */
+      if (options->prune_below > 0 && solved_in_one_go > 0
+          && iteration + 1 < options->iterations)
+        options->pruned += prune_solver_index (index, options->prune_below);
+
       if (options->progress)
         options->progress (options->context);
     }
-  while (++iteration < options->iterations && solved_in_one_go > 0);
-
-  clean_solver (solver);
+  while (++iteration < options->iterations && solved_in_one_go > 0
+         && gaining);
 
-  undiff_vertical (options->data, size, options->width);
-  undiff_horizontal (options->data, size);
+  if (options->min_gain > 0)
+    clean_controller (&controller);
 
   options->iterations_made = iteration;
   options->resolved = resolved;
+  options->converged = solved_in_one_go == 0;
+
+  if (options->converged)
+    options->stopped = PERLOVKA_STOP_CONVERGED;
+  else if (!gaining)
+    options->stopped = PERLOVKA_STOP_GAIN;
+  else
+    options->stopped = PERLOVKA_STOP_LIMIT;
+}
+
+void
+perlovka_solve_plan (PerlovkaOptions *options, PSolver solver)
+{
+  PSolverIndex index;
+
+  if (solve_finished (options))
+    return;
+
+  index = build_solver_index (solver, options->data, options->width,
+                              options->height);
+  solve_indexed (options, solver, index);
+  clean_solver_index (index);
+}
+
+void
+perlovka_solve_indexed (PerlovkaOptions *options, PSolver solver,
+                        PSolverIndex index)
+{
+  if (solve_finished (options))
+    return;
+
+  rebuild_solver_index (index, solver, options->data, options->width,
+                        options->height);
+  solve_indexed (options, solver, index);
+}
+
+bool
+perlovka_solve_rowwise (PerlovkaOptions const *options)
+{
+  return options->scan == SCAN_RASTER && options->prune_below <= 0
+         && options->min_gain <= 0 && options->probe_budget <= 0;
+}
+
+bool
+perlovka_solve_resumable (PerlovkaOptions const *options)
+{
+  return options->prune_below <= 0 && options->min_gain <= 0;
+}
+
+void
+perlovka_denoize (PerlovkaOptions *options)
+{
+  options->iterations_made = 0;
+  options->resolved = 0;
+  options->converged = false;
+  options->pruned = 0;
+  options->gain = 0;
+  options->frozen = 0;
+
+  perlovka_diff (options);
+  perlovka_solve (options);
+  perlovka_undiff (options);
 }
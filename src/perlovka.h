@@ -20,6 +20,65 @@
 
 #include "solver.h"
 
+/**
+ * Order the pixels are visited in during an iteration
+ */
+typedef enum
+{
+  /**
+   * Rows top to bottom, each left to right
+   */
+  SCAN_RASTER = 0,
+
+  /**
+   * Raster in even iterations, bottom to top and right to left in odd ones
+   */
+  SCAN_ALTERNATE,
+
+  /**
+   * Rows top to bottom, every second one right to left
+   */
+  SCAN_SERPENTINE,
+
+  /**
+   * Blocks of `SCAN_BLOCK` pixels in two checkerboard passes, each block in
+   * raster order
+   */
+  SCAN_BLOCKS
+} ScanOrder;
+
+/**
+ * Side of the square blocks of `SCAN_BLOCKS`
+ */
+#define SCAN_BLOCK 32
+
+/**
+ * Why the iterations have stopped, from the most final reason: merging runs
+ * keeps the largest one
+ */
+typedef enum
+{
+  /**
+   * The last iteration found nothing to compensate
+   */
+  PERLOVKA_STOP_CONVERGED = 0,
+
+  /**
+   * The last iteration changed the diff less than `min_gain` of the first one
+   */
+  PERLOVKA_STOP_GAIN,
+
+  /**
+   * The iterations limit was reached
+   */
+  PERLOVKA_STOP_LIMIT,
+
+  /**
+   * The cancellation check returned true
+   */
+  PERLOVKA_STOP_CANCELLED
+} PerlovkaStop;
+
 /**
  * Color channel to denoize along with additional data and settings
  */
@@ -40,6 +99,33 @@ typedef struct
    */
   size_t resolved;
 
+  /**
+   * The last iteration found nothing to compensate: further iterations would
+   * not change the data
+   */
+  bool converged;
+
+  /**
+   * Boxes dropped from the plan by pruning
+   */
+  size_t pruned;
+
+  /**
+   * Why the last solve has stopped
+   */
+  PerlovkaStop stopped;
+
+  /**
+   * Sum of absolute changes of the diff by the last iteration as a share of
+   * the sum by the first one, tracked with `min_gain` only
+   */
+  double gain;
+
+  /**
+   * Diff samples frozen for changing direction back and forth
+   */
+  size_t frozen;
+
   /**
    * Image width
    */
@@ -56,7 +142,7 @@ typedef struct
   int radius;
 
   /**
-   * Iterations limit
+   * Iterations limit. With 0 no iteration is run.
    */
   int iterations;
 
@@ -79,18 +165,58 @@ typedef struct
    * Compensate pixels around diagonals too
    */
   bool field_matching;
-  
+
+  /**
+   * Order of the pixels within an iteration. Any order but the raster one
+   * gives a different result.
+   */
+  ScanOrder scan;
+
+  /**
+   * Drop the boxes compensating less than this share of their probes during
+   * an iteration from the following iterations, 0 keeps the plan whole. The
+   * result then differs from the full plan.
+   */
+  double prune_below;
+
+  /**
+   * Stop once an iteration changes the diff by less than this share of the
+   * change by the first one, and freeze the samples whose change reverses
+   * direction between iterations again and again. 0 runs until convergence
+   * or the iterations limit. Both are tracked within one solve call only.
+   */
+  double min_gain;
+
+  /**
+   * Boxes of the plan probed at most at one pixel during the first
+   * iteration, growing by as much with every further iteration: the cost of
+   * an iteration is then bounded whatever the radius and field matching. 0
+   * probes the whole plan. The result then differs from the full plan.
+   */
+  int probe_budget;
+
   /**
    * Progress callback called after each iteration
    */
   void (*progress) (void *context);
 
+  /**
+   * Cancellation check polled after each row: iterations stop as soon as it
+   * returns true
+   */
+  bool (*cancelled) (void *context);
+
   /**
    * Progress context for the callback
    */
   void *context;
 } PerlovkaOptions;
 
+/**
+ * Initialize `options` with default settings and no callbacks
+ */
+void perlovka_init_options (PerlovkaOptions *options);
+
 /**
  * Run Perlovka denoize on data presented by `options`
  * @options Data to denoize
@@ -98,4 +224,53 @@ typedef struct
  */
 void perlovka_denoize (PerlovkaOptions *options);
 
+/**
+ * Turn the image in `options->data` into the twofold diff
+ */
+void perlovka_diff (PerlovkaOptions *options);
+
+/**
+ * Compensate grains in the twofold diff in `options->data`. Iterations are
+ * continued from `options->iterations_made` up to `options->iterations`, and
+ * `iterations_made`, `resolved` and `converged` are accumulated. Thus the call
+ * may be repeated on the same diff with a raised iterations limit. `stopped`
+ * tells why the call has returned: a diff already converged or a limit
+ * already reached, 0 included, returns at once with `PERLOVKA_STOP_CONVERGED`
+ * or `PERLOVKA_STOP_LIMIT`.
+ */
+void perlovka_solve (PerlovkaOptions *options);
+
+/**
+ * Same as `perlovka_solve` with the solver plan built by the caller for the
+ * settings and width of `options`
+ */
+void perlovka_solve_plan (PerlovkaOptions *options, PSolver solver);
+
+/**
+ * Same as `perlovka_solve_plan` indexing the diff in the memory of `index`,
+ * built by the caller. Nothing is allocated when `index` has room for the
+ * diff (see `reserve_solver_index`) and `min_gain` is not set.
+ */
+void perlovka_solve_indexed (PerlovkaOptions *options, PSolver solver,
+                             PSolverIndex index);
+
+/**
+ * Whether `options` solve every pixel with the whole plan in raster order:
+ * no `scan` order, `prune_below`, `min_gain` or `probe_budget`. Solvers
+ * working row by row can honor only such options.
+ */
+bool perlovka_solve_rowwise (PerlovkaOptions const *options);
+
+/**
+ * Whether `options` give the same result solved in several calls with a
+ * raised iterations limit: no `prune_below` or `min_gain`, whose state lives
+ * within one call
+ */
+bool perlovka_solve_resumable (PerlovkaOptions const *options);
+
+/**
+ * Restore the image from the twofold diff in `options->data`
+ */
+void perlovka_undiff (PerlovkaOptions *options);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,133 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "daemon.h"
+
+static void
+usage (void)
+{
+  fprintf (stderr,
+           "Usage: perlovkad [OPTIONS]\n"
+           "Denoize jobs submitted over a Unix domain socket in shared "
+           "memory.\n"
+           "\n"
+           "  -s, --socket=PATH       socket to listen on (default\n"
+           "                          $XDG_RUNTIME_DIR/perlovkad.sock)\n"
+           "  -w, --workers=N         jobs denoized at once (default 1)\n"
+           "  -j, --threads=N         threads of each job (default 1)\n"
+           "  -c, --cache=N           contexts kept for later jobs with the\n"
+           "                          same settings and size (default 4)\n"
+           "  -h, --help              show this help\n");
+}
+
+static bool
+parse_int (const char *value, int low, int high, int *result)
+{
+  char *end;
+  long number = strtol (value, &end, 10);
+
+  if (*value == '\0' || *end != '\0' || number < low || number > high)
+    return false;
+
+  *result = (int)number;
+
+  return true;
+}
+
+int
+main (int argc, char **argv)
+{
+  static struct option long_options[] = {
+    { "socket", required_argument, NULL, 's' },
+    { "workers", required_argument, NULL, 'w' },
+    { "threads", required_argument, NULL, 'j' },
+    { "cache", required_argument, NULL, 'c' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 },
+  };
+
+  PerlovkaDaemon *daemon;
+  char path[256];
+  sigset_t signals;
+  int workers = 1;
+  int threads = 1;
+  int cache_size = 4;
+  int signal;
+  int c;
+  bool ok = true;
+
+  perlovka_daemon_default_path (path, sizeof (path));
+
+  while (ok
+         && (c = getopt_long (argc, argv, "s:w:j:c:h", long_options, NULL))
+                != -1)
+    {
+      switch (c)
+        {
+        case 's':
+          snprintf (path, sizeof (path), "%s", optarg);
+          break;
+
+        case 'w':
+          ok = parse_int (optarg, 1, 64, &workers);
+          break;
+
+        case 'j':
+          ok = parse_int (optarg, 1, 1024, &threads);
+          break;
+
+        case 'c':
+          ok = parse_int (optarg, 1, 256, &cache_size);
+          break;
+
+        default:
+          ok = false;
+          break;
+        }
+    }
+
+  if (!ok || optind != argc)
+    {
+      usage ();
+      return 2;
+    }
+
+  /* Threads inherit the mask, so the signals only end the wait below */
+  sigemptyset (&signals);
+  sigaddset (&signals, SIGINT);
+  sigaddset (&signals, SIGTERM);
+  pthread_sigmask (SIG_BLOCK, &signals, NULL);
+
+  daemon = perlovka_daemon_start (path, workers, threads, cache_size);
+
+  if (daemon == NULL)
+    {
+      fprintf (stderr, "perlovkad: cannot listen on %s\n", path);
+      return 1;
+    }
+
+  sigwait (&signals, &signal);
+  perlovka_daemon_stop (daemon);
+
+  return 0;
+}
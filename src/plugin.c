@@ -19,6 +19,7 @@
 
 #include "perlovka.h"
 #include "plugin.h"
+#include "resume.h"
 #include "ui.h"
 
 static void query (void);
@@ -153,7 +154,8 @@ load_params (gint nparams, const GimpParam *param)
     case GIMP_RUN_INTERACTIVE:
       gimp_get_data (PLUG_IN_PROC, &settings);
 
-      if (!show_perlovka_dialog (&settings))
+      if (!show_perlovka_dialog (param[PERLOVKA_PARAM_DRAWABLE].data.d_drawable,
+                                 &settings))
         return GIMP_PDB_CANCEL;
 
       conditions.show_progress = TRUE;
@@ -336,14 +338,36 @@ do_progress ()
   gimp_progress_update (conditions.progress_count);
 }
 
+/**
+ * Identify the channel being denoized for the resume cache
+ */
+void
+init_resume_key (ResumeKey *key, gint32 drawable_id, struct PerlovkaData *data)
+{
+  memset (key, 0, sizeof (ResumeKey));
+
+  key->drawable_id = drawable_id;
+  key->width = data->width;
+  key->height = data->height;
+  key->radius = settings.radius;
+  key->grid = settings.grid;
+  key->matching = settings.matching;
+  key->resolver = settings.resolver;
+  key->field_matching = settings.field_matching ? TRUE : FALSE;
+  key->checksum = resume_checksum (data->channels[0], data->size);
+}
+
 /**
  * Run Perlovka for each channel in the PerlovkaData
  */
 GimpPDBStatusType
-denoize (struct PerlovkaData *data)
+denoize (struct PerlovkaData *data, gint32 drawable_id)
 {
   PerlovkaOptions run_options;
-  int index;
+  ResumeKey key;
+  gboolean use_cache;
+
+  perlovka_init_options (&run_options);
 
   run_options.width = data->width;
   run_options.height = data->height;
@@ -353,7 +377,6 @@ denoize (struct PerlovkaData *data)
   run_options.matching = settings.matching;
   run_options.resolver = settings.resolver;
   run_options.field_matching = settings.field_matching;
-  run_options.progress = NULL;
 
   if (conditions.show_progress)
     {
@@ -364,7 +387,32 @@ denoize (struct PerlovkaData *data)
     }
 
   run_options.data = data->channels[0];
-  perlovka_denoize (&run_options);
+
+  /*
+      Tuning the iterations limit in the dialog reruns the plug-in on the same
+      drawable: keep the solved diff so a raised limit resumes from there.
+  */
+  use_cache = conditions.run_mode != GIMP_RUN_NONINTERACTIVE;
+
+  if (use_cache)
+    init_resume_key (&key, drawable_id, data);
+
+  if (use_cache && resume_load (&key, &run_options))
+    {
+      conditions.progress_count
+          = conditions.progress_tick * run_options.iterations_made;
+    }
+  else
+    {
+      perlovka_diff (&run_options);
+    }
+
+  perlovka_solve (&run_options);
+
+  if (use_cache)
+    resume_store (&key, &run_options);
+
+  perlovka_undiff (&run_options);
   normalize (data->channels[0], data->size);
 
   gimp_progress_update (1.0);
@@ -471,7 +519,7 @@ run (const gchar *name, gint nparams, const GimpParam *param,
   gimp_context_push ();
   gimp_image_undo_group_start (image_id);
 
-  status = denoize (&data);
+  status = denoize (&data, param[PERLOVKA_PARAM_DRAWABLE].data.d_drawable);
   if (status == GIMP_PDB_SUCCESS)
     {
       status = paste_result (image_id, &data);
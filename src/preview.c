@@ -0,0 +1,355 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+#include <string.h>
+
+#include "perlovka.h"
+#include "preview.h"
+
+/**
+ * PreviewJob:
+ * Denoizing of the visible preview area with the settings taken at the moment
+ * of invalidation. Shared by the dialog and the worker thread.
+ */
+typedef struct
+{
+  /**
+   * References held by the dialog and by the worker
+   */
+  gint refs;
+
+  /**
+   * Set by the dialog when the job has gone stale
+   */
+  gint cancelled;
+
+  /**
+   * Preview generation the job has been started for
+   */
+  guint generation;
+
+  /**
+   * Settings and the channel being denoized
+   */
+  PerlovkaOptions options;
+
+  /**
+   * Visible area size
+   */
+  gint width;
+  gint height;
+
+  /**
+   * Offset of the visible area inside the padded region
+   */
+  gint left;
+  gint top;
+
+  /**
+   * Region pixels in the `format` of the job
+   */
+  gint components;
+  guint16 *pixels;
+
+  /**
+   * Restored copy of the channel for intermediate frames
+   */
+  int *scratch;
+
+  /**
+   * Conversion of the region pixels to the preview format
+   */
+  const Babl *fish;
+  GimpImageType image_type;
+  gint bpp;
+} PreviewJob;
+
+/**
+ * PreviewFrame:
+ * Denoized visible area passed from the worker to the dialog
+ */
+typedef struct
+{
+  guint generation;
+  gint width;
+  gint height;
+  GimpImageType image_type;
+  gint bpp;
+  guchar *buffer;
+} PreviewFrame;
+
+static struct
+{
+  /**
+   * Preview widget, NULL when the dialog is closed
+   */
+  GtkWidget *preview;
+
+  gint32 drawable_id;
+
+  PerlovkaPluginSettings *settings;
+
+  /**
+   * Job being calculated
+   */
+  PreviewJob *job;
+
+  /**
+   * Incremented on each invalidation: frames of older jobs are dropped
+   */
+  guint generation;
+} state;
+
+static void
+unref_job (PreviewJob *job)
+{
+  if (!g_atomic_int_dec_and_test (&job->refs))
+    return;
+
+  g_free (job->options.data);
+  g_free (job->scratch);
+  g_free (job->pixels);
+  g_free (job);
+}
+
+static void
+cancel_job (void)
+{
+  if (state.job == NULL)
+    return;
+
+  g_atomic_int_set (&state.job->cancelled, 1);
+  unref_job (state.job);
+  state.job = NULL;
+}
+
+static bool
+job_cancelled (void *context)
+{
+  PreviewJob *job = context;
+
+  return g_atomic_int_get (&job->cancelled) != 0;
+}
+
+static gboolean
+draw_frame (gpointer data)
+{
+  PreviewFrame *frame = data;
+  GtkWidget *area;
+
+  if (state.preview && frame->generation == state.generation)
+    {
+      area = gimp_preview_get_area (GIMP_PREVIEW (state.preview));
+      gimp_preview_area_draw (GIMP_PREVIEW_AREA (area), 0, 0, frame->width,
+                              frame->height, frame->image_type,
+                              frame->buffer, frame->width * frame->bpp);
+    }
+
+  g_free (frame->buffer);
+  g_free (frame);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * Restore the current state of the twofold diff and post it to the dialog
+ */
+static void
+post_frame (void *context)
+{
+  PreviewJob *job = context;
+  PerlovkaOptions restore;
+  PreviewFrame *frame;
+  guint16 *row;
+  guint16 *ptr;
+  int *pdata;
+  int value;
+  gint region_width = job->options.width;
+  gint x, y;
+
+  if (job_cancelled (job))
+    return;
+
+  restore = job->options;
+  restore.data = job->scratch;
+  memcpy (job->scratch, job->options.data,
+          sizeof (int) * job->options.width * job->options.height);
+  perlovka_undiff (&restore);
+
+  frame = g_new (PreviewFrame, 1);
+  frame->generation = job->generation;
+  frame->width = job->width;
+  frame->height = job->height;
+  frame->image_type = job->image_type;
+  frame->bpp = job->bpp;
+  frame->buffer = g_new (guchar, job->width * job->height * job->bpp);
+
+  row = g_new (guint16, job->width * job->components);
+
+  for (y = 0; y < job->height; ++y)
+    {
+      memcpy (row,
+              job->pixels
+                  + ((y + job->top) * region_width + job->left)
+                        * job->components,
+              sizeof (guint16) * job->width * job->components);
+
+      pdata = job->scratch + (y + job->top) * region_width + job->left;
+      ptr = row;
+
+      for (x = 0; x < job->width; ++x)
+        {
+          value = *pdata;
+          *ptr = (guint16)CLAMP (value, 0, G_MAXUINT16);
+          ++pdata;
+          ptr += job->components;
+        }
+
+      babl_process (job->fish, row,
+                    frame->buffer + y * job->width * job->bpp, job->width);
+    }
+
+  g_free (row);
+
+  g_idle_add (draw_frame, frame);
+}
+
+static gpointer
+denoize_job (gpointer data)
+{
+  PreviewJob *job = data;
+
+  perlovka_diff (&job->options);
+  perlovka_solve (&job->options);
+
+  unref_job (job);
+
+  return NULL;
+}
+
+/**
+ * Read the visible area padded by the grain radius and start a worker on it
+ */
+static void
+preview_invalidated (GimpPreview *preview, gpointer user_data)
+{
+  PerlovkaPluginSettings *settings = state.settings;
+  PreviewJob *job;
+  GeglBuffer *buffer;
+  const Babl *format;
+  gboolean gray;
+  gint x, y, width, height;
+  gint left, top, right, bottom;
+  gint halo;
+  size_t size;
+  size_t index;
+
+  cancel_job ();
+  ++state.generation;
+
+  gimp_preview_get_position (preview, &x, &y);
+  gimp_preview_get_size (preview, &width, &height);
+
+  /* Border pixels within the radius are never compensated */
+  halo = settings->radius + 1;
+  left = MAX (0, x - halo);
+  top = MAX (0, y - halo);
+  right = MIN (gimp_drawable_width (state.drawable_id), x + width + halo);
+  bottom = MIN (gimp_drawable_height (state.drawable_id), y + height + halo);
+
+  gray = gimp_drawable_is_gray (state.drawable_id);
+  format = gray ? babl_format ("Y' u16") : babl_format ("CIE Lab u16");
+
+  job = g_new0 (PreviewJob, 1);
+  job->refs = 2;
+  job->generation = state.generation;
+  job->width = width;
+  job->height = height;
+  job->left = x - left;
+  job->top = y - top;
+  job->components = gray ? 1 : 3;
+  job->image_type = gray ? GIMP_GRAY_IMAGE : GIMP_RGB_IMAGE;
+  job->bpp = job->components;
+  job->fish = babl_fish (format, gray ? babl_format ("Y' u8")
+                                      : babl_format ("R'G'B' u8"));
+
+  size = (right - left) * (bottom - top);
+  job->pixels = g_new (guint16, size * job->components);
+  job->scratch = g_new (int, size);
+
+  buffer = gimp_drawable_get_buffer (state.drawable_id);
+  gegl_buffer_get (buffer,
+                   GEGL_RECTANGLE (left, top, right - left, bottom - top), 1.0,
+                   format, job->pixels, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_CLAMP);
+  g_object_unref (buffer);
+
+  perlovka_init_options (&job->options);
+  job->options.data = g_new (int, size);
+  job->options.width = right - left;
+  job->options.height = bottom - top;
+  job->options.radius = settings->radius;
+  job->options.iterations = settings->iterations_limit;
+  job->options.grid = settings->grid;
+  job->options.matching = settings->matching;
+  job->options.resolver = settings->resolver;
+  job->options.field_matching = settings->field_matching;
+  job->options.progress = post_frame;
+  job->options.cancelled = job_cancelled;
+  job->options.context = job;
+
+  for (index = 0; index < size; ++index)
+    job->options.data[index] = job->pixels[index * job->components];
+
+  state.job = job;
+
+  g_thread_unref (g_thread_new ("perlovka-preview", denoize_job, job));
+}
+
+GtkWidget *
+perlovka_preview_new (gint32 drawable_id, PerlovkaPluginSettings *settings)
+{
+  state.drawable_id = drawable_id;
+  state.settings = settings;
+  state.preview = gimp_drawable_preview_new_from_drawable_id (drawable_id);
+
+  g_signal_connect (state.preview, "invalidated",
+                    G_CALLBACK (preview_invalidated), NULL);
+
+  return state.preview;
+}
+
+void
+perlovka_preview_changed (GimpPreview *preview)
+{
+  cancel_job ();
+  ++state.generation;
+
+  gimp_preview_invalidate (preview);
+}
+
+void
+perlovka_preview_stop (void)
+{
+  cancel_job ();
+  ++state.generation;
+  state.preview = NULL;
+}
+
+#pragma GCC diagnostic pop
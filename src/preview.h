@@ -0,0 +1,48 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef PLUGIN_PREVIEW
+#define PLUGIN_PREVIEW
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+#include "plugin.h"
+#include <libgimp/gimp.h>
+#include <libgimp/gimpui.h>
+
+/**
+ * Create preview widget for the drawable. Whenever the preview is invalidated
+ * its visible area is denoized with `settings` in a background thread and
+ * redrawn after each iteration.
+ */
+GtkWidget *perlovka_preview_new (gint32 drawable_id,
+                                 PerlovkaPluginSettings *settings);
+
+/**
+ * Settings have changed: drop the stale job at once and invalidate `preview`
+ */
+void perlovka_preview_changed (GimpPreview *preview);
+
+/**
+ * Cancel background denoizing and forget the preview widget
+ */
+void perlovka_preview_stop (void);
+
+#pragma GCC diagnostic pop
+
+#endif
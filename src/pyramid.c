@@ -0,0 +1,149 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "pyramid.h"
+
+/**
+ * Average 2 x 2 blocks of `data` into `half`; blocks on the odd right and
+ * bottom edges have fewer pixels
+ */
+static void
+downsample (int const *data, size_t width, size_t height, int *half)
+{
+  size_t half_width = (width + 1) / 2;
+  size_t half_height = (height + 1) / 2;
+
+  for (size_t y = 0; y < half_height; ++y)
+    for (size_t x = 0; x < half_width; ++x)
+      {
+        long long sum = 0;
+        int count = 0;
+
+        for (size_t dy = 2 * y; dy < 2 * y + 2 && dy < height; ++dy)
+          for (size_t dx = 2 * x; dx < 2 * x + 2 && dx < width; ++dx)
+            {
+              sum += data[dy * width + dx];
+              ++count;
+            }
+
+        /* Rounded to the nearest, halves away from zero */
+        half[y * half_width + x]
+            = (int)(sum >= 0 ? (sum + count / 2) / count
+                             : -((-sum + count / 2) / count));
+      }
+}
+
+/**
+ * Add the compensations made on the half size copy to the pixels of each
+ * 2 x 2 block
+ */
+static void
+project (int *data, size_t width, size_t height, int const *half,
+         int const *original)
+{
+  size_t half_width = (width + 1) / 2;
+
+  for (size_t y = 0; y < height; ++y)
+    for (size_t x = 0; x < width; ++x)
+      {
+        size_t index = (y / 2) * half_width + x / 2;
+
+        data[y * width + x] += half[index] - original[index];
+      }
+}
+
+static void
+collect (PerlovkaOptions *options, PerlovkaOptions const *level)
+{
+  if (level->iterations_made > options->iterations_made)
+    options->iterations_made = level->iterations_made;
+
+  options->resolved += level->resolved;
+  options->converged = options->converged && level->converged;
+}
+
+/**
+ * Denoize `options->data` with `levels` coarser copies below it: the coarser
+ * ones first, then the refinement
+ */
+static void
+denoize_level (PerlovkaOptions *options, PerlovkaOptions *stats, int levels,
+               int fine_radius)
+{
+  PerlovkaOptions level = *options;
+  size_t half_width = (options->width + 1) / 2;
+  size_t half_height = (options->height + 1) / 2;
+  size_t half_size = half_width * half_height;
+  size_t border = 2 * (size_t)((options->radius + 1) / 2) + 2;
+  int *half;
+  int *original;
+
+  /* A level too small for its radius has nothing to add */
+  if (levels > 0 && half_width > border && half_height > border)
+    {
+      half = (int *)malloc (sizeof (int) * half_size);
+      original = (int *)malloc (sizeof (int) * half_size);
+
+      downsample (options->data, options->width, options->height, half);
+      memcpy (original, half, sizeof (int) * half_size);
+
+      level.data = half;
+      level.width = half_width;
+      level.height = half_height;
+      level.radius = (options->radius + 1) / 2;
+
+      denoize_level (&level, stats, levels - 1, fine_radius);
+      project (options->data, options->width, options->height, half,
+               original);
+
+      free (half);
+      free (original);
+
+      /* Grain of the coarse radius is gone: only the fine one is left */
+      level = *options;
+
+      if (level.radius > fine_radius)
+        level.radius = fine_radius;
+    }
+
+  level.data = options->data;
+  perlovka_denoize (&level);
+  collect (stats, &level);
+}
+
+void
+perlovka_denoize_pyramid (PerlovkaOptions *options, int levels,
+                          int fine_radius)
+{
+  PerlovkaOptions stats;
+
+  if (fine_radius < 1)
+    fine_radius = 1;
+
+  stats.iterations_made = 0;
+  stats.resolved = 0;
+  stats.converged = true;
+
+  denoize_level (options, &stats, levels, fine_radius);
+
+  options->iterations_made = stats.iterations_made;
+  options->resolved = stats.resolved;
+  options->converged = stats.converged;
+}
@@ -0,0 +1,39 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include "perlovka.h"
+
+/**
+ * Multi-resolution denoizing for large grain. The image is halved `levels`
+ * times by averaging 2 x 2 blocks. The coarsest copy is denoized with the
+ * radius scaled down accordingly, and its compensations are added back
+ * onto the twice larger copy, spread over the 2 x 2 blocks. Every finer
+ * copy, and finally the image itself, only needs a refinement with
+ * `fine_radius` (at most `options->radius`). The cost is close to that of
+ * the fine radius alone.
+ *
+ * `iterations_made` is the maximum over the levels, `resolved` their sum and
+ * `converged` whether all of them have converged. With no levels this is
+ * `perlovka_denoize`.
+ */
+void perlovka_denoize_pyramid (PerlovkaOptions *options, int levels,
+                               int fine_radius);
+
+#endif
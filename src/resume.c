@@ -0,0 +1,140 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "plugin.h"
+#include "resume.h"
+
+#define RESUME_MAGIC 0x4b564c50u
+#define RESUME_VERSION 1
+
+/**
+ * Resume file header followed by the twofold diff
+ */
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  ResumeKey key;
+  gint32 iterations_made;
+  gboolean converged;
+  guint64 resolved;
+} ResumeHeader;
+
+static gchar *
+resume_file_name (void)
+{
+  return g_build_filename (g_get_user_cache_dir (), PLUGIN_NAME, "resume.bin",
+                           NULL);
+}
+
+guint64
+resume_checksum (const int *data, size_t size)
+{
+  /* FNV-1a over the channel values */
+  guint64 hash = 14695981039346656037ull;
+  const int *pend = data + size;
+
+  while (data < pend)
+    {
+      hash ^= (guint32)*data;
+      hash *= 1099511628211ull;
+      ++data;
+    }
+
+  return hash;
+}
+
+gboolean
+resume_load (const ResumeKey *key, PerlovkaOptions *options)
+{
+  ResumeHeader header;
+  gchar *file_name;
+  FILE *file;
+  size_t size = options->width * options->height;
+  gboolean result = FALSE;
+
+  file_name = resume_file_name ();
+  file = g_fopen (file_name, "rb");
+  g_free (file_name);
+
+  if (file == NULL)
+    return FALSE;
+
+  if (fread (&header, sizeof (header), 1, file) == 1
+      && header.magic == RESUME_MAGIC && header.version == RESUME_VERSION
+      && memcmp (&header.key, key, sizeof (ResumeKey)) == 0
+      && header.iterations_made <= options->iterations)
+    {
+      result = fread (options->data, sizeof (int), size, file) == size;
+    }
+
+  fclose (file);
+
+  if (result)
+    {
+      options->iterations_made = header.iterations_made;
+      options->resolved = header.resolved;
+      options->converged = header.converged;
+    }
+
+  return result;
+}
+
+void
+resume_store (const ResumeKey *key, const PerlovkaOptions *options)
+{
+  ResumeHeader header;
+  gchar *file_name;
+  gchar *dir_name;
+  FILE *file;
+  size_t size = options->width * options->height;
+
+  memset (&header, 0, sizeof (header));
+  header.magic = RESUME_MAGIC;
+  header.version = RESUME_VERSION;
+  header.key = *key;
+  header.iterations_made = options->iterations_made;
+  header.converged = options->converged;
+  header.resolved = options->resolved;
+
+  file_name = resume_file_name ();
+  dir_name = g_path_get_dirname (file_name);
+  g_mkdir_with_parents (dir_name, 0700);
+  g_free (dir_name);
+
+  file = g_fopen (file_name, "wb");
+
+  if (file)
+    {
+      if (fwrite (&header, sizeof (header), 1, file) != 1
+          || fwrite (options->data, sizeof (int), size, file) != size)
+        {
+          fclose (file);
+          g_remove (file_name);
+        }
+      else
+        {
+          fclose (file);
+        }
+    }
+
+  g_free (file_name);
+}
@@ -0,0 +1,76 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef RESUME_H
+#define RESUME_H
+
+#include <glib.h>
+
+#include "perlovka.h"
+
+/**
+ * ResumeKey:
+ * Identifies the twofold diff solved by the previous plug-in run. The diff may
+ * be reused when everything but the iterations limit matches.
+ */
+typedef struct
+{
+  /**
+   * Source drawable
+   */
+  gint32 drawable_id;
+
+  /**
+   * Source drawable size
+   */
+  gint32 width;
+  gint32 height;
+
+  /**
+   * Settings affecting the solution except for the iterations limit
+   */
+  gint32 radius;
+  gint32 grid;
+  gint32 matching;
+  gint32 resolver;
+  gboolean field_matching;
+
+  /**
+   * Checksum of the source channel, catches edits of the drawable
+   */
+  guint64 checksum;
+} ResumeKey;
+
+/**
+ * Checksum of the channel data before it is diffed
+ */
+guint64 resume_checksum (const int *data, size_t size);
+
+/**
+ * Load the twofold diff saved by the previous run into `options->data` if
+ * `key` matches and the previous run did not overshoot `options->iterations`.
+ * `iterations_made`, `resolved` and `converged` are restored along with the
+ * data. Returns FALSE when there is nothing to resume from.
+ */
+gboolean resume_load (const ResumeKey *key, PerlovkaOptions *options);
+
+/**
+ * Save the twofold diff in `options->data` along with its counters
+ */
+void resume_store (const ResumeKey *key, const PerlovkaOptions *options);
+
+#endif
@@ -15,11 +15,33 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "solver.h"
 
+/**
+ * Smallest field matching ring worth checking against the ring index: the
+ * boxes of smaller rings are cheaper to probe than the index
+ */
+#define RING_INDEX_RADIUS 6
+
+/**
+ * Values of a row or column summarized by one count of the ring index
+ */
+#define RING_BLOCK 8
+
+/**
+ * Positions whose leading boxes are matched at once on the sign bit-planes
+ */
+#define SIGN_WORD 64
+
+/**
+ * Probes of a box in an iteration needed before its hit rate is trusted
+ */
+#define PRUNE_MIN_PROBES 64
+
 typedef struct ArmBox ArmBox;
 typedef ArmBox *PBox;
 
@@ -28,16 +50,135 @@ typedef struct ArmBox
   ArmPosition first;
   ArmPosition second;
   PBox skip_to;
+
+  /**
+   * Radius of the field matching ring the box leads if the ring index may
+   * reject the rest of the ring, 0 otherwise
+   */
+  int ring;
+
+  /**
+   * The box follows the leading box of its ring
+   */
+  bool in_ring;
+
+  bool odd;
 } ArmBox;
 
 typedef struct
 {
   bool (*match) (PCValue lhs, PCValue rhs);
   int (*get_delta) (PCValue lhs, PCValue rhs);
+  int radius;
+  bool field_matching;
+  bool soft;
+
+  /**
+   * Leading boxes of the grids: a position where none of them matches is
+   * left as it is
+   */
+  int n_heads;
+  PBox heads[2];
+
+  /**
+   * Distinct corner offsets of the leading boxes and the corners of every
+   * leading box among them: with both grids the bottom left corner is
+   * shared and its signs are loaded once
+   */
+  int n_corners;
+  int corners[8];
+  int head_corners[2][4];
+
   int n_boxes;
   ArmBox boxes[];
 } Solvers;
 
+/**
+ * Counts of positive and negative diffs in blocks of `RING_BLOCK` values of
+ * every row and every column. The boxes following the leading one of a ring
+ * take their corners from two row and two column segments, and a ring whose
+ * segments lack the signs a match needs is rejected in one check.
+ */
+typedef struct
+{
+  int width;
+  int height;
+  int blocks_across;
+  int blocks_down;
+
+  /**
+   * Row `y` counts start at `y * blocks_across`, column `x` counts at
+   * `x * blocks_down`. Not counted until the first large ring is checked.
+   */
+  bool counted;
+  unsigned char *row_positive;
+  unsigned char *row_negative;
+  unsigned char *column_positive;
+  unsigned char *column_negative;
+
+  /**
+   * Counts the buffers hold for each sign, kept over rebuilds
+   */
+  size_t row_capacity;
+  size_t column_capacity;
+} RingIndex;
+
+/**
+ * Signs of a pair at `SIGN_WORD` positions: both diffs positive or negative,
+ * at least one positive and no negative, or the reverse
+ */
+typedef struct
+{
+  uint64_t positive;
+  uint64_t negative;
+  uint64_t any_positive;
+  uint64_t any_negative;
+} PackedPair;
+
+/**
+ * Signs of the twofold diff packed one bit per position, and the ring index
+ * of large field matching plans
+ */
+typedef struct
+{
+  Solvers const *solvers;
+  uint64_t *positive;
+  uint64_t *negative;
+  size_t words;
+
+  /**
+   * `ring_counts` of large field matching plans, NULL for others
+   */
+  RingIndex *rings;
+  RingIndex ring_counts;
+
+  /**
+   * Probes and compensations of every box since the last pruning, and the
+   * boxes dropped: used only when the hits are tracked
+   */
+  bool tracking;
+  unsigned *probes;
+  unsigned *hits;
+  bool *pruned;
+  int boxes;
+
+  /**
+   * Samples never to change, NULL for none
+   */
+  unsigned char const *frozen;
+
+  /**
+   * Boxes probed at most at one position, 0 for all
+   */
+  int budget;
+} SolverIndex;
+
+typedef struct
+{
+  bool positive;
+  bool negative;
+} Signs;
+
 void
 clean_solver (PSolver solver)
 {
@@ -125,6 +266,8 @@ make_box (PBox box, PBox next_grid, int width, int radius, bool odd)
   init_position (&box->second, row_top + delta_right, row_bottom + delta_left);
 
   box->skip_to = next_grid;
+  box->ring = radius >= RING_INDEX_RADIUS ? radius : 0;
+  box->odd = odd;
   ++box;
 
   for (int count = 1; count < radius; ++count)
@@ -135,6 +278,7 @@ make_box (PBox box, PBox next_grid, int width, int radius, bool odd)
       init_position (&box->second, row_top + delta_right - count,
                      row_bottom + delta_left + count);
       box->skip_to = box + 1;
+      box->in_ring = true;
       ++box;
 
       other_row = width * count;
@@ -145,6 +289,7 @@ make_box (PBox box, PBox next_grid, int width, int radius, bool odd)
       init_position (&box->second, row_top - other_row + delta_right,
                      row_bottom + other_row + delta_left);
       box->skip_to = box + 1;
+      box->in_ring = true;
       ++box;
     }
 
@@ -171,6 +316,33 @@ make_boxes (PBox box, PBox next_grid, int width, int radius,
   return box;
 }
 
+static int
+add_corner (Solvers *solvers, int offset)
+{
+  for (int corner = 0; corner < solvers->n_corners; ++corner)
+    if (solvers->corners[corner] == offset)
+      return corner;
+
+  solvers->corners[solvers->n_corners] = offset;
+
+  return solvers->n_corners++;
+}
+
+static void
+add_head_corners (Solvers *solvers)
+{
+  PBox head;
+
+  for (int index = 0; index < solvers->n_heads; ++index)
+    {
+      head = solvers->heads[index];
+      solvers->head_corners[index][0] = add_corner (solvers, head->first.a);
+      solvers->head_corners[index][1] = add_corner (solvers, head->first.b);
+      solvers->head_corners[index][2] = add_corner (solvers, head->second.a);
+      solvers->head_corners[index][3] = add_corner (solvers, head->second.b);
+    }
+}
+
 PSolver
 build_solver (int width, int radius, Grid grid, MatchMode matching,
               ResolveMode resolver, bool field_matching)
@@ -192,6 +364,9 @@ build_solver (int width, int radius, Grid grid, MatchMode matching,
   memset (solvers, 0, size);
 
   solvers->n_boxes = n_boxes;
+  solvers->radius = radius;
+  solvers->field_matching = field_matching;
+  solvers->soft = matching == MATCHING_SOFT;
 
   set_solver_modes (solvers, matching, resolver);
 
@@ -199,6 +374,11 @@ build_solver (int width, int radius, Grid grid, MatchMode matching,
 
   next_grid = grid == GRID_BOTH ? box + n_grid : NULL;
 
+  solvers->heads[solvers->n_heads++] = box;
+
+  if (next_grid)
+    solvers->heads[solvers->n_heads++] = next_grid;
+
   if (grid == GRID_ODD || grid == GRID_BOTH)
     box = make_boxes (box, next_grid, width, radius, field_matching, true);
 
@@ -209,42 +389,584 @@ build_solver (int width, int radius, Grid grid, MatchMode matching,
 
   box->skip_to = NULL;
 
+  add_head_corners (solvers);
+
   return solvers;
 }
 
+/**
+ * Grow the buffer at `buffer` holding `capacity` to at least `size` bytes.
+ * The contents are not kept.
+ */
+static void *
+reserve_buffer (void *buffer, size_t *capacity, size_t size)
+{
+  if (size <= *capacity)
+    return buffer;
+
+  free (buffer);
+  *capacity = size;
+
+  return malloc (size);
+}
+
+static void
+reserve_ring_index (RingIndex *index, int width, int height)
+{
+  int blocks_across = (width + RING_BLOCK - 1) / RING_BLOCK;
+  int blocks_down = (height + RING_BLOCK - 1) / RING_BLOCK;
+
+  index->row_positive = (unsigned char *)reserve_buffer (
+      index->row_positive, &index->row_capacity,
+      (size_t)blocks_across * height * 2);
+  index->column_positive = (unsigned char *)reserve_buffer (
+      index->column_positive, &index->column_capacity,
+      (size_t)blocks_down * width * 2);
+}
+
+static RingIndex *
+build_ring_index (RingIndex *index, Solvers const *solvers, int width,
+                  int height)
+{
+  if (!solvers->field_matching || solvers->radius < RING_INDEX_RADIUS)
+    return NULL;
+
+  index->width = width;
+  index->height = height;
+  index->blocks_across = (width + RING_BLOCK - 1) / RING_BLOCK;
+  index->blocks_down = (height + RING_BLOCK - 1) / RING_BLOCK;
+  index->counted = false;
+
+  return index;
+}
+
+/**
+ * Count the signs of `data` when the first large ring is reached: most
+ * pixels never get past the small rings and then the index costs nothing
+ */
+static void
+count_signs (RingIndex *index, int const *data)
+{
+  size_t row_size = (size_t)index->blocks_across * index->height;
+  size_t column_size = (size_t)index->blocks_down * index->width;
+  int width = index->width;
+  int value;
+
+  reserve_ring_index (index, index->width, index->height);
+
+  memset (index->row_positive, 0, row_size * 2);
+  index->row_negative = index->row_positive + row_size;
+  memset (index->column_positive, 0, column_size * 2);
+  index->column_negative = index->column_positive + column_size;
+  index->counted = true;
+
+  for (int y = 0; y < index->height; ++y)
+    for (int x = 0; x < width; ++x)
+      {
+        value = data[(size_t)y * width + x];
+
+        if (value > 0)
+          {
+            ++index->row_positive[y * index->blocks_across + x / RING_BLOCK];
+            ++index->column_positive[x * index->blocks_down + y / RING_BLOCK];
+          }
+        else if (value < 0)
+          {
+            ++index->row_negative[y * index->blocks_across + x / RING_BLOCK];
+            ++index->column_negative[x * index->blocks_down + y / RING_BLOCK];
+          }
+      }
+}
+
+static inline void
+set_sign (SolverIndex *index, int position, int value)
+{
+  uint64_t bit = (uint64_t)1 << (position % SIGN_WORD);
+  size_t word = position / SIGN_WORD;
+
+  index->positive[word] &= ~bit;
+  index->negative[word] &= ~bit;
+
+  if (value > 0)
+    index->positive[word] |= bit;
+  else if (value < 0)
+    index->negative[word] |= bit;
+}
+
+/**
+ * A word of positions may reach past the last one, and the bits are read
+ * two words at a time
+ */
+static size_t
+sign_words (int width, int height)
+{
+  return ((size_t)width * height + SIGN_WORD - 1) / SIGN_WORD + 2;
+}
+
+static void
+reserve_signs (SolverIndex *index, size_t words)
+{
+  if (words <= index->words)
+    return;
+
+  free (index->positive);
+  index->positive = (uint64_t *)malloc (words * 2 * sizeof (uint64_t));
+  index->words = words;
+}
+
+static void
+reserve_hits (SolverIndex *index, int n_boxes)
+{
+  if (n_boxes <= index->boxes)
+    return;
+
+  free (index->probes);
+  free (index->pruned);
+  index->probes = (unsigned *)malloc (n_boxes * 2 * sizeof (unsigned));
+  index->pruned = (bool *)malloc (n_boxes * sizeof (bool));
+  index->boxes = n_boxes;
+}
+
+void
+reserve_solver_index (PSolverIndex solver_index, PSolver solver, int width,
+                      int height)
+{
+  SolverIndex *index = (SolverIndex *)solver_index;
+  Solvers const *solvers = (Solvers *)solver;
+  size_t words = sign_words (width, height);
+
+  reserve_signs (index, words);
+
+  if (build_ring_index (&index->ring_counts, solvers, width, height))
+    reserve_ring_index (&index->ring_counts, width, height);
+
+  reserve_hits (index, solvers->n_boxes);
+}
+
+void
+rebuild_solver_index (PSolverIndex solver_index, PSolver solver,
+                      int const *data, int width, int height)
+{
+  SolverIndex *index = (SolverIndex *)solver_index;
+  size_t size = (size_t)width * height;
+  size_t words = sign_words (width, height);
+
+  reserve_signs (index, words);
+
+  index->solvers = (Solvers *)solver;
+  index->negative = index->positive + words;
+  memset (index->positive, 0, words * 2 * sizeof (uint64_t));
+  index->rings = build_ring_index (&index->ring_counts, index->solvers, width,
+                                   height);
+  index->tracking = false;
+  index->frozen = NULL;
+  index->budget = 0;
+
+  for (size_t position = 0; position < size; ++position)
+    set_sign (index, position, data[position]);
+}
+
+PSolverIndex
+new_solver_index (void)
+{
+  return calloc (1, sizeof (SolverIndex));
+}
+
+PSolverIndex
+build_solver_index (PSolver solver, int const *data, int width, int height)
+{
+  PSolverIndex index = new_solver_index ();
+
+  rebuild_solver_index (index, solver, data, width, height);
+
+  return index;
+}
+
+void
+clean_solver_index (PSolverIndex solver_index)
+{
+  SolverIndex *index = (SolverIndex *)solver_index;
+
+  if (index == NULL)
+    return;
+
+  free (index->ring_counts.row_positive);
+  free (index->ring_counts.column_positive);
+  free (index->positive);
+  free (index->probes);
+  free (index->pruned);
+  free (index);
+}
+
+void
+track_solver_hits (PSolverIndex solver_index)
+{
+  SolverIndex *index = (SolverIndex *)solver_index;
+  int n_boxes = index->solvers->n_boxes;
+
+  if (index->tracking)
+    return;
+
+  reserve_hits (index, n_boxes);
+  index->hits = index->probes + n_boxes;
+  memset (index->probes, 0, n_boxes * 2 * sizeof (unsigned));
+  memset (index->pruned, 0, n_boxes * sizeof (bool));
+  index->tracking = true;
+}
+
+void
+freeze_solver_samples (PSolverIndex solver_index, unsigned char const *frozen)
+{
+  ((SolverIndex *)solver_index)->frozen = frozen;
+}
+
+void
+limit_solver_probes (PSolverIndex solver_index, int probes)
+{
+  ((SolverIndex *)solver_index)->budget = probes;
+}
+
+static bool
+is_head (Solvers const *solvers, PBox box)
+{
+  for (int head = 0; head < solvers->n_heads; ++head)
+    if (solvers->heads[head] == box)
+      return true;
+
+  return false;
+}
+
 int
-apply_solver (PSolver solver, int *const data, int position)
+prune_solver_index (PSolverIndex solver_index, double threshold)
+{
+  SolverIndex *index = (SolverIndex *)solver_index;
+  Solvers const *solvers = index->solvers;
+  PBox box;
+  int result = 0;
+
+  for (int number = 0; number < solvers->n_boxes; ++number)
+    {
+      box = (PBox)&solvers->boxes[number];
+
+      if (!index->pruned[number] && !is_head (solvers, box)
+          && index->probes[number] >= PRUNE_MIN_PROBES
+          && index->hits[number] < threshold * index->probes[number])
+        {
+          index->pruned[number] = true;
+          ++result;
+        }
+    }
+
+  memset (index->probes, 0, sizeof (unsigned) * solvers->n_boxes * 2);
+
+  return result;
+}
+
+static inline int
+sign_of (int value)
+{
+  return (value > 0) - (value < 0);
+}
+
+/**
+ * Move the diff at `position` from the counts of its old sign to those of
+ * its new one
+ */
+static void
+update_index (RingIndex *index, int position, int old_value, int new_value)
+{
+  int old_sign = sign_of (old_value);
+  int new_sign = sign_of (new_value);
+  int x;
+  int y;
+  int row;
+  int column;
+
+  if (old_sign == new_sign || !index->counted)
+    return;
+
+  x = position % index->width;
+  y = position / index->width;
+  row = y * index->blocks_across + x / RING_BLOCK;
+  column = x * index->blocks_down + y / RING_BLOCK;
+
+  if (old_sign > 0)
+    {
+      --index->row_positive[row];
+      --index->column_positive[column];
+    }
+  else if (old_sign < 0)
+    {
+      --index->row_negative[row];
+      --index->column_negative[column];
+    }
+
+  if (new_sign > 0)
+    {
+      ++index->row_positive[row];
+      ++index->column_positive[column];
+    }
+  else if (new_sign < 0)
+    {
+      ++index->row_negative[row];
+      ++index->column_negative[column];
+    }
+}
+
+/**
+ * Collect the signs of values `first` to `last` of a row or column starting
+ * at `line` with `step` between the values. Whole blocks are taken from the
+ * counts.
+ */
+static void
+scan_line (int const *line, int step, int first, int last,
+           unsigned char const *positive, unsigned char const *negative,
+           Signs *signs)
+{
+  int value;
+  int index = first;
+
+  signs->positive = false;
+  signs->negative = false;
+
+  while (index <= last && !(signs->positive && signs->negative))
+    {
+      if (index % RING_BLOCK == 0 && index + RING_BLOCK - 1 <= last)
+        {
+          signs->positive = signs->positive || positive[index / RING_BLOCK];
+          signs->negative = signs->negative || negative[index / RING_BLOCK];
+          index += RING_BLOCK;
+        }
+      else
+        {
+          value = line[index * step];
+          signs->positive = signs->positive || value > 0;
+          signs->negative = signs->negative || value < 0;
+          ++index;
+        }
+    }
+}
+
+/**
+ * Every box of a ring but the leading one pairs a corner of one segment with
+ * a corner of the opposite one. A match needs a pair of two positive or two
+ * negative diffs and an opposite sign somewhere in the other pair.
+ */
+static bool
+segments_may_match (Signs const *lhs, Signs const *rhs)
+{
+  return (lhs->positive && rhs->positive && (lhs->negative || rhs->negative))
+         || (lhs->negative && rhs->negative
+             && (lhs->positive || rhs->positive));
+}
+
+/**
+ * Whether a box following the leading one of the ring around `position`
+ * may match. The segments cover the corners of the odd and even rings both.
+ */
+static bool
+ring_may_match (RingIndex *index, int const *data, int position,
+                int ring, bool odd)
+{
+  int width = index->width;
+  int x = position % width;
+  int y = position / width;
+  int top = odd ? y + ring : y + ring - 1;
+  int bottom = y - ring;
+  int left = x - ring;
+  int right = odd ? x + ring : x + ring - 1;
+  Signs first;
+  Signs second;
+
+  if (!index->counted)
+    count_signs (index, data);
+
+  scan_line (data + (size_t)top * width, 1, x - ring + 1, x + ring - 1,
+             index->row_positive + top * index->blocks_across,
+             index->row_negative + top * index->blocks_across, &first);
+  scan_line (data + (size_t)bottom * width, 1, x - ring + 1, x + ring - 1,
+             index->row_positive + bottom * index->blocks_across,
+             index->row_negative + bottom * index->blocks_across, &second);
+
+  if (segments_may_match (&first, &second))
+    return true;
+
+  scan_line (data + left, width, y - ring + 1, y + ring - 1,
+             index->column_positive + left * index->blocks_down,
+             index->column_negative + left * index->blocks_down, &first);
+  scan_line (data + right, width, y - ring + 1, y + ring - 1,
+             index->column_positive + right * index->blocks_down,
+             index->column_negative + right * index->blocks_down, &second);
+
+  return segments_may_match (&first, &second);
+}
+
+/**
+ * `SIGN_WORD` bits of a sign bit-plane starting at `position`
+ */
+static inline uint64_t
+signs_at (uint64_t const *plane, int position)
+{
+  size_t word = position / SIGN_WORD;
+  int shift = position % SIGN_WORD;
+
+  if (shift == 0)
+    return plane[word];
+
+  return (plane[word] >> shift) | (plane[word + 1] << (SIGN_WORD - shift));
+}
+
+static inline void
+pack_pair (uint64_t positive_a, uint64_t negative_a, uint64_t positive_b,
+           uint64_t negative_b, PackedPair *pair)
+{
+  pair->positive = positive_a & positive_b;
+  pair->negative = negative_a & negative_b;
+  pair->any_positive = (positive_a | positive_b) & ~(negative_a | negative_b);
+  pair->any_negative = (negative_a | negative_b) & ~(positive_a | positive_b);
+}
+
+/**
+ * Bits of positions starting at `position` where each leading box matches:
+ * the same as `match_strict` or `match_soft` on the signs alone. The corners
+ * of all the grids are loaded before any of them is matched.
+ */
+static void
+match_heads (Solvers const *solvers, SolverIndex const *index, int position,
+             uint64_t *matches)
+{
+  uint64_t positive[8];
+  uint64_t negative[8];
+  int const *corners;
+  PackedPair lhs;
+  PackedPair rhs;
+
+  for (int corner = 0; corner < solvers->n_corners; ++corner)
+    {
+      positive[corner]
+          = signs_at (index->positive, position + solvers->corners[corner]);
+      negative[corner]
+          = signs_at (index->negative, position + solvers->corners[corner]);
+    }
+
+  for (int head = 0; head < solvers->n_heads; ++head)
+    {
+      corners = solvers->head_corners[head];
+      pack_pair (positive[corners[0]], negative[corners[0]],
+                 positive[corners[1]], negative[corners[1]], &lhs);
+      pack_pair (positive[corners[2]], negative[corners[2]],
+                 positive[corners[3]], negative[corners[3]], &rhs);
+
+      if (solvers->soft)
+        matches[head] = (lhs.negative & rhs.any_positive)
+                        | (lhs.any_negative & ~lhs.negative & rhs.positive)
+                        | (lhs.positive & rhs.any_negative)
+                        | (lhs.any_positive & ~lhs.positive & rhs.negative);
+      else
+        matches[head] = (lhs.negative & rhs.positive)
+                        | (lhs.positive & rhs.negative);
+    }
+}
+
+/**
+ * Apply the plan to `position` starting at `box`
+ */
+static int
+solve_position (Solvers *solvers, SolverIndex *index, int *const data,
+                int position, PBox box)
 {
   ArmPosition first;
   ArmPosition second;
   ArmValue first_value;
   ArmValue second_value;
-  PBox box;
+  ArmValue old_first;
+  ArmValue old_second;
   PBox pend;
-  Solvers *solvers;
   int delta;
   int result = 0;
+  int probes = 0;
+  bool skip_ring = false;
 
-  solvers = (Solvers *)solver;
-
-  box = &solvers->boxes[0];
-  pend = box + solvers->n_boxes;
+  pend = &solvers->boxes[solvers->n_boxes];
 
   while (box && box < pend)
     {
+      if (skip_ring && box->in_ring)
+        {
+          box = box->skip_to;
+          continue;
+        }
+
+      /* A dropped box is taken for one that never matches */
+      if (index && index->tracking && index->pruned[box - solvers->boxes])
+        {
+          box = box->skip_to;
+          continue;
+        }
+
       translated_position (&box->first, &first, position);
       translated_position (&box->second, &second, position);
 
+      if (index && index->frozen
+          && (index->frozen[first.a] | index->frozen[first.b]
+              | index->frozen[second.a] | index->frozen[second.b]))
+        {
+          box = box->skip_to;
+          continue;
+        }
+
+      if (index && index->budget && probes++ == index->budget)
+        break;
+
+      if (index && index->tracking)
+        ++index->probes[box - solvers->boxes];
+
       get_values (data, &first, &first_value);
       get_values (data, &second, &second_value);
 
       if (solvers->match (&first_value, &second_value))
         {
+          if (index && index->tracking)
+            ++index->hits[box - solvers->boxes];
+
           delta = solvers->get_delta (&first_value, &second_value);
+          old_first = first_value;
+          old_second = second_value;
 
           apply_delta (data, &first, &first_value, delta);
           apply_delta (data, &second, &second_value, delta);
 
+          if (index)
+            {
+              set_sign (index, first.a, first_value.a);
+              set_sign (index, first.b, first_value.b);
+              set_sign (index, second.a, second_value.a);
+              set_sign (index, second.b, second_value.b);
+            }
+
+          if (index && index->rings)
+            {
+              update_index (index->rings, first.a, old_first.a,
+                            first_value.a);
+              update_index (index->rings, first.b, old_first.b,
+                            first_value.b);
+              update_index (index->rings, second.a, old_second.a,
+                            second_value.a);
+              update_index (index->rings, second.b, old_second.b,
+                            second_value.b);
+            }
+
+          /*
+             A compensation inside the ring may create a match the check has
+             not seen: only a fresh check after the leading box rejects
+          */
+          if (box->in_ring)
+            skip_ring = false;
+          else
+            skip_ring = index && index->rings && box->ring
+                        && !ring_may_match (index->rings, data, position,
+                                            box->ring, box->odd);
+
           ++box;
           ++result;
         }
@@ -256,3 +978,96 @@ apply_solver (PSolver solver, int *const data, int position)
 
   return result;
 }
+
+int
+apply_solver (PSolver solver, int *const data, int position)
+{
+  Solvers *solvers = (Solvers *)solver;
+
+  return solve_position (solvers, NULL, data, position, solvers->boxes);
+}
+
+int
+apply_solver_row (PSolver solver, int *const data, int position, int width,
+                  int radius)
+{
+  return apply_indexed_solver_row (solver, NULL, data, position, width,
+                                   radius);
+}
+
+int
+apply_indexed_solver_row (PSolver solver, PSolverIndex solver_index,
+                          int *const data, int position, int width, int radius)
+{
+  return apply_indexed_solver_span (solver, solver_index, data,
+                                    position + radius + 1,
+                                    position + width - radius, false);
+}
+
+int
+apply_indexed_solver_span (PSolver solver, PSolverIndex solver_index,
+                           int *const data, int first, int last, bool reverse)
+{
+  Solvers *solvers = (Solvers *)solver;
+  SolverIndex *index = (SolverIndex *)solver_index;
+  int words = (last - first + SIGN_WORD - 1) / SIGN_WORD;
+  int position;
+  int count;
+  int bit;
+  int solved;
+  uint64_t valid;
+  uint64_t matches[2] = { 0, 0 };
+  uint64_t candidates;
+  PBox start;
+  int result = 0;
+
+  if (index == NULL)
+    {
+      for (int step = 0; step < last - first; ++step)
+        result += solve_position (solvers, NULL, data,
+                                  reverse ? last - 1 - step : first + step,
+                                  solvers->boxes);
+
+      return result;
+    }
+
+  for (int word = 0; word < words; ++word)
+    {
+      position = first + (reverse ? words - 1 - word : word) * SIGN_WORD;
+      count = last - position < SIGN_WORD ? last - position : SIGN_WORD;
+      valid = count == SIGN_WORD ? ~(uint64_t)0
+                                 : ((uint64_t)1 << count) - 1;
+      match_heads (solvers, index, position, matches);
+      candidates = (matches[0] | matches[1]) & valid;
+
+      while (candidates)
+        {
+          bit = reverse ? SIGN_WORD - 1 - __builtin_clzll (candidates)
+                        : __builtin_ctzll (candidates);
+
+          /* Where the odd grid cannot match its leading box is not probed
+             again: the even one is the first to change the diffs */
+          start = (matches[0] >> bit) & 1 ? solvers->heads[0]
+                                          : solvers->heads[1];
+          solved = solve_position (solvers, index, data, position + bit,
+                                   start);
+
+          /* The compensations may have changed the signs the rest of the
+             candidates were taken from */
+          if (solved)
+            {
+              result += solved;
+              match_heads (solvers, index, position, matches);
+              candidates = (matches[0] | matches[1]) & valid
+                           & (reverse ? ((uint64_t)1 << bit) - 1
+                                      : ~(uint64_t)1 << bit);
+            }
+          else
+            {
+              candidates &= ~((uint64_t)1 << bit);
+            }
+        }
+    }
+
+  return result;
+}
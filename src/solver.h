@@ -79,4 +79,89 @@ void clean_solver (PSolver solver);
 
 int apply_solver (PSolver solver, int *const data, int position);
 
+/**
+ * Apply solver to every pixel of the row starting at `position` which is far
+ * enough from the borders. Returns the amount of compensations
+ */
+int apply_solver_row (PSolver solver, int *const data, int position,
+                      int width, int radius);
+
+/**
+ * Sign summary of a twofold diff: the positions where no grid can match are
+ * skipped without reading the diffs, and large field matching rings are
+ * rejected without probing their boxes one by one
+ */
+typedef void *PSolverIndex;
+
+/**
+ * Empty index to be built by `rebuild_solver_index`
+ */
+PSolverIndex new_solver_index (void);
+
+/**
+ * Index the diff of `width` x `height` in `data` for `solver`
+ */
+PSolverIndex build_solver_index (PSolver solver, int const *data, int width,
+                                 int height);
+
+/**
+ * Index the diff in `data` for `solver` again reusing the memory of `index`,
+ * as though built anew: no hits are tracked, no samples frozen and no
+ * probes limited. Allocates only when the diff is larger than any indexed
+ * or reserved before.
+ */
+void rebuild_solver_index (PSolverIndex index, PSolver solver,
+                           int const *data, int width, int height);
+
+/**
+ * Make room in `index` for a diff of `width` x `height` indexed for
+ * `solver` with its hits tracked, so that rebuilding it allocates nothing
+ */
+void reserve_solver_index (PSolverIndex index, PSolver solver, int width,
+                           int height);
+
+void clean_solver_index (PSolverIndex index);
+
+/**
+ * Count probes and compensations of every box of the plan from now on, so
+ * that it may be pruned
+ */
+void track_solver_hits (PSolverIndex index);
+
+/**
+ * Drop the boxes compensating less than `threshold` of their probes since
+ * the last call from the plan as seen through `index`. The leading boxes of
+ * the grids are kept. Returns the amount of boxes dropped.
+ */
+int prune_solver_index (PSolverIndex index, double threshold);
+
+/**
+ * Leave the diff samples nonzero in `frozen` (one per sample, may be NULL)
+ * unchanged: the boxes touching them are taken for boxes that never match.
+ * The map is owned by the caller and may change between the rows.
+ */
+void freeze_solver_samples (PSolverIndex index, unsigned char const *frozen);
+
+/**
+ * Probe at most `probes` boxes of the plan at every position, 0 for no
+ * limit. Boxes skipped without reading the diffs do not count.
+ */
+void limit_solver_probes (PSolverIndex index, int probes);
+
+/**
+ * Same as `apply_solver_row` keeping `index` (may be NULL) up to date. The
+ * result is the same.
+ */
+int apply_indexed_solver_row (PSolver solver, PSolverIndex index,
+                              int *const data, int position, int width,
+                              int radius);
+
+/**
+ * Same as `apply_indexed_solver_row` for the positions from `first` up to
+ * `last` exclusive, visited from the last one down if `reverse`
+ */
+int apply_indexed_solver_span (PSolver solver, PSolverIndex index,
+                               int *const data, int first, int last,
+                               bool reverse);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,242 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+
+#include "diff.h"
+#include "solver.h"
+#include "step.h"
+
+/**
+ * Passes in the order `perlovka_denoize` makes them. The diffs are split by
+ * rows so that every row still reads the values the whole-array pass would:
+ * passes reading the row above go bottom-up, those reading the row below or
+ * the previous sample go top-down.
+ */
+typedef enum
+{
+  STEP_DIFF_HORIZONTAL,
+  STEP_DIFF_VERTICAL,
+  STEP_SOLVE,
+  STEP_UNDIFF_VERTICAL,
+  STEP_UNDIFF_HORIZONTAL,
+  STEP_DONE
+} StepPass;
+
+typedef struct
+{
+  PerlovkaOptions *options;
+  PSolver solver;
+  StepPass pass;
+
+  /**
+   * Rows of the current pass (or iteration) done
+   */
+  size_t row;
+
+  /**
+   * Compensations of the current iteration
+   */
+  int solved;
+
+  /**
+   * Rows done over all passes
+   */
+  size_t rows_done;
+} Stepper;
+
+PStepper
+perlovka_step_new (PerlovkaOptions *options)
+{
+  Stepper *stepper;
+
+  if (!perlovka_solve_rowwise (options))
+    return NULL;
+
+  stepper = (Stepper *)calloc (1, sizeof (Stepper));
+  stepper->options = options;
+  stepper->solver = build_solver (options->width, options->radius,
+                                  options->grid, options->matching,
+                                  options->resolver, options->field_matching);
+
+  options->iterations_made = 0;
+  options->resolved = 0;
+  options->converged = false;
+
+  return stepper;
+}
+
+static size_t
+solve_rows (PerlovkaOptions const *options)
+{
+  int max_height = (int)options->height - options->radius - 1;
+
+  return max_height > options->radius ? max_height - options->radius : 0;
+}
+
+/**
+ * Process one row of a diff pass
+ */
+static void
+diff_row (Stepper *stepper)
+{
+  PerlovkaOptions *options = stepper->options;
+  size_t width = options->width;
+  size_t height = options->height;
+  size_t y;
+
+  switch (stepper->pass)
+    {
+    case STEP_DIFF_HORIZONTAL:
+      y = height - 1 - stepper->row;
+
+      if (y == 0)
+        diff_horizontal (options->data, width);
+      else
+        diff_horizontal (options->data + y * width - 1, width + 1);
+      break;
+
+    case STEP_DIFF_VERTICAL:
+      y = stepper->row;
+
+      if (y + 1 < height)
+        diff_vertical (options->data + y * width, 2 * width, width);
+      break;
+
+    case STEP_UNDIFF_VERTICAL:
+      y = height - 1 - stepper->row;
+
+      if (y + 1 < height)
+        undiff_vertical (options->data + y * width, 2 * width, width);
+      break;
+
+    case STEP_UNDIFF_HORIZONTAL:
+      y = stepper->row;
+
+      if (y == 0)
+        undiff_horizontal (options->data, width);
+      else
+        undiff_horizontal (options->data + y * width - 1, width + 1);
+      break;
+
+    default:
+      break;
+    }
+}
+
+/**
+ * Close the current iteration as `perlovka_solve_plan` does. Returns true if
+ * no further iteration follows.
+ */
+static bool
+finish_iteration (Stepper *stepper)
+{
+  PerlovkaOptions *options = stepper->options;
+
+  options->resolved += stepper->solved;
+  ++options->iterations_made;
+
+  if (options->progress)
+    options->progress (options->context);
+
+  if (options->iterations_made < options->iterations && stepper->solved > 0)
+    {
+      stepper->row = 0;
+      stepper->solved = 0;
+      return false;
+    }
+
+  options->converged = stepper->solved == 0;
+
+  return true;
+}
+
+bool
+perlovka_step (PStepper handle, size_t budget_rows)
+{
+  Stepper *stepper = (Stepper *)handle;
+  PerlovkaOptions *options = stepper->options;
+  size_t rows = solve_rows (options);
+  bool next;
+
+  if (budget_rows == 0)
+    budget_rows = 1;
+
+  while (stepper->pass != STEP_DONE && budget_rows > 0)
+    {
+      if (stepper->pass == STEP_SOLVE)
+        {
+          if (options->iterations_made >= options->iterations)
+            next = true;
+          else if (stepper->row < rows)
+            {
+              stepper->solved += apply_solver_row (
+                  stepper->solver, options->data,
+                  (options->radius + stepper->row) * options->width,
+                  options->width, options->radius);
+              ++stepper->row;
+              ++stepper->rows_done;
+              --budget_rows;
+              continue;
+            }
+          else
+            next = finish_iteration (stepper);
+        }
+      else
+        {
+          diff_row (stepper);
+          ++stepper->row;
+          ++stepper->rows_done;
+          --budget_rows;
+          next = stepper->row == options->height;
+        }
+
+      if (next)
+        {
+          ++stepper->pass;
+          stepper->row = 0;
+          stepper->solved = 0;
+        }
+    }
+
+  return stepper->pass == STEP_DONE;
+}
+
+double
+perlovka_step_fraction (PStepper handle)
+{
+  Stepper *stepper = (Stepper *)handle;
+  PerlovkaOptions const *options = stepper->options;
+  size_t total = 4 * options->height
+                 + solve_rows (options)
+                       * (options->iterations > 0 ? options->iterations : 0);
+
+  if (stepper->pass == STEP_DONE || total == 0)
+    return 1.0;
+
+  return stepper->rows_done < total ? (double)stepper->rows_done / total
+                                    : 1.0;
+}
+
+void
+perlovka_step_free (PStepper handle)
+{
+  Stepper *stepper = (Stepper *)handle;
+
+  clean_solver (stepper->solver);
+  free (stepper);
+}
@@ -0,0 +1,54 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef STEP_H
+#define STEP_H
+
+#include "perlovka.h"
+
+/**
+ * Cooperative denoizer for hosts that cannot block or start threads: each
+ * call does a bounded amount of rows of the diff, solve and undiff passes
+ * and returns. The result is identical to `perlovka_denoize` for the options
+ * it accepts.
+ */
+typedef void *PStepper;
+
+/**
+ * Prepare denoizing of `options->data` in place. `options` must stay valid
+ * until the stepper is freed: `iterations_made`, `resolved` and `converged`
+ * are updated after each iteration and the progress callback is called as
+ * `perlovka_denoize` does. The cancellation callback is not used. Returns
+ * NULL unless the options are solved row by row (see
+ * `perlovka_solve_rowwise`).
+ */
+PStepper perlovka_step_new (PerlovkaOptions *options);
+
+/**
+ * Advance by at most `budget_rows` rows (at least one) of any pass. Returns
+ * true once the data holds the denoized image.
+ */
+bool perlovka_step (PStepper stepper, size_t budget_rows);
+
+/**
+ * Share of the work done in [0, 1], assuming all iterations are needed
+ */
+double perlovka_step_fraction (PStepper stepper);
+
+void perlovka_step_free (PStepper stepper);
+
+#endif
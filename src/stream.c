@@ -0,0 +1,355 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "solver.h"
+#include "stream.h"
+
+/*
+   Iteration `k` at center row `c` reads and writes rows `c - radius` to
+   `c + radius` only. Thus it commutes with iteration `k - 1` at any center
+   below `c + 2 * radius`, and the iterations run as a wavefront: each one
+   follows the previous at `2 * radius` rows distance.
+
+   Iterations after the one which has found nothing do not change the data, so
+   the stream runs all of them and the result matches the whole image run.
+
+   Compensations never change the horizontal diff of the first row, so the
+   vertical undiff may go top down from it instead of bottom up.
+*/
+
+typedef struct
+{
+  PSolver solver;
+  int width;
+  int radius;
+  int passes;
+
+  /**
+   * Rows [base, pushed) of the twofold diff, the last one is still
+   * the horizontal diff only
+   */
+  int *window;
+  long capacity;
+  long base;
+  long pushed;
+  bool finished;
+
+  /**
+   * Last pixel of the last pushed row
+   */
+  int last_pixel;
+
+  /**
+   * Horizontal diff of the last emitted row
+   */
+  int *h_out;
+
+  /**
+   * Last pixel of the last emitted row
+   */
+  int out_pixel;
+
+  long emitted;
+
+  /**
+   * Next center row of each iteration
+   */
+  long *next_center;
+
+  /**
+   * Compensations of each iteration
+   */
+  size_t *solved;
+} Stream;
+
+PStream
+perlovka_stream_new (PerlovkaOptions const *options)
+{
+  Stream *stream;
+
+  if (!perlovka_solve_rowwise (options))
+    return NULL;
+
+  stream = (Stream *)malloc (sizeof (Stream));
+  memset (stream, 0, sizeof (Stream));
+
+  stream->width = options->width;
+  stream->radius = options->radius;
+  stream->passes = options->iterations;
+  stream->capacity
+      = 2 * ((long)2 * options->radius * options->iterations + options->radius
+             + 2);
+  stream->window
+      = (int *)malloc (sizeof (int) * stream->capacity * stream->width);
+  stream->h_out = (int *)malloc (sizeof (int) * stream->width);
+  stream->next_center = (long *)malloc (sizeof (long) * stream->passes);
+  stream->solved = (size_t *)calloc (stream->passes, sizeof (size_t));
+
+  for (int pass = 0; pass < stream->passes; ++pass)
+    stream->next_center[pass] = stream->radius;
+
+  stream->solver = build_solver (options->width, options->radius,
+                                 options->grid, options->matching,
+                                 options->resolver, options->field_matching);
+
+  return stream;
+}
+
+void
+perlovka_stream_free (PStream pstream)
+{
+  Stream *stream = (Stream *)pstream;
+
+  clean_solver (stream->solver);
+  free (stream->window);
+  free (stream->h_out);
+  free (stream->next_center);
+  free (stream->solved);
+  free (stream);
+}
+
+static inline int *
+window_row (Stream *stream, long row)
+{
+  return stream->window + (row - stream->base) * stream->width;
+}
+
+/**
+ * Centers below the limit have all their rows in the twofold diff
+ */
+static long
+centers_limit (Stream *stream)
+{
+  long limit = stream->pushed - stream->radius - 1;
+
+  return limit > stream->radius ? limit : stream->radius;
+}
+
+static bool
+pass_complete (Stream *stream, int pass)
+{
+  return stream->finished
+         && stream->next_center[pass] >= centers_limit (stream);
+}
+
+/**
+ * Amount of twofold diff rows no iteration is going to change
+ */
+static long
+final_rows (Stream *stream)
+{
+  long rows;
+
+  if (stream->passes == 0 || pass_complete (stream, stream->passes - 1))
+    return stream->finished ? stream->pushed : stream->pushed - 1;
+
+  rows = stream->next_center[stream->passes - 1] - stream->radius;
+
+  return rows < stream->pushed - 1 ? rows : stream->pushed - 1;
+}
+
+static void
+advance (Stream *stream)
+{
+  long limit0 = centers_limit (stream);
+  long limit;
+  long previous;
+
+  for (int pass = 0; pass < stream->passes; ++pass)
+    {
+      limit = limit0;
+
+      if (pass > 0 && !pass_complete (stream, pass - 1))
+        {
+          previous = stream->next_center[pass - 1] - 2 * stream->radius;
+          limit = previous < limit0 ? previous : limit0;
+        }
+
+      while (stream->next_center[pass] < limit)
+        {
+          stream->solved[pass] += apply_solver_row (
+              stream->solver, stream->window,
+              (stream->next_center[pass] - stream->base) * stream->width,
+              stream->width, stream->radius);
+          ++stream->next_center[pass];
+        }
+    }
+}
+
+/**
+ * Make room for one more row dropping the emitted ones
+ */
+static void
+reserve_row (Stream *stream)
+{
+  long keep = stream->emitted > 0 ? stream->emitted - 1 : 0;
+  long shift = keep - stream->base;
+
+  if (stream->pushed - stream->base < stream->capacity)
+    return;
+
+  if (shift > 0)
+    {
+      memmove (stream->window, window_row (stream, keep),
+               sizeof (int) * (stream->pushed - keep) * stream->width);
+      stream->base = keep;
+    }
+
+  if (stream->pushed - stream->base >= stream->capacity)
+    {
+      stream->capacity *= 2;
+      stream->window = (int *)realloc (
+          stream->window, sizeof (int) * stream->capacity * stream->width);
+    }
+}
+
+void
+perlovka_stream_push (PStream pstream, int const *row)
+{
+  Stream *stream = (Stream *)pstream;
+  int *target;
+  int *previous;
+  int pixel = stream->pushed > 0 ? stream->last_pixel : 0;
+  int value;
+  int x;
+
+  reserve_row (stream);
+
+  target = window_row (stream, stream->pushed);
+
+  for (x = 0; x < stream->width; ++x)
+    {
+      value = row[x];
+      target[x] = value - pixel;
+      pixel = value;
+    }
+
+  stream->last_pixel = pixel;
+
+  if (stream->pushed == 0)
+    {
+      memcpy (stream->h_out, target, sizeof (int) * stream->width);
+    }
+  else
+    {
+      previous = window_row (stream, stream->pushed - 1);
+
+      for (x = 0; x < stream->width; ++x)
+        previous[x] -= target[x];
+    }
+
+  ++stream->pushed;
+
+  advance (stream);
+}
+
+void
+perlovka_stream_finish (PStream pstream)
+{
+  Stream *stream = (Stream *)pstream;
+
+  stream->finished = true;
+
+  advance (stream);
+}
+
+size_t
+perlovka_stream_ready (PStream pstream)
+{
+  Stream *stream = (Stream *)pstream;
+  long ready = final_rows (stream) + 1;
+
+  if (ready > stream->pushed)
+    ready = stream->pushed;
+
+  return ready > stream->emitted ? ready - stream->emitted : 0;
+}
+
+bool
+perlovka_stream_pull (PStream pstream, int *row)
+{
+  Stream *stream = (Stream *)pstream;
+  int const *twofold;
+  int pixel;
+  int x;
+
+  if (perlovka_stream_ready (pstream) == 0)
+    return false;
+
+  if (stream->emitted > 0)
+    {
+      twofold = window_row (stream, stream->emitted - 1);
+
+      for (x = 0; x < stream->width; ++x)
+        stream->h_out[x] -= twofold[x];
+    }
+
+  pixel = stream->emitted > 0 ? stream->out_pixel : 0;
+
+  for (x = 0; x < stream->width; ++x)
+    {
+      pixel += stream->h_out[x];
+      row[x] = pixel;
+    }
+
+  stream->out_pixel = pixel;
+  ++stream->emitted;
+
+  return true;
+}
+
+void
+perlovka_stream_stats (PStream pstream, PerlovkaOptions *options)
+{
+  Stream *stream = (Stream *)pstream;
+  int pass;
+
+  options->resolved = 0;
+  options->converged = false;
+
+  for (pass = 0; pass < stream->passes; ++pass)
+    {
+      options->resolved += stream->solved[pass];
+
+      if (stream->solved[pass] == 0)
+        {
+          options->converged = true;
+          ++pass;
+          break;
+        }
+    }
+
+  options->iterations_made = pass;
+}
+
+void
+perlovka_clamp_row (int *row, size_t width, int low, int high)
+{
+  int *pend = row + width;
+
+  while (row < pend)
+    {
+      if (*row < low)
+        *row = low;
+      else if (*row > high)
+        *row = high;
+      ++row;
+    }
+}
@@ -0,0 +1,76 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "perlovka.h"
+
+/**
+ * Row-streaming denoizer: input rows are pushed one by one and finished rows
+ * are pulled as soon as no further compensation can change them. Only a
+ * window of about `2 * radius * iterations` rows of the twofold diff is kept.
+ * The output is identical to `perlovka_denoize` over the whole image for the
+ * options it accepts.
+ */
+typedef void *PStream;
+
+/**
+ * Create a stream for rows of `options->width` samples with the settings of
+ * `options`. The height, data and callbacks of `options` are not used.
+ * Returns NULL unless the options are solved row by row (see
+ * `perlovka_solve_rowwise`).
+ */
+PStream perlovka_stream_new (PerlovkaOptions const *options);
+
+/**
+ * Push the next input row of `width` samples
+ */
+void perlovka_stream_push (PStream stream, int const *row);
+
+/**
+ * Mark the end of input: the remaining rows become available for pulling
+ */
+void perlovka_stream_finish (PStream stream);
+
+/**
+ * Amount of finished rows ready to be pulled
+ */
+size_t perlovka_stream_ready (PStream stream);
+
+/**
+ * Copy the next finished row to `row`. Returns false if there is none yet.
+ * Pulled rows are dropped from the window, so memory stays bounded only if
+ * rows are pulled while pushing.
+ */
+bool perlovka_stream_pull (PStream stream, int *row);
+
+/**
+ * Fill `iterations_made`, `resolved` and `converged` of `options` as
+ * `perlovka_denoize` would. Meaningful after the stream has been finished.
+ */
+void perlovka_stream_stats (PStream stream, PerlovkaOptions *options);
+
+void perlovka_stream_free (PStream stream);
+
+/**
+ * Streaming replacement for the whole-image normalization: bring the row
+ * values into [low, high]
+ */
+void perlovka_clamp_row (int *row, size_t width, int low, int high);
+
+#endif
@@ -0,0 +1,252 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sweep.h"
+
+/**
+ * Work shared by the sweep threads
+ */
+typedef struct
+{
+  PerlovkaSweepConfig const *configs;
+  int n_configs;
+
+  /**
+   * Twofold diffs of the planes, read only
+   */
+  int **diffs;
+  int n_planes;
+  size_t width;
+  size_t height;
+
+  PerlovkaSweepEmit emit;
+  void *context;
+
+  pthread_mutex_t lock;
+
+  /**
+   * Next configuration to take
+   */
+  int next;
+} SweepWork;
+
+/**
+ * Run configuration `number` from the shared diffs, emitting its snapshots.
+ * `diffs` and `results` hold a plane each for the thread.
+ */
+static void
+sweep_config (SweepWork *work, int number, int **diffs, int **results)
+{
+  PerlovkaSweepConfig const *config = &work->configs[number];
+  PerlovkaOptions planes[PERLOVKA_SWEEP_PLANES];
+  PerlovkaOptions stats;
+  PerlovkaOptions undiff;
+  PSolver solver;
+  size_t size = work->width * work->height;
+  int plane;
+
+  stats = config->options;
+  stats.width = work->width;
+  stats.height = work->height;
+
+  solver = build_solver (stats.width, stats.radius, stats.grid,
+                         stats.matching, stats.resolver,
+                         stats.field_matching);
+
+  for (plane = 0; plane < work->n_planes; ++plane)
+    {
+      memcpy (diffs[plane], work->diffs[plane], sizeof (int) * size);
+      planes[plane] = stats;
+      planes[plane].data = diffs[plane];
+      planes[plane].iterations_made = 0;
+      planes[plane].resolved = 0;
+      planes[plane].converged = false;
+      planes[plane].pruned = 0;
+      planes[plane].gain = 0;
+      planes[plane].frozen = 0;
+    }
+
+  for (int snapshot = 0; snapshot < config->n_snapshots; ++snapshot)
+    {
+      stats.iterations_made = 0;
+      stats.resolved = 0;
+      stats.converged = true;
+      stats.pruned = 0;
+      stats.stopped = PERLOVKA_STOP_CONVERGED;
+      stats.frozen = 0;
+
+      for (plane = 0; plane < work->n_planes; ++plane)
+        {
+          /* Each snapshot continues the run of the previous one */
+          planes[plane].iterations = config->snapshots[snapshot];
+          perlovka_solve_plan (&planes[plane], solver);
+
+          if (planes[plane].iterations_made > stats.iterations_made)
+            stats.iterations_made = planes[plane].iterations_made;
+
+          stats.resolved += planes[plane].resolved;
+          stats.converged = stats.converged && planes[plane].converged;
+          stats.pruned += planes[plane].pruned;
+          stats.frozen += planes[plane].frozen;
+
+          if (planes[plane].stopped > stats.stopped)
+            stats.stopped = planes[plane].stopped;
+
+          undiff = planes[plane];
+          undiff.data = results[plane];
+          memcpy (results[plane], diffs[plane], sizeof (int) * size);
+          perlovka_undiff (&undiff);
+        }
+
+      stats.iterations = config->snapshots[snapshot];
+      work->emit (work->context, number, snapshot, results, &stats);
+    }
+
+  clean_solver (solver);
+}
+
+static void *
+sweep_thread (void *arg)
+{
+  SweepWork *work = (SweepWork *)arg;
+  size_t size = work->width * work->height;
+  int *diffs[PERLOVKA_SWEEP_PLANES];
+  int *results[PERLOVKA_SWEEP_PLANES];
+  int number;
+  int plane;
+
+  for (plane = 0; plane < work->n_planes; ++plane)
+    {
+      diffs[plane] = (int *)malloc (sizeof (int) * size);
+      results[plane] = (int *)malloc (sizeof (int) * size);
+    }
+
+  for (;;)
+    {
+      pthread_mutex_lock (&work->lock);
+      number = work->next++;
+      pthread_mutex_unlock (&work->lock);
+
+      if (number >= work->n_configs)
+        break;
+
+      sweep_config (work, number, diffs, results);
+    }
+
+  for (plane = 0; plane < work->n_planes; ++plane)
+    {
+      free (diffs[plane]);
+      free (results[plane]);
+    }
+
+  return NULL;
+}
+
+/**
+ * Whether the snapshots of `config` can be taken one after another
+ */
+static bool
+valid_snapshots (PerlovkaSweepConfig const *config)
+{
+  if (config->n_snapshots < 1
+      || config->n_snapshots > PERLOVKA_SWEEP_SNAPSHOTS
+      || config->snapshots[0] < 1)
+    return false;
+
+  for (int snapshot = 1; snapshot < config->n_snapshots; ++snapshot)
+    {
+      if (config->snapshots[snapshot] <= config->snapshots[snapshot - 1])
+        return false;
+    }
+
+  return true;
+}
+
+bool
+perlovka_sweep (PerlovkaSweepConfig const *configs, int n_configs,
+                int *const *planes, int n_planes, size_t width,
+                size_t height, int threads, PerlovkaSweepEmit emit,
+                void *context)
+{
+  SweepWork work;
+  PerlovkaOptions options;
+  pthread_t *ids;
+  size_t size = width * height;
+  int plane;
+  int index;
+
+  if (n_configs < 1 || n_planes < 1 || n_planes > PERLOVKA_SWEEP_PLANES)
+    return false;
+
+  for (index = 0; index < n_configs; ++index)
+    {
+      if (!valid_snapshots (&configs[index]))
+        return false;
+    }
+
+  if (threads < 1)
+    threads = 1;
+
+  if (threads > n_configs)
+    threads = n_configs;
+
+  memset (&work, 0, sizeof (work));
+  work.configs = configs;
+  work.n_configs = n_configs;
+  work.n_planes = n_planes;
+  work.width = width;
+  work.height = height;
+  work.emit = emit;
+  work.context = context;
+  work.diffs = (int **)malloc (sizeof (int *) * n_planes);
+  pthread_mutex_init (&work.lock, NULL);
+
+  perlovka_init_options (&options);
+  options.width = width;
+  options.height = height;
+
+  for (plane = 0; plane < n_planes; ++plane)
+    {
+      work.diffs[plane] = (int *)malloc (sizeof (int) * size);
+      memcpy (work.diffs[plane], planes[plane], sizeof (int) * size);
+      options.data = work.diffs[plane];
+      perlovka_diff (&options);
+    }
+
+  ids = (pthread_t *)malloc (sizeof (pthread_t) * threads);
+
+  for (index = 1; index < threads; ++index)
+    pthread_create (&ids[index], NULL, sweep_thread, &work);
+
+  sweep_thread (&work);
+
+  for (index = 1; index < threads; ++index)
+    pthread_join (ids[index], NULL);
+
+  for (plane = 0; plane < n_planes; ++plane)
+    free (work.diffs[plane]);
+
+  free (work.diffs);
+  free (ids);
+  pthread_mutex_destroy (&work.lock);
+
+  return true;
+}
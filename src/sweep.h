@@ -0,0 +1,74 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "perlovka.h"
+
+/**
+ * Most iteration counts one configuration of a sweep is taken at
+ */
+#define PERLOVKA_SWEEP_SNAPSHOTS 8
+
+/**
+ * Most planes swept at once
+ */
+#define PERLOVKA_SWEEP_PLANES 4
+
+/**
+ * Settings of one configuration of a sweep and the iteration counts its
+ * results are taken at, positive and ascending
+ */
+typedef struct
+{
+  PerlovkaOptions options;
+  int n_snapshots;
+  int snapshots[PERLOVKA_SWEEP_SNAPSHOTS];
+} PerlovkaSweepConfig;
+
+/**
+ * Receives the result of `config` after `snapshots[snapshot]` iterations:
+ * `n_planes` planes valid during the call only (the callback may change
+ * them), and `stats` with the iterations made, compensations and
+ * convergence over the planes. Called from the sweep threads, one
+ * configuration at a time per thread.
+ */
+typedef void (*PerlovkaSweepEmit) (void *context, int config, int snapshot,
+                                   int *const *planes,
+                                   PerlovkaOptions const *stats);
+
+/**
+ * Denoize up to `PERLOVKA_SWEEP_PLANES` planes of `width` x `height` samples
+ * with each of `n_configs` configurations. The planes are diffed once and
+ * left intact: every configuration starts from a copy of the twofold diff,
+ * and its snapshots are taken as one run goes on. Configurations are shared
+ * among `threads` threads. The results equal those of `perlovka_denoize`
+ * with the iterations limit of the snapshot, except with `prune_below` or
+ * `min_gain` whose state does not outlive a snapshot.
+ *
+ * `data`, `width`, `height` and `iterations` of the options of the
+ * configurations are ignored. Returns false without emitting anything when
+ * there are no planes or too many, or when the snapshots of a configuration
+ * are not 1 to `PERLOVKA_SWEEP_SNAPSHOTS` positive ascending counts.
+ */
+bool perlovka_sweep (PerlovkaSweepConfig const *configs, int n_configs,
+                     int *const *planes, int n_planes, size_t width,
+                     size_t height, int threads, PerlovkaSweepEmit emit,
+                     void *context);
+
+#endif
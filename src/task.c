@@ -0,0 +1,285 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "solver.h"
+#include "task.h"
+
+struct PerlovkaTask
+{
+  PerlovkaOptions options;
+  int n_planes;
+
+  /**
+   * Per-plane solve state: the row callback of each points to the task
+   */
+  PerlovkaOptions *stats;
+
+  double started;
+  double deadline;
+
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t finished;
+
+  /**
+   * Guarded by `lock`
+   */
+  PerlovkaProgress progress;
+  bool cancel;
+};
+
+static double
+seconds (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Row callback of the solver: count the row and tell whether to stop
+ */
+static bool
+count_row (void *context)
+{
+  PerlovkaTask *task = (PerlovkaTask *)context;
+  bool cancel;
+
+  pthread_mutex_lock (&task->lock);
+  ++task->progress.rows_done;
+  cancel = task->cancel;
+  pthread_mutex_unlock (&task->lock);
+
+  return cancel;
+}
+
+/**
+ * Gather the outcome of the planes into the progress, under the lock
+ */
+static void
+collect_outcome (PerlovkaTask *task)
+{
+  PerlovkaProgress *progress = &task->progress;
+
+  progress->iterations_made = 0;
+  progress->resolved = 0;
+  progress->converged = true;
+
+  for (int plane = 0; plane < task->n_planes; ++plane)
+    {
+      if (task->stats[plane].iterations_made > progress->iterations_made)
+        progress->iterations_made = task->stats[plane].iterations_made;
+
+      progress->resolved += task->stats[plane].resolved;
+      progress->converged
+          = progress->converged && task->stats[plane].converged;
+    }
+
+  progress->seconds = seconds () - task->started;
+}
+
+static void *
+task_thread (void *arg)
+{
+  PerlovkaTask *task = (PerlovkaTask *)arg;
+  PerlovkaTaskState state = PERLOVKA_TASK_DONE;
+  PSolver solver;
+  int limit = task->options.iterations;
+  bool done = task->n_planes == 0 || limit <= 0;
+
+  for (int plane = 0; plane < task->n_planes; ++plane)
+    perlovka_diff (&task->stats[plane]);
+
+  solver = build_solver (task->options.width, task->options.radius,
+                         task->options.grid, task->options.matching,
+                         task->options.resolver,
+                         task->options.field_matching);
+
+  while (!done)
+    {
+      pthread_mutex_lock (&task->lock);
+      ++task->progress.iteration;
+      pthread_mutex_unlock (&task->lock);
+
+      done = true;
+
+      /* One iteration of each plane: a deadline waits for all of them */
+      for (int plane = 0; plane < task->n_planes; ++plane)
+        {
+          PerlovkaOptions *stats = &task->stats[plane];
+
+          if (stats->converged || stats->iterations_made >= limit)
+            continue;
+
+          stats->iterations = stats->iterations_made + 1;
+          perlovka_solve_plan (stats, solver);
+          done = done && (stats->converged || stats->iterations_made >= limit);
+        }
+
+      pthread_mutex_lock (&task->lock);
+      collect_outcome (task);
+
+      if (task->cancel)
+        state = PERLOVKA_TASK_CANCELLED;
+      else if (!done && task->deadline > 0
+               && task->progress.seconds >= task->deadline)
+        state = PERLOVKA_TASK_DEADLINE;
+
+      pthread_mutex_unlock (&task->lock);
+
+      if (state != PERLOVKA_TASK_DONE)
+        break;
+    }
+
+  clean_solver (solver);
+
+  for (int plane = 0; plane < task->n_planes; ++plane)
+    perlovka_undiff (&task->stats[plane]);
+
+  pthread_mutex_lock (&task->lock);
+  collect_outcome (task);
+  task->progress.state = state;
+  pthread_cond_broadcast (&task->finished);
+  pthread_mutex_unlock (&task->lock);
+
+  return NULL;
+}
+
+PerlovkaTask *
+perlovka_task_start (PerlovkaOptions const *options, int *const *planes,
+                     int n_planes, double deadline)
+{
+  PerlovkaTask *task;
+  pthread_condattr_t attributes;
+  int max_height = (int)options->height - options->radius - 1;
+
+  if (!perlovka_solve_resumable (options))
+    return NULL;
+
+  task = (PerlovkaTask *)calloc (1, sizeof (PerlovkaTask));
+  task->options = *options;
+  task->options.progress = NULL;
+  task->options.cancelled = count_row;
+  task->options.context = task;
+  task->options.iterations_made = 0;
+  task->options.resolved = 0;
+  task->options.converged = false;
+
+  task->n_planes = n_planes;
+  task->stats = (PerlovkaOptions *)malloc (
+      sizeof (PerlovkaOptions) * (n_planes > 0 ? n_planes : 1));
+
+  for (int plane = 0; plane < n_planes; ++plane)
+    {
+      task->stats[plane] = task->options;
+      task->stats[plane].data = planes[plane];
+    }
+
+  task->progress.state = PERLOVKA_TASK_RUNNING;
+  task->progress.iterations = options->iterations;
+  task->progress.converged = false;
+  task->progress.rows_per_iteration
+      = max_height > options->radius
+            ? (size_t)(max_height - options->radius) * n_planes
+            : 0;
+
+  task->started = seconds ();
+  task->deadline = deadline;
+
+  /* Timed waits are measured on the monotonic clock */
+  pthread_condattr_init (&attributes);
+  pthread_condattr_setclock (&attributes, CLOCK_MONOTONIC);
+  pthread_cond_init (&task->finished, &attributes);
+  pthread_condattr_destroy (&attributes);
+  pthread_mutex_init (&task->lock, NULL);
+
+  pthread_create (&task->thread, NULL, task_thread, task);
+
+  return task;
+}
+
+void
+perlovka_task_cancel (PerlovkaTask *task)
+{
+  pthread_mutex_lock (&task->lock);
+  task->cancel = true;
+  pthread_mutex_unlock (&task->lock);
+}
+
+PerlovkaTaskState
+perlovka_task_wait (PerlovkaTask *task, double timeout)
+{
+  PerlovkaTaskState state;
+  struct timespec until;
+  double end;
+
+  clock_gettime (CLOCK_MONOTONIC, &until);
+  end = until.tv_sec + until.tv_nsec * 1e-9 + (timeout > 0 ? timeout : 0);
+  until.tv_sec = (time_t)end;
+  until.tv_nsec = (long)((end - until.tv_sec) * 1e9);
+
+  pthread_mutex_lock (&task->lock);
+
+  while (task->progress.state == PERLOVKA_TASK_RUNNING)
+    {
+      if (timeout < 0)
+        pthread_cond_wait (&task->finished, &task->lock);
+      else if (pthread_cond_timedwait (&task->finished, &task->lock, &until)
+               == ETIMEDOUT)
+        break;
+    }
+
+  state = task->progress.state;
+  pthread_mutex_unlock (&task->lock);
+
+  return state;
+}
+
+void
+perlovka_task_progress (PerlovkaTask *task, PerlovkaProgress *progress)
+{
+  pthread_mutex_lock (&task->lock);
+  *progress = task->progress;
+
+  if (progress->state == PERLOVKA_TASK_RUNNING)
+    progress->seconds = seconds () - task->started;
+
+  pthread_mutex_unlock (&task->lock);
+}
+
+void
+perlovka_task_free (PerlovkaTask *task)
+{
+  if (task == NULL)
+    return;
+
+  perlovka_task_cancel (task);
+  pthread_join (task->thread, NULL);
+
+  pthread_mutex_destroy (&task->lock);
+  pthread_cond_destroy (&task->finished);
+  free (task->stats);
+  free (task);
+}
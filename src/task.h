@@ -0,0 +1,113 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef TASK_H
+#define TASK_H
+
+#include "perlovka.h"
+
+/**
+ * Denoizing running in its own thread: the caller may poll its progress,
+ * wait for it with a timeout, cancel it, or let it stop at a deadline
+ */
+typedef struct PerlovkaTask PerlovkaTask;
+
+typedef enum
+{
+  PERLOVKA_TASK_RUNNING,
+
+  /**
+   * All iterations are done or the planes have converged
+   */
+  PERLOVKA_TASK_DONE,
+
+  /**
+   * The deadline has passed: the iteration it fell into was finished and the
+   * planes hold the result so far
+   */
+  PERLOVKA_TASK_DEADLINE,
+
+  /**
+   * Cancelled in the middle of an iteration: the planes hold a partly
+   * denoized image
+   */
+  PERLOVKA_TASK_CANCELLED
+} PerlovkaTaskState;
+
+/**
+ * Snapshot of a task
+ */
+typedef struct
+{
+  PerlovkaTaskState state;
+
+  /**
+   * Iteration in progress counted from 1 (0 while diffing) and the limit
+   */
+  int iteration;
+  int iterations;
+
+  /**
+   * Rows solved so far over all planes and iterations, and rows of one
+   * iteration over all planes
+   */
+  size_t rows_done;
+  size_t rows_per_iteration;
+
+  /**
+   * Outcome so far: iterations (maximum over the planes), compensations and
+   * whether all planes have converged
+   */
+  int iterations_made;
+  size_t resolved;
+  bool converged;
+
+  double seconds;
+} PerlovkaProgress;
+
+/**
+ * Start denoizing whole planes of `options->width` x `options->height` with
+ * the settings of `options`; its callbacks are not used. The planes advance
+ * one iteration at a time together, and once `deadline` seconds (0 for none)
+ * have passed since the start no further iteration is begun. The planes
+ * belong to the task until it has finished. Returns NULL unless the options
+ * are resumable (see `perlovka_solve_resumable`): each iteration is a solve
+ * call of its own.
+ */
+PerlovkaTask *perlovka_task_start (PerlovkaOptions const *options,
+                                   int *const *planes, int n_planes,
+                                   double deadline);
+
+/**
+ * Ask the task to stop as soon as possible: within a row
+ */
+void perlovka_task_cancel (PerlovkaTask *task);
+
+/**
+ * Wait up to `timeout` seconds (negative for no limit) for the task to
+ * finish. Returns its state: `PERLOVKA_TASK_RUNNING` if it is still running.
+ */
+PerlovkaTaskState perlovka_task_wait (PerlovkaTask *task, double timeout);
+
+void perlovka_task_progress (PerlovkaTask *task, PerlovkaProgress *progress);
+
+/**
+ * Cancel the task if it is still running, wait for it and free it
+ */
+void perlovka_task_free (PerlovkaTask *task);
+
+#endif
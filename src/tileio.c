@@ -0,0 +1,542 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "tileio.h"
+
+#define URING_ENTRIES 256
+#define IO_THREADS 4
+
+struct TileIORequest
+{
+  TileIOBatch *batch;
+  int fd;
+  char *buffer;
+  size_t size;
+  off_t offset;
+  bool write;
+  TileIORequest *next;
+};
+
+/**
+ * Submission and completion rings shared with the kernel
+ */
+typedef struct
+{
+  int fd;
+
+  void *sq_ring;
+  size_t sq_ring_size;
+  void *cq_ring;
+  size_t cq_ring_size;
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned sq_mask;
+  unsigned sq_entries;
+  unsigned *sq_array;
+
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned cq_mask;
+  unsigned cq_entries;
+  struct io_uring_cqe *cqes;
+
+  /**
+   * Entries queued but not passed to the kernel yet, and requests the
+   * kernel has not completed: the latter must fit the completion ring
+   */
+  unsigned unsubmitted;
+  unsigned in_flight;
+} Uring;
+
+struct TileIO
+{
+  TileIOBackend backend;
+  Uring uring;
+
+  /**
+   * Thread pool: requests queued since the last submit, and those the threads
+   * take from
+   */
+  TileIORequest *staged;
+  TileIORequest *staged_tail;
+  TileIORequest *queue;
+  TileIORequest *queue_tail;
+  pthread_t threads[IO_THREADS];
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t done;
+  bool quit;
+};
+
+static void
+complete (TileIORequest *request, bool ok)
+{
+  if (!ok)
+    request->batch->failed = true;
+
+  --request->batch->pending;
+}
+
+/* io_uring backend: the rings are used from one thread only */
+
+static bool
+uring_setup (Uring *uring)
+{
+  struct io_uring_params params;
+  unsigned char *sq;
+  unsigned char *cq;
+
+  memset (&params, 0, sizeof (params));
+  uring->fd = syscall (__NR_io_uring_setup, URING_ENTRIES, &params);
+
+  if (uring->fd < 0)
+    return false;
+
+  uring->sq_ring_size
+      = params.sq_off.array + params.sq_entries * sizeof (unsigned);
+  uring->cq_ring_size = params.cq_off.cqes
+                        + params.cq_entries * sizeof (struct io_uring_cqe);
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      if (uring->cq_ring_size > uring->sq_ring_size)
+        uring->sq_ring_size = uring->cq_ring_size;
+
+      uring->cq_ring_size = 0;
+    }
+
+  uring->sq_ring = mmap (NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, uring->fd,
+                         IORING_OFF_SQ_RING);
+  uring->cq_ring = uring->cq_ring_size
+                       ? mmap (NULL, uring->cq_ring_size,
+                               PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, uring->fd,
+                               IORING_OFF_CQ_RING)
+                       : uring->sq_ring;
+  uring->sqes_size = params.sq_entries * sizeof (struct io_uring_sqe);
+  uring->sqes = (struct io_uring_sqe *)mmap (
+      NULL, uring->sqes_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+
+  if (uring->sq_ring == MAP_FAILED || uring->cq_ring == MAP_FAILED
+      || uring->sqes == MAP_FAILED)
+    {
+      if (uring->sq_ring != MAP_FAILED)
+        munmap (uring->sq_ring, uring->sq_ring_size);
+
+      if (uring->cq_ring_size && uring->cq_ring != MAP_FAILED)
+        munmap (uring->cq_ring, uring->cq_ring_size);
+
+      if (uring->sqes != MAP_FAILED)
+        munmap (uring->sqes, uring->sqes_size);
+
+      close (uring->fd);
+      return false;
+    }
+
+  sq = (unsigned char *)uring->sq_ring;
+  cq = (unsigned char *)uring->cq_ring;
+  uring->sq_head = (unsigned *)(sq + params.sq_off.head);
+  uring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+  uring->sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+  uring->sq_entries = params.sq_entries;
+  uring->sq_array = (unsigned *)(sq + params.sq_off.array);
+  uring->cq_head = (unsigned *)(cq + params.cq_off.head);
+  uring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+  uring->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+  uring->cq_entries = params.cq_entries;
+  uring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+  return true;
+}
+
+static void
+uring_cleanup (Uring *uring)
+{
+  munmap (uring->sqes, uring->sqes_size);
+
+  if (uring->cq_ring_size)
+    munmap (uring->cq_ring, uring->cq_ring_size);
+
+  munmap (uring->sq_ring, uring->sq_ring_size);
+  close (uring->fd);
+}
+
+/**
+ * Pass the queued entries to the kernel and, with `wait`, wait for at least
+ * one completion
+ */
+static void
+uring_enter (Uring *uring, bool wait)
+{
+  long result;
+
+  do
+    result = syscall (__NR_io_uring_enter, uring->fd, uring->unsubmitted,
+                      wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, NULL,
+                      0);
+  while (result < 0 && errno == EINTR);
+
+  if (result > 0)
+    uring->unsubmitted -= result < uring->unsubmitted ? result
+                                                      : uring->unsubmitted;
+}
+
+static void
+uring_queue (Uring *uring, TileIORequest *request)
+{
+  struct io_uring_sqe *sqe;
+  unsigned tail = *uring->sq_tail;
+  unsigned index;
+
+  /* Requests queued again by the reaping may find the ring full */
+  while (tail - __atomic_load_n (uring->sq_head, __ATOMIC_ACQUIRE)
+         >= uring->sq_entries)
+    uring_enter (uring, false);
+
+  index = tail & uring->sq_mask;
+  sqe = &uring->sqes[index];
+  memset (sqe, 0, sizeof (*sqe));
+  sqe->opcode = request->write ? IORING_OP_WRITE : IORING_OP_READ;
+  sqe->fd = request->fd;
+  sqe->off = request->offset;
+  sqe->addr = (unsigned long)request->buffer;
+  sqe->len = request->size;
+  sqe->user_data = (unsigned long)request;
+  uring->sq_array[index] = index;
+
+  __atomic_store_n (uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ++uring->unsubmitted;
+  ++uring->in_flight;
+}
+
+/**
+ * Handle the completions at hand. Short transfers are queued again for the
+ * rest of the data.
+ */
+static void
+uring_reap (Uring *uring)
+{
+  struct io_uring_cqe *cqe;
+  TileIORequest *request;
+  unsigned head = *uring->cq_head;
+
+  while (head != __atomic_load_n (uring->cq_tail, __ATOMIC_ACQUIRE))
+    {
+      cqe = &uring->cqes[head & uring->cq_mask];
+      request = (TileIORequest *)(unsigned long)cqe->user_data;
+      --uring->in_flight;
+      ++head;
+
+      if (cqe->res == -EAGAIN || cqe->res == -EINTR
+          || (cqe->res > 0 && (size_t)cqe->res < request->size))
+        {
+          if (cqe->res > 0)
+            {
+              request->buffer += cqe->res;
+              request->size -= cqe->res;
+              request->offset += cqe->res;
+            }
+
+          uring_queue (uring, request);
+          continue;
+        }
+
+      complete (request, cqe->res > 0 && (size_t)cqe->res == request->size);
+    }
+
+  __atomic_store_n (uring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static void
+uring_add (Uring *uring, TileIORequest *request)
+{
+  /* Room in the submission ring and for the completion */
+  while (*uring->sq_tail - __atomic_load_n (uring->sq_head, __ATOMIC_ACQUIRE)
+             >= uring->sq_entries
+         || uring->in_flight >= uring->cq_entries)
+    {
+      uring_enter (uring, uring->in_flight >= uring->cq_entries);
+      uring_reap (uring);
+    }
+
+  uring_queue (uring, request);
+}
+
+/* Thread pool backend */
+
+static void *
+io_thread (void *arg)
+{
+  TileIO *io = (TileIO *)arg;
+  TileIORequest *request;
+  ssize_t done;
+  bool ok;
+
+  pthread_mutex_lock (&io->lock);
+
+  for (;;)
+    {
+      while (!io->quit && io->queue == NULL)
+        pthread_cond_wait (&io->work, &io->lock);
+
+      if (io->queue == NULL)
+        break;
+
+      request = io->queue;
+      io->queue = request->next;
+
+      if (io->queue == NULL)
+        io->queue_tail = NULL;
+
+      pthread_mutex_unlock (&io->lock);
+
+      ok = true;
+
+      while (ok && request->size > 0)
+        {
+          done = request->write ? pwrite (request->fd, request->buffer,
+                                          request->size, request->offset)
+                                : pread (request->fd, request->buffer,
+                                         request->size, request->offset);
+
+          if (done < 0 && errno == EINTR)
+            continue;
+
+          ok = done > 0;
+
+          if (ok)
+            {
+              request->buffer += done;
+              request->size -= done;
+              request->offset += done;
+            }
+        }
+
+      pthread_mutex_lock (&io->lock);
+      complete (request, ok);
+      pthread_cond_broadcast (&io->done);
+    }
+
+  pthread_mutex_unlock (&io->lock);
+
+  return NULL;
+}
+
+TileIO *
+tileio_new (TileIOBackend backend)
+{
+  TileIO *io = (TileIO *)calloc (1, sizeof (TileIO));
+
+  if (backend != TILEIO_THREADS && uring_setup (&io->uring))
+    {
+      io->backend = TILEIO_URING;
+      return io;
+    }
+
+  if (backend == TILEIO_URING)
+    {
+      free (io);
+      return NULL;
+    }
+
+  io->backend = TILEIO_THREADS;
+  pthread_mutex_init (&io->lock, NULL);
+  pthread_cond_init (&io->work, NULL);
+  pthread_cond_init (&io->done, NULL);
+
+  for (int index = 0; index < IO_THREADS; ++index)
+    pthread_create (&io->threads[index], NULL, io_thread, io);
+
+  return io;
+}
+
+void
+tileio_free (TileIO *io)
+{
+  if (io == NULL)
+    return;
+
+  if (io->backend == TILEIO_URING)
+    {
+      uring_cleanup (&io->uring);
+      free (io);
+      return;
+    }
+
+  pthread_mutex_lock (&io->lock);
+  io->quit = true;
+  pthread_cond_broadcast (&io->work);
+  pthread_mutex_unlock (&io->lock);
+
+  for (int index = 0; index < IO_THREADS; ++index)
+    pthread_join (io->threads[index], NULL);
+
+  pthread_mutex_destroy (&io->lock);
+  pthread_cond_destroy (&io->work);
+  pthread_cond_destroy (&io->done);
+  free (io);
+}
+
+const char *
+tileio_backend_name (TileIO const *io)
+{
+  return io->backend == TILEIO_URING ? "io_uring" : "threads";
+}
+
+void
+tileio_init_batch (TileIOBatch *batch, size_t capacity)
+{
+  memset (batch, 0, sizeof (TileIOBatch));
+  batch->requests
+      = (TileIORequest *)malloc (sizeof (TileIORequest) * capacity);
+  batch->capacity = capacity;
+}
+
+void
+tileio_clean_batch (TileIOBatch *batch)
+{
+  free (batch->requests);
+  batch->requests = NULL;
+}
+
+static void
+add_request (TileIO *io, TileIOBatch *batch, int fd, void *buffer,
+             size_t size, off_t offset, bool write)
+{
+  TileIORequest *request = &batch->requests[batch->count++];
+
+  request->batch = batch;
+  request->fd = fd;
+  request->buffer = (char *)buffer;
+  request->size = size;
+  request->offset = offset;
+  request->write = write;
+  request->next = NULL;
+
+  if (io->backend == TILEIO_URING)
+    {
+      ++batch->pending;
+      uring_add (&io->uring, request);
+      return;
+    }
+
+  pthread_mutex_lock (&io->lock);
+  ++batch->pending;
+  pthread_mutex_unlock (&io->lock);
+
+  if (io->staged_tail)
+    io->staged_tail->next = request;
+  else
+    io->staged = request;
+
+  io->staged_tail = request;
+}
+
+void
+tileio_read (TileIO *io, TileIOBatch *batch, int fd, void *buffer,
+             size_t size, off_t offset)
+{
+  add_request (io, batch, fd, buffer, size, offset, false);
+}
+
+void
+tileio_write (TileIO *io, TileIOBatch *batch, int fd, void const *buffer,
+              size_t size, off_t offset)
+{
+  add_request (io, batch, fd, (void *)buffer, size, offset, true);
+}
+
+void
+tileio_submit (TileIO *io)
+{
+  if (io->backend == TILEIO_URING)
+    {
+      if (io->uring.unsubmitted > 0)
+        uring_enter (&io->uring, false);
+
+      return;
+    }
+
+  if (io->staged == NULL)
+    return;
+
+  pthread_mutex_lock (&io->lock);
+
+  if (io->queue_tail)
+    io->queue_tail->next = io->staged;
+  else
+    io->queue = io->staged;
+
+  io->queue_tail = io->staged_tail;
+  pthread_cond_broadcast (&io->work);
+  pthread_mutex_unlock (&io->lock);
+
+  io->staged = NULL;
+  io->staged_tail = NULL;
+}
+
+bool
+tileio_wait (TileIO *io, TileIOBatch *batch)
+{
+  bool ok;
+
+  tileio_submit (io);
+
+  if (io->backend == TILEIO_URING)
+    {
+      uring_reap (&io->uring);
+
+      while (batch->pending > 0)
+        {
+          uring_enter (&io->uring, true);
+          uring_reap (&io->uring);
+        }
+    }
+  else
+    {
+      pthread_mutex_lock (&io->lock);
+
+      while (batch->pending > 0)
+        pthread_cond_wait (&io->done, &io->lock);
+
+      pthread_mutex_unlock (&io->lock);
+    }
+
+  ok = !batch->failed;
+  batch->count = 0;
+  batch->failed = false;
+
+  return ok;
+}
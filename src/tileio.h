@@ -0,0 +1,94 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef TILEIO_H
+#define TILEIO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * Asynchronous positioned reads and writes of tile rows: io_uring where the
+ * kernel allows it, a pool of pread/pwrite threads otherwise
+ */
+typedef struct TileIO TileIO;
+
+typedef enum
+{
+  TILEIO_AUTO,
+  TILEIO_URING,
+  TILEIO_THREADS
+} TileIOBackend;
+
+typedef struct TileIORequest TileIORequest;
+
+/**
+ * Requests of one tile: they are waited for together
+ */
+typedef struct
+{
+  TileIORequest *requests;
+  size_t capacity;
+  size_t count;
+
+  /**
+   * Requests not completed yet, and whether one of them has failed
+   */
+  size_t pending;
+  bool failed;
+} TileIOBatch;
+
+/**
+ * Start the I/O engine. `TILEIO_AUTO` takes io_uring if the kernel supports
+ * it. Returns NULL if the requested backend is unavailable.
+ */
+TileIO *tileio_new (TileIOBackend backend);
+
+void tileio_free (TileIO *io);
+
+/**
+ * Backend actually used: "io_uring" or "threads"
+ */
+const char *tileio_backend_name (TileIO const *io);
+
+void tileio_init_batch (TileIOBatch *batch, size_t capacity);
+
+void tileio_clean_batch (TileIOBatch *batch);
+
+/**
+ * Queue reading or writing of `size` bytes at `offset` of `fd` as a part of
+ * `batch`. The batch must have been waited for since it was last submitted.
+ */
+void tileio_read (TileIO *io, TileIOBatch *batch, int fd, void *buffer,
+                  size_t size, off_t offset);
+
+void tileio_write (TileIO *io, TileIOBatch *batch, int fd, void const *buffer,
+                   size_t size, off_t offset);
+
+/**
+ * Start the requests queued so far
+ */
+void tileio_submit (TileIO *io);
+
+/**
+ * Wait for all requests of `batch` and make it empty. Returns false if one of
+ * them has failed.
+ */
+bool tileio_wait (TileIO *io, TileIOBatch *batch);
+
+#endif
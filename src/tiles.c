@@ -0,0 +1,338 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "grain.h"
+#include "tiles.h"
+
+/**
+ * Work shared by the tile threads
+ */
+typedef struct
+{
+  PerlovkaOptions *options;
+  int *const *planes;
+
+  /**
+   * Denoized tiles are collected here: the planes must stay intact while
+   * their neighbours read the halo
+   */
+  int **results;
+
+  size_t tile_size;
+
+  /**
+   * Statistics of the adaptive radius, NULL for the radius of the options
+   */
+  PerlovkaAdaptiveStats *adaptive;
+
+  size_t tiles_per_plane;
+  size_t n_tiles;
+
+  pthread_mutex_t lock;
+
+  /**
+   * Next tile to take
+   */
+  size_t next;
+
+  int iterations_made;
+  size_t resolved;
+  bool converged;
+  size_t pruned;
+  PerlovkaStop stopped;
+  double gain;
+  size_t frozen;
+} TileWork;
+
+size_t
+perlovka_tile_halo (PerlovkaOptions const *options)
+{
+  /*
+     The border of the radius width is never compensated, and each iteration
+     may spread a compensation by another radius
+  */
+  return (size_t)options->radius * (options->iterations + 1) + 1;
+}
+
+static size_t
+tiles_across (PerlovkaOptions const *options, size_t *tile_size)
+{
+  if (*tile_size == 0)
+    *tile_size = options->width > options->height ? options->width
+                                                  : options->height;
+
+  return (options->width + *tile_size - 1) / *tile_size;
+}
+
+size_t
+perlovka_tile_count (PerlovkaOptions const *options, size_t tile_size)
+{
+  size_t tiles_x = tiles_across (options, &tile_size);
+
+  return tiles_x * ((options->height + tile_size - 1) / tile_size);
+}
+
+void
+perlovka_tile_rect (PerlovkaOptions const *options, size_t tile_size,
+                    size_t index, TileRect *rect)
+{
+  size_t tiles_x = tiles_across (options, &tile_size);
+  size_t halo = perlovka_tile_halo (options);
+  size_t width = options->width;
+  size_t height = options->height;
+
+  rect->x0 = (index % tiles_x) * tile_size;
+  rect->y0 = (index / tiles_x) * tile_size;
+  rect->x1 = rect->x0 + tile_size < width ? rect->x0 + tile_size : width;
+  rect->y1 = rect->y0 + tile_size < height ? rect->y0 + tile_size : height;
+  rect->left = rect->x0 > halo ? rect->x0 - halo : 0;
+  rect->top = rect->y0 > halo ? rect->y0 - halo : 0;
+  rect->right = rect->x1 + halo < width ? rect->x1 + halo : width;
+  rect->bottom = rect->y1 + halo < height ? rect->y1 + halo : height;
+}
+
+static void
+collect_stats (TileWork *work, PerlovkaOptions const *options)
+{
+  pthread_mutex_lock (&work->lock);
+
+  if (options->iterations_made > work->iterations_made)
+    work->iterations_made = options->iterations_made;
+
+  work->resolved += options->resolved;
+  work->converged = work->converged && options->converged;
+  work->pruned += options->pruned;
+  work->frozen += options->frozen;
+
+  if (options->stopped > work->stopped)
+    work->stopped = options->stopped;
+
+  if (options->gain > work->gain)
+    work->gain = options->gain;
+
+  pthread_mutex_unlock (&work->lock);
+}
+
+/**
+ * Denoize `options->data` with the radius of the options or the one the
+ * tile itself calls for
+ */
+static void
+denoize_data (TileWork *work, PerlovkaOptions *options)
+{
+  int radius;
+
+  if (work->adaptive == NULL)
+    {
+      perlovka_denoize (options);
+      return;
+    }
+
+  options->iterations_made = 0;
+  options->resolved = 0;
+  options->converged = true;
+  options->pruned = 0;
+  options->stopped = PERLOVKA_STOP_CONVERGED;
+  options->gain = 0;
+  options->frozen = 0;
+
+  perlovka_diff (options);
+  radius = perlovka_grain_radius (options);
+
+  if (radius > 0)
+    {
+      options->radius = radius;
+      options->converged = false;
+      perlovka_solve (options);
+    }
+
+  perlovka_undiff (options);
+
+  pthread_mutex_lock (&work->lock);
+  ++work->adaptive->tiles;
+
+  if (radius > 0)
+    work->adaptive->radius_sum += radius;
+  else
+    ++work->adaptive->skipped;
+
+  pthread_mutex_unlock (&work->lock);
+}
+
+static void
+denoize_tile (TileWork *work, size_t tile, int **buffer, size_t *capacity)
+{
+  PerlovkaOptions options;
+  TileRect rect;
+  size_t width = work->options->width;
+  size_t plane = tile / work->tiles_per_plane;
+  size_t tile_width;
+  size_t size;
+  int const *source = work->planes[plane];
+  int *target = work->results[plane];
+
+  perlovka_tile_rect (work->options, work->tile_size,
+                      tile % work->tiles_per_plane, &rect);
+  tile_width = rect.right - rect.left;
+  size = tile_width * (rect.bottom - rect.top);
+
+  options = *work->options;
+  options.progress = NULL;
+  options.cancelled = NULL;
+
+  if (work->tiles_per_plane == 1)
+    {
+      /* Whole plane: no neighbours to keep the halo intact for */
+      options.data = work->planes[plane];
+      denoize_data (work, &options);
+      collect_stats (work, &options);
+      return;
+    }
+
+  if (*capacity < size)
+    {
+      free (*buffer);
+      *buffer = (int *)malloc (sizeof (int) * size);
+      *capacity = size;
+    }
+
+  for (size_t y = rect.top; y < rect.bottom; ++y)
+    memcpy (*buffer + (y - rect.top) * tile_width,
+            source + y * width + rect.left, sizeof (int) * tile_width);
+
+  options.data = *buffer;
+  options.width = tile_width;
+  options.height = rect.bottom - rect.top;
+
+  denoize_data (work, &options);
+
+  for (size_t y = rect.y0; y < rect.y1; ++y)
+    memcpy (target + y * width + rect.x0,
+            *buffer + (y - rect.top) * tile_width + (rect.x0 - rect.left),
+            sizeof (int) * (rect.x1 - rect.x0));
+
+  collect_stats (work, &options);
+}
+
+static void *
+tile_thread (void *arg)
+{
+  TileWork *work = (TileWork *)arg;
+  int *buffer = NULL;
+  size_t capacity = 0;
+  size_t tile;
+
+  for (;;)
+    {
+      pthread_mutex_lock (&work->lock);
+      tile = work->next++;
+      pthread_mutex_unlock (&work->lock);
+
+      if (tile >= work->n_tiles)
+        break;
+
+      denoize_tile (work, tile, &buffer, &capacity);
+    }
+
+  free (buffer);
+
+  return NULL;
+}
+
+static void
+denoize_tiles (PerlovkaOptions *options, int *const *planes, int n_planes,
+               size_t tile_size, int threads, PerlovkaAdaptiveStats *adaptive)
+{
+  TileWork work;
+  pthread_t *ids;
+  size_t size = options->width * options->height;
+  int plane;
+  int index;
+
+  if (threads < 1)
+    threads = 1;
+
+  memset (&work, 0, sizeof (work));
+  work.options = options;
+  work.planes = planes;
+  work.tile_size = tile_size;
+  work.adaptive = adaptive;
+  work.tiles_per_plane = perlovka_tile_count (options, tile_size);
+  work.n_tiles = work.tiles_per_plane * n_planes;
+  work.converged = true;
+  work.results = (int **)malloc (sizeof (int *) * n_planes);
+  pthread_mutex_init (&work.lock, NULL);
+
+  for (plane = 0; plane < n_planes; ++plane)
+    work.results[plane] = work.tiles_per_plane > 1
+                              ? (int *)malloc (sizeof (int) * size)
+                              : NULL;
+
+  if ((size_t)threads > work.n_tiles)
+    threads = work.n_tiles;
+
+  ids = (pthread_t *)malloc (sizeof (pthread_t) * threads);
+
+  for (index = 1; index < threads; ++index)
+    pthread_create (&ids[index], NULL, tile_thread, &work);
+
+  tile_thread (&work);
+
+  for (index = 1; index < threads; ++index)
+    pthread_join (ids[index], NULL);
+
+  for (plane = 0; plane < n_planes; ++plane)
+    {
+      if (work.results[plane] == NULL)
+        continue;
+
+      memcpy (planes[plane], work.results[plane], sizeof (int) * size);
+      free (work.results[plane]);
+    }
+
+  free (work.results);
+  free (ids);
+  pthread_mutex_destroy (&work.lock);
+
+  options->iterations_made = work.iterations_made;
+  options->resolved = work.resolved;
+  options->converged = work.converged;
+  options->pruned = work.pruned;
+  options->stopped = work.stopped;
+  options->gain = work.gain;
+  options->frozen = work.frozen;
+}
+
+void
+perlovka_denoize_tiled (PerlovkaOptions *options, int *const *planes,
+                        int n_planes, size_t tile_size, int threads)
+{
+  denoize_tiles (options, planes, n_planes, tile_size, threads, NULL);
+}
+
+void
+perlovka_denoize_adaptive (PerlovkaOptions *options, int *const *planes,
+                           int n_planes, size_t tile_size, int threads,
+                           PerlovkaAdaptiveStats *stats)
+{
+  memset (stats, 0, sizeof (PerlovkaAdaptiveStats));
+  denoize_tiles (options, planes, n_planes, tile_size, threads, stats);
+}
@@ -0,0 +1,105 @@
+/*
+    Perlovka - grain reduction filter
+    Copyright (C) 2025 Alexander Belkov
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef TILES_H
+#define TILES_H
+
+#include "perlovka.h"
+
+/**
+ * Margin a tile is padded with so that compensations at its borders see the
+ * same surroundings as in the whole image
+ */
+size_t perlovka_tile_halo (PerlovkaOptions const *options);
+
+/**
+ * Tile of a plane along with its padded region
+ */
+typedef struct
+{
+  /**
+   * Tile itself: [x0, x1) x [y0, y1)
+   */
+  size_t x0;
+  size_t y0;
+  size_t x1;
+  size_t y1;
+
+  /**
+   * Tile padded by the halo and clipped by the plane: [left, right) x
+   * [top, bottom)
+   */
+  size_t left;
+  size_t top;
+  size_t right;
+  size_t bottom;
+} TileRect;
+
+/**
+ * Amount of tiles of `tile_size` (0 for the whole plane) covering the plane
+ */
+size_t perlovka_tile_count (PerlovkaOptions const *options, size_t tile_size);
+
+/**
+ * Geometry of the tile number `index`
+ */
+void perlovka_tile_rect (PerlovkaOptions const *options, size_t tile_size,
+                         size_t index, TileRect *rect);
+
+/**
+ * Denoize `n_planes` planes of `options->width` x `options->height` samples.
+ * Planes are split into square tiles of `tile_size` (0 for whole planes), each
+ * tile is padded by the halo and denoized on its own by one of `threads`
+ * threads. The result depends on the tile size but not on the amount of
+ * threads.
+ *
+ * `options->data` and the callbacks are ignored. `iterations_made` reports the
+ * maximum over the tiles, `resolved` the sum and `converged` whether all tiles
+ * have converged. `stopped` and `gain` are the maximum over the tiles, and
+ * `pruned` and `frozen` the sum.
+ */
+void perlovka_denoize_tiled (PerlovkaOptions *options, int *const *planes,
+                             int n_planes, size_t tile_size, int threads);
+
+/**
+ * Tiles of an adaptive run
+ */
+typedef struct
+{
+  size_t tiles;
+
+  /**
+   * Tiles left as they are: no grain detected
+   */
+  size_t skipped;
+
+  /**
+   * Sum of the radii the other tiles were denoized with
+   */
+  size_t radius_sum;
+} PerlovkaAdaptiveStats;
+
+/**
+ * Same as `perlovka_denoize_tiled` with the radius chosen for every tile by
+ * `perlovka_grain_radius` up to `options->radius`. Tiles without detectable
+ * grain are not solved at all.
+ */
+void perlovka_denoize_adaptive (PerlovkaOptions *options, int *const *planes,
+                                int n_planes, size_t tile_size, int threads,
+                                PerlovkaAdaptiveStats *stats);
+
+#endif
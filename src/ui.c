@@ -18,13 +18,15 @@
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
 
+#include "preview.h"
 #include "ui.h"
 
 gboolean
-show_perlovka_dialog (PerlovkaPluginSettings *settings)
+show_perlovka_dialog (gint32 drawable_id, PerlovkaPluginSettings *settings)
 {
   GtkWidget *dlg;
   GtkWidget *main_vbox;
+  GtkWidget *preview;
   GtkWidget *frame;
   GtkWidget *table;
   GtkWidget *spin;
@@ -44,6 +46,10 @@ show_perlovka_dialog (PerlovkaPluginSettings *settings)
   gtk_container_set_border_width (GTK_CONTAINER (main_vbox), 12);
   gtk_container_add (GTK_CONTAINER (GTK_DIALOG (dlg)->vbox), main_vbox);
 
+  preview = perlovka_preview_new (drawable_id, settings);
+  gtk_box_pack_start (GTK_BOX (main_vbox), preview, TRUE, TRUE, 0);
+  gtk_widget_show (preview);
+
   frame = gimp_frame_new (_("Perlovka Settings"));
   gtk_box_pack_start (GTK_BOX (main_vbox), frame, FALSE, FALSE, 0);
   gtk_widget_show (frame);
@@ -64,6 +70,8 @@ show_perlovka_dialog (PerlovkaPluginSettings *settings)
   g_signal_connect (adj, "value-changed",
                     G_CALLBACK (gimp_int_adjustment_update),
                     &settings->radius);
+  g_signal_connect_swapped (adj, "value-changed",
+                            G_CALLBACK (perlovka_preview_changed), preview);
 
   adj = (GtkAdjustment *)gtk_adjustment_new (settings->iterations_limit, 1,
                                              100, 1, 10, 0);
@@ -74,6 +82,8 @@ show_perlovka_dialog (PerlovkaPluginSettings *settings)
   g_signal_connect (adj, "value-changed",
                     G_CALLBACK (gimp_int_adjustment_update),
                     &settings->iterations_limit);
+  g_signal_connect_swapped (adj, "value-changed",
+                            G_CALLBACK (perlovka_preview_changed), preview);
 
   combo = gimp_int_combo_box_new (_("Odd"), 0, _("Even"), 1, _("Both"), 2, NULL);
   gimp_table_attach_aligned (GTK_TABLE (table), 0, 2, _("Grid:"), 0.0, 0.5,
@@ -81,6 +91,8 @@ show_perlovka_dialog (PerlovkaPluginSettings *settings)
   gimp_int_combo_box_connect (GIMP_INT_COMBO_BOX (combo), settings->grid,
                               G_CALLBACK (gimp_int_combo_box_get_active),
                               &settings->grid);
+  g_signal_connect_swapped (combo, "changed",
+                            G_CALLBACK (perlovka_preview_changed), preview);
 
   combo = gimp_int_combo_box_new (_("Soft"), 0, _("Strict"), 1, NULL);
   gimp_table_attach_aligned (GTK_TABLE (table), 0, 3, _("Matching:"), 0.0,
@@ -88,6 +100,8 @@ show_perlovka_dialog (PerlovkaPluginSettings *settings)
   gimp_int_combo_box_connect (GIMP_INT_COMBO_BOX (combo), settings->matching,
                               G_CALLBACK (gimp_int_combo_box_get_active),
                               &settings->matching);
+  g_signal_connect_swapped (combo, "changed",
+                            G_CALLBACK (perlovka_preview_changed), preview);
 
   combo = gimp_int_combo_box_new (_("Minimal"), 0, _("Least of Max"), 1,
                                   _("Largest of Min"), 2, _("Maximal"), 3, NULL);
@@ -96,12 +110,16 @@ show_perlovka_dialog (PerlovkaPluginSettings *settings)
   gimp_int_combo_box_connect (GIMP_INT_COMBO_BOX (combo), settings->resolver,
                               G_CALLBACK (gimp_int_combo_box_get_active),
                               &settings->resolver);
+  g_signal_connect_swapped (combo, "changed",
+                            G_CALLBACK (perlovka_preview_changed), preview);
 
   check = gtk_check_button_new_with_label (_("Field matching"));
   gimp_table_attach_aligned (GTK_TABLE (table), 0, 5, NULL, 0.0, 0.5, check, 1,
                              FALSE);
   g_signal_connect (check, "toggled", G_CALLBACK (gimp_toggle_button_update),
                     &settings->field_matching);
+  g_signal_connect_swapped (check, "toggled",
+                            G_CALLBACK (perlovka_preview_changed), preview);
   gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (check),
                                 settings->field_matching);
 
@@ -110,6 +128,7 @@ show_perlovka_dialog (PerlovkaPluginSettings *settings)
 
   result = (gimp_dialog_run (GIMP_DIALOG (dlg)) == GTK_RESPONSE_OK);
 
+  perlovka_preview_stop ();
   gtk_widget_destroy (dlg);
 
   return result;
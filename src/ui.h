@@ -25,7 +25,8 @@
 #include <libgimp/gimp.h>
 #include <libgimp/gimpui.h>
 
-gboolean show_perlovka_dialog (PerlovkaPluginSettings *options);
+gboolean show_perlovka_dialog (gint32 drawable_id,
+                               PerlovkaPluginSettings *options);
 
 #pragma GCC diagnostic pop
 
@@ -0,0 +1,1370 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "perlovka_test.h"
+#include "../src/checkpoint.h"
+#include "../src/daemon.h"
+#include "../src/diff.h"
+#include "../src/farm.h"
+#include "../src/grain.h"
+#include "../src/grain_signs.h"
+#include "../src/libperlovka.h"
+#include "../src/outofcore.h"
+#include "../src/perlovka.h"
+#include "../src/pyramid.h"
+#include "../src/solver.h"
+#include "../src/step.h"
+#include "../src/stream.h"
+#include "../src/sweep.h"
+#include "../src/task.h"
+#include "../src/tiles.h"
+
+#define TEST_WIDTH 97
+#define TEST_HEIGHT 61
+
+/* Grainy gradient: deterministic so that runs can be compared */
+int *make_image()
+{
+    int *data = malloc(sizeof(int) * TEST_WIDTH * TEST_HEIGHT);
+    unsigned seed = 12345;
+
+    for (int index = 0; index < TEST_WIDTH * TEST_HEIGHT; ++index)
+    {
+        seed = seed * 1103515245 + 12345;
+        data[index] = 20000 + (index % TEST_WIDTH) * 100 + (int)((seed >> 16) % 4000);
+    }
+
+    return data;
+}
+
+void init_test_options(PerlovkaOptions *options, int *data, int iterations)
+{
+    memset(options, 0, sizeof(PerlovkaOptions));
+    options->data = data;
+    options->width = TEST_WIDTH;
+    options->height = TEST_HEIGHT;
+    options->radius = 3;
+    options->iterations = iterations;
+    options->grid = GRID_BOTH;
+    options->matching = MATCHING_SOFT;
+    options->resolver = RESOLVER_LARGEST_OF_MIN;
+    options->field_matching = true;
+}
+
+int check(const char *name, bool ok)
+{
+    printf("%s", name);
+
+    if (ok)
+    {
+        printf(" - OK\n");
+        return 0;
+    }
+
+    printf(" - FAIL!\n");
+    return 1;
+}
+
+int test_resume()
+{
+    PerlovkaOptions whole;
+    PerlovkaOptions resumed;
+    int *expected = make_image();
+    int *actual = make_image();
+    int fails = 0;
+
+    init_test_options(&whole, expected, 12);
+    perlovka_denoize(&whole);
+
+    init_test_options(&resumed, actual, 8);
+    perlovka_diff(&resumed);
+    perlovka_solve(&resumed);
+    resumed.iterations = 12;
+    perlovka_solve(&resumed);
+    perlovka_undiff(&resumed);
+
+    fails += check("Resumed data", memcmp(expected, actual, sizeof(int) * TEST_WIDTH * TEST_HEIGHT) == 0);
+    fails += check("Resumed iterations", whole.iterations_made == resumed.iterations_made);
+    fails += check("Resumed compensations", whole.resolved == resumed.resolved);
+
+    free(expected);
+    free(actual);
+
+    return fails;
+}
+
+int test_stream_with(Grid grid, bool field_matching, int iterations)
+{
+    PerlovkaOptions whole;
+    PerlovkaOptions streamed;
+    PStream stream;
+    int *expected = make_image();
+    int *source = make_image();
+    int *actual = malloc(sizeof(int) * TEST_WIDTH * TEST_HEIGHT);
+    int pulled = 0;
+    int first_pulled_at = -1;
+    int fails = 0;
+
+    init_test_options(&whole, expected, iterations);
+    whole.grid = grid;
+    whole.field_matching = field_matching;
+    perlovka_denoize(&whole);
+
+    streamed = whole;
+    stream = perlovka_stream_new(&streamed);
+
+    for (int y = 0; y < TEST_HEIGHT; ++y)
+    {
+        perlovka_stream_push(stream, source + y * TEST_WIDTH);
+
+        while (perlovka_stream_pull(stream, actual + pulled * TEST_WIDTH))
+        {
+            if (first_pulled_at < 0)
+                first_pulled_at = y;
+            ++pulled;
+        }
+    }
+
+    perlovka_stream_finish(stream);
+
+    while (perlovka_stream_pull(stream, actual + pulled * TEST_WIDTH))
+        ++pulled;
+
+    perlovka_stream_stats(stream, &streamed);
+    perlovka_stream_free(stream);
+
+    printf("grid %d, fields %d, %d iterations: ", grid, field_matching, iterations);
+    fails += check("streamed data", pulled == TEST_HEIGHT && memcmp(expected, actual, sizeof(int) * TEST_WIDTH * TEST_HEIGHT) == 0);
+    fails += check("  first row before the end", first_pulled_at == 0);
+    fails += check("  streamed stats", whole.iterations_made == streamed.iterations_made && whole.resolved == streamed.resolved && whole.converged == streamed.converged);
+
+    free(expected);
+    free(source);
+    free(actual);
+
+    return fails;
+}
+
+int test_stream()
+{
+    PerlovkaOptions options;
+    int fails = 0;
+
+    fails += test_stream_with(GRID_ODD, false, 5);
+    fails += test_stream_with(GRID_EVEN, true, 3);
+    fails += test_stream_with(GRID_BOTH, true, 12);
+    fails += test_stream_with(GRID_BOTH, false, 100);
+
+    init_test_options(&options, NULL, 3);
+    options.probe_budget = 4;
+    fails += check("Stream rejects a probe budget", perlovka_stream_new(&options) == NULL);
+
+    return fails;
+}
+
+int test_context_with(size_t tile_size, int threads)
+{
+    PerlovkaOptions options;
+    PerlovkaContext *context;
+    PerlovkaStats stats;
+    int *expected = make_image();
+    int *source = make_image();
+    int *actual = malloc(sizeof(int) * TEST_WIDTH * TEST_HEIGHT);
+    int fails = 0;
+
+    init_test_options(&options, expected, 6);
+    perlovka_denoize_tiled(&options, &expected, 1, tile_size, 1);
+
+    context = perlovka_context_new(&options, tile_size, threads);
+
+    printf("tile %zu, %d threads: ", tile_size, threads);
+
+    for (int run = 0; run < 3; ++run)
+    {
+        memset(actual, 0, sizeof(int) * TEST_WIDTH * TEST_HEIGHT);
+        perlovka_context_execute(context, source, actual, sizeof(int) * TEST_WIDTH, PERLOVKA_SAMPLE_INT, 0);
+        fails += check(run ? "  same data again" : "context data", memcmp(expected, actual, sizeof(int) * TEST_WIDTH * TEST_HEIGHT) == 0);
+    }
+
+    perlovka_context_stats(context, &stats);
+    fails += check("  context stats", stats.runs == 3 && stats.resolved == options.resolved && stats.iterations_made == options.iterations_made);
+
+    perlovka_context_free(context);
+
+    free(expected);
+    free(source);
+    free(actual);
+
+    return fails;
+}
+
+int test_context()
+{
+    int fails = 0;
+
+    fails += test_context_with(0, 1);
+    fails += test_context_with(32, 1);
+    fails += test_context_with(32, 3);
+
+    return fails;
+}
+
+int test_daemon()
+{
+    PerlovkaOptions options;
+    PerlovkaDaemon *daemon;
+    PerlovkaJob job;
+    PerlovkaReply reply;
+    char path[64];
+    size_t size = sizeof(int) * TEST_WIDTH * TEST_HEIGHT;
+    int *expected = make_image();
+    int *source = make_image();
+    int *memory;
+    int socket;
+    int fd;
+    int fails = 0;
+
+    init_test_options(&options, expected, 6);
+    perlovka_denoize_tiled(&options, &expected, 1, 32, 1);
+
+    snprintf(path, sizeof(path), "/tmp/perlovka-test-%d.sock", (int)getpid());
+    daemon = perlovka_daemon_start(path, 2, 2, 2);
+    fails += check("Daemon started", daemon != NULL);
+
+    if (daemon == NULL)
+    {
+        free(expected);
+        free(source);
+        return fails;
+    }
+
+    socket = perlovka_daemon_connect(path);
+    memory = perlovka_daemon_alloc(size, &fd);
+    perlovka_job_init(&job, &options, 1, 32, PERLOVKA_PRIORITY_INTERACTIVE);
+
+    for (int run = 0; run < 2; ++run)
+    {
+        memcpy(memory, source, size);
+        job.priority = run ? PERLOVKA_PRIORITY_BATCH : PERLOVKA_PRIORITY_INTERACTIVE;
+
+        fails += check(run ? "  batch job" : "  interactive job",
+                       perlovka_daemon_submit(socket, &job, fd, &reply) && reply.status == PERLOVKA_DAEMON_OK
+                           && memcmp(expected, memory, size) == 0 && reply.stats.resolved == options.resolved);
+        fails += check(run ? "  warm context" : "  new context", reply.stats.runs == (size_t)run + 1);
+    }
+
+    /* The solve options beyond the plan travel with the job */
+    free(expected);
+    expected = make_image();
+    init_test_options(&options, expected, 6);
+    options.scan = SCAN_ALTERNATE;
+    options.prune_below = 0.3;
+    options.min_gain = 0.01;
+    options.probe_budget = 8;
+    perlovka_denoize_tiled(&options, &expected, 1, 32, 1);
+
+    memcpy(memory, source, size);
+    perlovka_job_init(&job, &options, 1, 32, PERLOVKA_PRIORITY_INTERACTIVE);
+    fails += check("  scan, pruning, gain and budget", perlovka_daemon_submit(socket, &job, fd, &reply) && reply.status == PERLOVKA_DAEMON_OK
+                                                             && memcmp(expected, memory, size) == 0 && reply.stats.resolved == options.resolved);
+
+    job.stride = 1;
+    fails += check("  bad job refused", perlovka_daemon_submit(socket, &job, fd, &reply) && reply.status == PERLOVKA_DAEMON_BAD_JOB);
+
+    job.stride = sizeof(int) * TEST_WIDTH;
+    job.planes = 2;
+    fails += check("  short memory refused", perlovka_daemon_submit(socket, &job, fd, &reply) && reply.status == PERLOVKA_DAEMON_BAD_MEMORY);
+
+    perlovka_daemon_release(memory, size, fd);
+    close(socket);
+    perlovka_daemon_stop(daemon);
+
+    fails += check("  socket removed", access(path, F_OK) != 0);
+
+    free(expected);
+    free(source);
+
+    return fails;
+}
+
+int test_farm()
+{
+    PerlovkaOptions options;
+    PerlovkaOptions farmed;
+    PerlovkaFarm *farm;
+    struct sockaddr_in address;
+    socklen_t length = sizeof(address);
+    char workers[64];
+    size_t size = sizeof(int) * TEST_WIDTH * TEST_HEIGHT;
+    int *expected[2] = { make_image(), make_image() };
+    int *actual[2] = { make_image(), make_image() };
+    int listener;
+    size_t local;
+    int fails = 0;
+
+    for (int index = 0; index < TEST_WIDTH * TEST_HEIGHT; ++index)
+    {
+        expected[1][index] = 60000 - expected[1][index];
+        actual[1][index] = expected[1][index];
+    }
+
+    init_test_options(&options, NULL, 6);
+    perlovka_denoize_tiled(&options, expected, 2, 32, 1);
+
+    init_test_options(&farmed, NULL, 6);
+    farm = perlovka_farm_spawn(3);
+    local = perlovka_farm_denoize(farm, &farmed, actual, 2, 32);
+    perlovka_farm_free(farm);
+
+    fails += check("Farm data", memcmp(expected[0], actual[0], size) == 0 && memcmp(expected[1], actual[1], size) == 0);
+    fails += check("  farm stats", local == 0 && farmed.resolved == options.resolved && farmed.iterations_made == options.iterations_made);
+
+    /* A worker that never answers: its tiles are denoized locally */
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    bind(listener, (struct sockaddr *)&address, sizeof(address));
+    listen(listener, 1);
+    getsockname(listener, (struct sockaddr *)&address, &length);
+    snprintf(workers, sizeof(workers), "127.0.0.1:%d", ntohs(address.sin_port));
+
+    farm = perlovka_farm_connect(workers);
+    close(listener);
+
+    for (int plane = 0; plane < 2; ++plane)
+    {
+        free(actual[plane]);
+        actual[plane] = make_image();
+    }
+
+    for (int index = 0; index < TEST_WIDTH * TEST_HEIGHT; ++index)
+        actual[1][index] = 60000 - actual[1][index];
+
+    local = farm ? perlovka_farm_denoize(farm, &farmed, actual, 2, 32) : 0;
+    perlovka_farm_free(farm);
+
+    fails += check("  failed worker", local > 0 && memcmp(expected[0], actual[0], size) == 0 && memcmp(expected[1], actual[1], size) == 0);
+    fails += check("  no workers", perlovka_farm_connect("127.0.0.1:1") == NULL);
+
+    /* The workers honor the options beyond the plan as the local tiles do */
+    for (int plane = 0; plane < 2; ++plane)
+    {
+        free(expected[plane]);
+        free(actual[plane]);
+        expected[plane] = make_image();
+        actual[plane] = make_image();
+    }
+
+    for (int index = 0; index < TEST_WIDTH * TEST_HEIGHT; ++index)
+    {
+        expected[1][index] = 60000 - expected[1][index];
+        actual[1][index] = expected[1][index];
+    }
+
+    init_test_options(&options, NULL, 6);
+    options.scan = SCAN_SERPENTINE;
+    options.prune_below = 0.3;
+    options.min_gain = 0.01;
+    options.probe_budget = 8;
+    perlovka_denoize_tiled(&options, expected, 2, 32, 1);
+
+    farmed = options;
+    farm = perlovka_farm_spawn(2);
+    local = perlovka_farm_denoize(farm, &farmed, actual, 2, 32);
+    perlovka_farm_free(farm);
+
+    fails += check("  scan, pruning, gain and budget", local == 0 && memcmp(expected[0], actual[0], size) == 0 && memcmp(expected[1], actual[1], size) == 0 && farmed.resolved == options.resolved);
+
+    /* Tiles the workers refuse are denoized locally to the same result */
+    for (int plane = 0; plane < 2; ++plane)
+    {
+        free(expected[plane]);
+        free(actual[plane]);
+        expected[plane] = make_image();
+        actual[plane] = make_image();
+    }
+
+    init_test_options(&options, NULL, 1001);
+    perlovka_denoize_tiled(&options, expected, 2, 32, 1);
+
+    farmed = options;
+    farm = perlovka_farm_spawn(2);
+    local = perlovka_farm_denoize(farm, &farmed, actual, 2, 32);
+
+    fails += check("  refused tiles", local == 2 * perlovka_tile_count(&options, 32) && memcmp(expected[0], actual[0], size) == 0 && memcmp(expected[1], actual[1], size) == 0 && farmed.resolved == options.resolved);
+
+    /* Without costing the workers */
+    free(actual[0]);
+    actual[0] = make_image();
+    init_test_options(&farmed, NULL, 6);
+    local = perlovka_farm_denoize(farm, &farmed, actual, 1, 32);
+    perlovka_farm_free(farm);
+
+    fails += check("  workers kept", local == 0);
+
+    for (int plane = 0; plane < 2; ++plane)
+    {
+        free(expected[plane]);
+        free(actual[plane]);
+    }
+
+    return fails;
+}
+
+/* Cancels the solve at the given row call: the run stops mid-iteration */
+static bool cancel_at_row(void *context)
+{
+    int *rows_left = context;
+
+    return --*rows_left < 0;
+}
+
+int test_checkpoint()
+{
+    PerlovkaOptions options;
+    PerlovkaOptions checkpointed;
+    PerlovkaOptions stats[2];
+    char path[] = "/tmp/perlovka_checkpointXXXXXX";
+    size_t size = sizeof(int) * TEST_WIDTH * TEST_HEIGHT;
+    int *expected[2] = { make_image(), make_image() };
+    int *actual[2] = { make_image(), make_image() };
+    int *source[2] = { make_image(), make_image() };
+    int *swapped[2];
+    int *untouched = make_image();
+    uint64_t hash;
+    int rows_left;
+    int resumed;
+    int fd = mkstemp(path);
+    int fails = 0;
+
+    close(fd);
+    unlink(path);
+
+    for (int index = 0; index < TEST_WIDTH * TEST_HEIGHT; ++index)
+    {
+        expected[1][index] = 60000 - expected[1][index];
+        actual[1][index] = expected[1][index];
+        source[1][index] = expected[1][index];
+    }
+
+    init_test_options(&options, NULL, 6);
+    perlovka_denoize_tiled(&options, expected, 2, 0, 1);
+
+    /* Two iterations are saved, the third one is cancelled halfway */
+    init_test_options(&checkpointed, NULL, 6);
+    rows_left = 2 * 2 * (TEST_HEIGHT - 2 * checkpointed.radius - 1) + 20;
+    checkpointed.cancelled = cancel_at_row;
+    checkpointed.context = &rows_left;
+    perlovka_denoize_checkpointed(&checkpointed, actual, 2, path, 1, &resumed);
+
+    for (int plane = 0; plane < 2; ++plane)
+        memcpy(actual[plane], source[plane], size);
+
+    init_test_options(&checkpointed, NULL, 6);
+    perlovka_denoize_checkpointed(&checkpointed, actual, 2, path, 1, &resumed);
+
+    fails += check("Checkpoint restart", resumed == 2 && memcmp(expected[0], actual[0], size) == 0 && memcmp(expected[1], actual[1], size) == 0);
+    fails += check("  checkpoint stats", checkpointed.resolved == options.resolved && checkpointed.iterations_made == options.iterations_made && checkpointed.converged == options.converged);
+
+    /* A checkpoint of one image is not continued on another of its size */
+    for (int plane = 0; plane < 2; ++plane)
+        memcpy(actual[plane], source[plane], size);
+
+    init_test_options(&checkpointed, NULL, 6);
+    rows_left = 2 * 2 * (TEST_HEIGHT - 2 * checkpointed.radius - 1) + 20;
+    checkpointed.cancelled = cancel_at_row;
+    checkpointed.context = &rows_left;
+    perlovka_denoize_checkpointed(&checkpointed, actual, 2, path, 1, &resumed);
+
+    memcpy(actual[0], source[1], size);
+    memcpy(actual[1], source[0], size);
+    init_test_options(&checkpointed, NULL, 6);
+    perlovka_denoize_checkpointed(&checkpointed, actual, 2, path, 1, &resumed);
+
+    fails += check("  other image started over", resumed == 0 && memcmp(expected[1], actual[0], size) == 0 && memcmp(expected[0], actual[1], size) == 0);
+
+    /* Nor beyond a lowered iterations limit */
+    swapped[0] = source[1];
+    swapped[1] = source[0];
+    init_test_options(&checkpointed, NULL, 6);
+    hash = perlovka_checkpoint_source(&checkpointed, swapped, 2);
+    checkpointed.iterations = 1;
+    memcpy(actual[0], untouched, size);
+    fails += check("  lowered limit", !perlovka_checkpoint_load(&checkpointed, actual, 2, stats, hash, path) && memcmp(actual[0], untouched, size) == 0);
+    checkpointed.iterations = 6;
+    fails += check("  same limit", perlovka_checkpoint_load(&checkpointed, actual, 2, stats, hash, path));
+
+    /* Nor in another scan order or with another probe budget */
+    checkpointed.scan = SCAN_SERPENTINE;
+    fails += check("  other scan order", !perlovka_checkpoint_load(&checkpointed, actual, 2, stats, hash, path));
+    checkpointed.scan = SCAN_RASTER;
+    checkpointed.probe_budget = 4;
+    fails += check("  other probe budget", !perlovka_checkpoint_load(&checkpointed, actual, 2, stats, hash, path));
+    checkpointed.probe_budget = 0;
+
+    /* A cut file is rejected before the planes are written */
+    truncate(path, 200);
+    init_test_options(&checkpointed, NULL, 6);
+    memcpy(actual[0], untouched, size);
+    fails += check("  damaged checkpoint", !perlovka_checkpoint_load(&checkpointed, actual, 1, stats, hash, path) && memcmp(actual[0], untouched, size) == 0);
+
+    unlink(path);
+
+    /* Gain tracking would start over with every resumed call */
+    init_test_options(&checkpointed, NULL, 6);
+    checkpointed.min_gain = 0.01;
+    memcpy(actual[0], untouched, size);
+    fails += check("  gain tracking refused", !perlovka_denoize_checkpointed(&checkpointed, actual, 1, path, 1, &resumed) && resumed == 0 && memcmp(actual[0], untouched, size) == 0 && access(path, F_OK) != 0);
+
+    for (int plane = 0; plane < 2; ++plane)
+    {
+        free(expected[plane]);
+        free(actual[plane]);
+        free(source[plane]);
+    }
+
+    free(untouched);
+
+    return fails;
+}
+
+int test_task()
+{
+    PerlovkaOptions options;
+    PerlovkaOptions settings;
+    PerlovkaProgress progress;
+    PerlovkaTask *task;
+    size_t size = sizeof(int) * TEST_WIDTH * TEST_HEIGHT;
+    size_t big_size = 800 * 800;
+    int *expected[2] = { make_image(), make_image() };
+    int *actual[2] = { make_image(), make_image() };
+    int *big = malloc(sizeof(int) * big_size);
+    unsigned seed = 1;
+    PerlovkaTaskState state;
+    int fails = 0;
+
+    for (int index = 0; index < TEST_WIDTH * TEST_HEIGHT; ++index)
+    {
+        expected[1][index] = 60000 - expected[1][index];
+        actual[1][index] = expected[1][index];
+    }
+
+    init_test_options(&options, NULL, 6);
+    perlovka_denoize_tiled(&options, expected, 2, 0, 1);
+
+    init_test_options(&settings, NULL, 6);
+    task = perlovka_task_start(&settings, actual, 2, 0);
+    state = perlovka_task_wait(task, -1);
+    perlovka_task_progress(task, &progress);
+    perlovka_task_free(task);
+
+    fails += check("Task", state == PERLOVKA_TASK_DONE && memcmp(expected[0], actual[0], size) == 0 && memcmp(expected[1], actual[1], size) == 0);
+    fails += check("  task progress", progress.state == PERLOVKA_TASK_DONE && progress.iterations_made == options.iterations_made && progress.resolved == options.resolved && progress.converged == options.converged && progress.rows_done > 0 && progress.rows_done <= progress.rows_per_iteration * progress.iterations_made);
+
+    /* Grain of a large image keeps the task busy long enough to stop it */
+    for (size_t index = 0; index < big_size; ++index)
+    {
+        seed = seed * 1103515245 + 12345;
+        big[index] = (int)((seed >> 16) % 4000);
+    }
+
+    init_test_options(&settings, NULL, 100);
+    settings.width = 800;
+    settings.height = 800;
+    task = perlovka_task_start(&settings, &big, 1, 0);
+    state = perlovka_task_wait(task, 0);
+    perlovka_task_cancel(task);
+    fails += check("  task cancel", state == PERLOVKA_TASK_RUNNING && perlovka_task_wait(task, 10) == PERLOVKA_TASK_CANCELLED);
+    perlovka_task_free(task);
+
+    task = perlovka_task_start(&settings, &big, 1, 1e-9);
+    state = perlovka_task_wait(task, -1);
+    perlovka_task_progress(task, &progress);
+    perlovka_task_free(task);
+    fails += check("  task deadline", state == PERLOVKA_TASK_DEADLINE && progress.iterations_made == 1 && progress.rows_done == progress.rows_per_iteration);
+
+    settings.prune_below = 0.3;
+    fails += check("  pruning refused", perlovka_task_start(&settings, &big, 1, 0) == NULL);
+
+    for (int plane = 0; plane < 2; ++plane)
+    {
+        free(expected[plane]);
+        free(actual[plane]);
+    }
+
+    free(big);
+
+    return fails;
+}
+
+int test_step_with(Grid grid, int iterations, size_t budget)
+{
+    PerlovkaOptions options;
+    PerlovkaOptions stepped;
+    PStepper stepper;
+    size_t size = sizeof(int) * TEST_WIDTH * TEST_HEIGHT;
+    int *expected = make_image();
+    int *actual = make_image();
+    double fraction = 0.0;
+    bool monotonic = true;
+    int calls = 0;
+    int fails = 0;
+
+    init_test_options(&options, expected, iterations);
+    options.grid = grid;
+    perlovka_denoize(&options);
+
+    init_test_options(&stepped, actual, iterations);
+    stepped.grid = grid;
+    stepper = perlovka_step_new(&stepped);
+
+    while (!perlovka_step(stepper, budget))
+    {
+        monotonic = monotonic && perlovka_step_fraction(stepper) >= fraction;
+        fraction = perlovka_step_fraction(stepper);
+        ++calls;
+    }
+
+    monotonic = monotonic && perlovka_step_fraction(stepper) == 1.0;
+    perlovka_step_free(stepper);
+
+    printf("Step, grid %d, %d iteration(s), %zu row(s) per call", grid, iterations, budget);
+    fails += check("", memcmp(expected, actual, size) == 0 && monotonic && (budget > 1000 || calls > 0));
+    fails += check("  step stats", stepped.iterations_made == options.iterations_made && stepped.resolved == options.resolved && stepped.converged == options.converged);
+
+    free(expected);
+    free(actual);
+
+    return fails;
+}
+
+int test_step()
+{
+    PerlovkaOptions options;
+    int fails = 0;
+
+    fails += test_step_with(GRID_BOTH, 6, 1);
+    fails += test_step_with(GRID_ODD, 3, 7);
+    fails += test_step_with(GRID_EVEN, 100, 5000);
+
+    init_test_options(&options, NULL, 3);
+    options.scan = SCAN_BLOCKS;
+    fails += check("Step rejects other scan orders", perlovka_step_new(&options) == NULL);
+
+    return fails;
+}
+
+int test_pyramid()
+{
+    PerlovkaOptions options;
+    PerlovkaOptions pyramid;
+    size_t size = sizeof(int) * TEST_WIDTH * TEST_HEIGHT;
+    size_t width = 2 * TEST_WIDTH;
+    size_t height = 2 * TEST_HEIGHT;
+    int *expected = make_image();
+    int *actual = make_image();
+    int *base = make_image();
+    int *coarse = make_image();
+    int *image = malloc(4 * size);
+    int *result = malloc(4 * size);
+    int fails = 0;
+
+    init_test_options(&options, expected, 4);
+    perlovka_denoize(&options);
+
+    init_test_options(&pyramid, actual, 4);
+    perlovka_denoize_pyramid(&pyramid, 0, 1);
+
+    fails += check("Pyramid without levels", memcmp(expected, actual, size) == 0 && pyramid.resolved == options.resolved);
+
+    /* Blocks of 2 x 2 halve into the test image exactly: the coarse pass is
+       the plain one at half radius, spread back over the blocks */
+    init_test_options(&options, coarse, 4);
+    options.radius = 3;
+    perlovka_denoize(&options);
+
+    for (size_t y = 0; y < height; ++y)
+        for (size_t x = 0; x < width; ++x)
+        {
+            image[y * width + x] = base[(y / 2) * TEST_WIDTH + x / 2];
+            result[y * width + x] = coarse[(y / 2) * TEST_WIDTH + x / 2];
+        }
+
+    init_test_options(&options, result, 4);
+    options.width = width;
+    options.height = height;
+    options.radius = 2;
+    perlovka_denoize(&options);
+
+    init_test_options(&pyramid, image, 4);
+    pyramid.width = width;
+    pyramid.height = height;
+    pyramid.radius = 6;
+    perlovka_denoize_pyramid(&pyramid, 1, 2);
+
+    fails += check("  pyramid level", memcmp(image, result, 4 * size) == 0 && pyramid.resolved > options.resolved);
+
+    free(expected);
+    free(actual);
+    free(base);
+    free(coarse);
+    free(image);
+    free(result);
+
+    return fails;
+}
+
+int test_out_of_core_with(TileIOBackend backend, const char *name)
+{
+    PerlovkaOptions options;
+    PerlovkaOptions filed;
+    PerlovkaFile input;
+    PerlovkaFile output;
+    PerlovkaFileStats stats;
+    size_t samples = TEST_WIDTH * TEST_HEIGHT;
+    unsigned char *bytes = malloc(4 * samples);
+    int *expected = make_image();
+    FILE *input_file = tmpfile();
+    FILE *output_file = tmpfile();
+    TileIO *io = tileio_new(backend);
+    bool same = true;
+    bool ok;
+    int fails = 0;
+
+    if (io == NULL)
+    {
+        printf("%s - unavailable, skipped\n", name);
+        free(bytes);
+        free(expected);
+        fclose(input_file);
+        fclose(output_file);
+        return 0;
+    }
+
+    /* Big-endian 16-bit samples interleaved with alpha, behind a header */
+    fwrite("HEAD", 1, 4, input_file);
+
+    for (size_t index = 0; index < samples; ++index)
+    {
+        bytes[4 * index] = expected[index] >> 8;
+        bytes[4 * index + 1] = expected[index] & 0xff;
+        bytes[4 * index + 2] = index >> 8;
+        bytes[4 * index + 3] = index & 0xff;
+    }
+
+    fwrite(bytes, 1, 4 * samples, input_file);
+    fflush(input_file);
+
+    input.fd = fileno(input_file);
+    input.offset = 4;
+    input.width = TEST_WIDTH;
+    input.height = TEST_HEIGHT;
+    input.channels = 2;
+    input.color_channels = 1;
+    input.bytes = 2;
+    input.big_endian = true;
+    input.interleaved = true;
+    input.maxval = 65535;
+
+    output = input;
+    output.fd = fileno(output_file);
+    output.offset = 0;
+
+    init_test_options(&options, NULL, 6);
+    perlovka_denoize_tiled(&options, &expected, 1, 32, 1);
+    perlovka_clamp_row(expected, samples, 0, 65535);
+
+    init_test_options(&filed, NULL, 6);
+    ok = perlovka_denoize_file(&filed, &input, &output, 32, io, &stats);
+
+    memset(bytes, 0, 4 * samples);
+    ok = ok && pread(output.fd, bytes, 4 * samples, 0) == (ssize_t)(4 * samples);
+
+    for (size_t index = 0; index < samples; ++index)
+    {
+        same = same && ((bytes[4 * index] << 8) | bytes[4 * index + 1]) == expected[index]
+               && ((bytes[4 * index + 2] << 8) | bytes[4 * index + 3]) == (int)(index & 0xffff);
+    }
+
+    fails += check(name, ok && same);
+    fails += check("  out-of-core stats", stats.tiles == perlovka_tile_count(&filed, 32) && filed.resolved == options.resolved && filed.iterations_made == options.iterations_made);
+
+    tileio_free(io);
+    fclose(input_file);
+    fclose(output_file);
+    free(bytes);
+    free(expected);
+
+    return fails;
+}
+
+int test_out_of_core()
+{
+    int fails = 0;
+
+    fails += test_out_of_core_with(TILEIO_THREADS, "Out-of-core with threads");
+    fails += test_out_of_core_with(TILEIO_URING, "Out-of-core with io_uring");
+
+    return fails;
+}
+
+int test_indexed_solver_with(Grid grid, MatchMode matching, bool field_matching, int radius)
+{
+    size_t size = TEST_WIDTH * TEST_HEIGHT;
+    int *expected = make_image();
+    int *actual = make_image();
+    int expected_solved = 0;
+    int actual_solved = 0;
+    PSolver solver;
+    PSolverIndex index;
+    int fails = 0;
+
+    diff_horizontal(expected, size);
+    diff_vertical(expected, size, TEST_WIDTH);
+    memcpy(actual, expected, sizeof(int) * size);
+
+    solver = build_solver(TEST_WIDTH, radius, grid, matching, RESOLVER_MINIMAL, field_matching);
+    index = build_solver_index(solver, actual, TEST_WIDTH, TEST_HEIGHT);
+
+    for (int iteration = 0; iteration < 3; ++iteration)
+        for (int y = radius; y < TEST_HEIGHT - radius - 1; ++y)
+        {
+            for (int x = radius + 1; x < TEST_WIDTH - radius; ++x)
+                expected_solved += apply_solver(solver, expected, y * TEST_WIDTH + x);
+
+            actual_solved += apply_indexed_solver_row(solver, index, actual, y * TEST_WIDTH, TEST_WIDTH, radius);
+        }
+
+    printf("Indexed solver, grid %d, matching %d, field matching %d, radius %d", grid, matching, field_matching, radius);
+    fails += check("", memcmp(expected, actual, sizeof(int) * size) == 0 && expected_solved == actual_solved && actual_solved > 0);
+
+    /* A rebuilt index forgets the hits, the pruned boxes and the budget */
+    track_solver_hits(index);
+    prune_solver_index(index, 1.0);
+    limit_solver_probes(index, 1);
+
+    free(actual);
+    actual = make_image();
+    diff_horizontal(actual, size);
+    diff_vertical(actual, size, TEST_WIDTH);
+    rebuild_solver_index(index, solver, actual, TEST_WIDTH, TEST_HEIGHT);
+    actual_solved = 0;
+
+    for (int iteration = 0; iteration < 3; ++iteration)
+        for (int y = radius; y < TEST_HEIGHT - radius - 1; ++y)
+            actual_solved += apply_indexed_solver_row(solver, index, actual, y * TEST_WIDTH, TEST_WIDTH, radius);
+
+    clean_solver_index(index);
+    clean_solver(solver);
+
+    fails += check("  rebuilt in place", memcmp(expected, actual, sizeof(int) * size) == 0 && expected_solved == actual_solved);
+
+    free(expected);
+    free(actual);
+
+    return fails;
+}
+
+int test_indexed_solver()
+{
+    int fails = 0;
+
+    fails += test_indexed_solver_with(GRID_BOTH, MATCHING_SOFT, false, 3);
+    fails += test_indexed_solver_with(GRID_ODD, MATCHING_STRICT, false, 1);
+    fails += test_indexed_solver_with(GRID_EVEN, MATCHING_SOFT, true, 4);
+    fails += test_indexed_solver_with(GRID_BOTH, MATCHING_STRICT, true, 8);
+
+    return fails;
+}
+
+int test_prune()
+{
+    PerlovkaOptions options;
+    PerlovkaOptions pruned;
+    size_t size = sizeof(int) * TEST_WIDTH * TEST_HEIGHT;
+    int *expected = make_image();
+    int *actual = make_image();
+    int *whole = make_image();
+    int fails = 0;
+
+    init_test_options(&options, expected, 6);
+    options.radius = 5;
+    perlovka_denoize(&options);
+
+    init_test_options(&pruned, actual, 6);
+    pruned.radius = 5;
+    pruned.prune_below = 0.5;
+    perlovka_denoize_tiled(&pruned, &actual, 1, 0, 1);
+
+    fails += check("Pruning drops boxes", pruned.pruned > 0 && pruned.resolved > 0 && pruned.resolved < options.resolved);
+
+    /* The leading boxes stay: every pixel is still probed */
+    init_test_options(&pruned, whole, 6);
+    pruned.radius = 5;
+    pruned.prune_below = 0.5;
+    perlovka_denoize(&pruned);
+
+    fails += check("  pruned runs repeat", memcmp(whole, actual, size) == 0 && memcmp(expected, actual, size) != 0);
+
+    free(expected);
+    free(actual);
+    free(whole);
+
+    return fails;
+}
+
+/* Flat gradient with discs of `radius` raised or sunk by 500 */
+int *make_disc_image(int radius)
+{
+    int *data = malloc(sizeof(int) * TEST_WIDTH * TEST_HEIGHT);
+    unsigned seed = 777;
+    int discs = radius > 0 ? TEST_WIDTH * TEST_HEIGHT / (6 * radius * radius) : 0;
+    int cx;
+    int cy;
+    int amplitude;
+
+    for (int index = 0; index < TEST_WIDTH * TEST_HEIGHT; ++index)
+        data[index] = 20000 + (index % TEST_WIDTH) * 10;
+
+    for (int disc = 0; disc < discs; ++disc)
+    {
+        seed = seed * 1103515245 + 12345;
+        cx = (seed >> 16) % TEST_WIDTH;
+        seed = seed * 1103515245 + 12345;
+        cy = (seed >> 16) % TEST_HEIGHT;
+        amplitude = (seed >> 8) & 1 ? 500 : -500;
+
+        for (int y = cy - radius; y <= cy + radius; ++y)
+            for (int x = cx - radius; x <= cx + radius; ++x)
+                if (x >= 0 && y >= 0 && x < TEST_WIDTH && y < TEST_HEIGHT
+                    && (x - cx) * (x - cx) + (y - cy) * (y - cy) <= radius * radius)
+                    data[y * TEST_WIDTH + x] += amplitude;
+    }
+
+    return data;
+}
+
+int grain_radius_of(int *data, int radius)
+{
+    PerlovkaOptions options;
+    int result;
+
+    init_test_options(&options, data, 1);
+    options.radius = radius;
+    perlovka_diff(&options);
+    result = perlovka_grain_radius(&options);
+    free(data);
+
+    return result;
+}
+
+int test_pack_signs()
+{
+    PerlovkaOptions options;
+    SignRows rows;
+    int width = 200;
+    int height = 6;
+    int *data = (int *)malloc(sizeof(int) * width * height);
+    long positive = 0;
+    long negative = 0;
+    long packed_positive = 0;
+    long packed_negative = 0;
+
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            data[y * width + x] = (x * 7 + y * 13) % 5 - 2;
+
+            if (x > 0 && y + 1 < height)
+            {
+                positive += data[y * width + x] > 0;
+                negative += data[y * width + x] < 0;
+            }
+        }
+
+    init_test_options(&options, data, 1);
+    options.width = width;
+    options.height = height;
+    pack_signs(&options, &rows);
+
+    for (size_t word = 0; word < rows.words * height; ++word)
+    {
+        packed_positive += __builtin_popcountll(rows.positive[word]);
+        packed_negative += __builtin_popcountll(rows.negative[word]);
+    }
+
+    free(rows.positive);
+    free(data);
+
+    return check("Packed signs of every word", rows.words == 4 && packed_positive == positive && packed_negative == negative);
+}
+
+int test_adaptive()
+{
+    PerlovkaOptions options;
+    PerlovkaOptions adaptive;
+    PerlovkaAdaptiveStats stats;
+    size_t size = sizeof(int) * TEST_WIDTH * TEST_HEIGHT;
+    int *expected = make_image();
+    int *actual = make_image();
+    int *flat = make_disc_image(0);
+    int *copy = make_disc_image(0);
+    int fails = 0;
+
+    fails += check("Grain radius of pixel noise", grain_radius_of(make_image(), 8) == 1);
+    fails += check("  of discs", grain_radius_of(make_disc_image(2), 8) == 2 && grain_radius_of(make_disc_image(4), 8) == 4);
+    fails += check("  up to the radius", grain_radius_of(make_disc_image(4), 3) == 3);
+    fails += check("  of no grain", grain_radius_of(make_disc_image(0), 8) == 0);
+
+    /* Pixel noise calls for the radius 1 everywhere: the same as tiles of
+       the radius 1 */
+    init_test_options(&options, expected, 3);
+    options.radius = 1;
+    perlovka_denoize_tiled(&options, &expected, 1, 40, 1);
+
+    init_test_options(&adaptive, actual, 3);
+    adaptive.radius = 1;
+    perlovka_denoize_adaptive(&adaptive, &actual, 1, 40, 2, &stats);
+
+    fails += check("Adaptive radius", memcmp(expected, actual, size) == 0 && adaptive.resolved == options.resolved && stats.tiles == 6 && stats.skipped == 0);
+
+    free(actual);
+    actual = make_image();
+    init_test_options(&adaptive, actual, 3);
+    adaptive.radius = 6;
+    perlovka_denoize_adaptive(&adaptive, &actual, 1, 40, 2, &stats);
+
+    fails += check("  radius of the grain, not the options", stats.tiles == 6 && stats.radius_sum == 6 && adaptive.resolved > 0);
+
+    init_test_options(&adaptive, flat, 3);
+    perlovka_denoize_adaptive(&adaptive, &flat, 1, 40, 1, &stats);
+
+    fails += check("  tiles without grain skipped", memcmp(flat, copy, size) == 0 && stats.skipped == stats.tiles && adaptive.resolved == 0 && adaptive.converged);
+
+    free(expected);
+    free(actual);
+    free(flat);
+    free(copy);
+
+    return fails;
+}
+
+int test_min_gain()
+{
+    PerlovkaOptions options;
+    PerlovkaOptions controlled;
+    size_t size = sizeof(int) * TEST_WIDTH * TEST_HEIGHT;
+    int *free_run = make_image();
+    int *actual = make_image();
+    int *whole = make_image();
+    int fails = 0;
+
+    init_test_options(&options, free_run, 100);
+    options.resolver = RESOLVER_MAXIMAL;
+    perlovka_denoize(&options);
+
+    init_test_options(&controlled, actual, 100);
+    controlled.resolver = RESOLVER_MAXIMAL;
+    controlled.min_gain = 0.01;
+    perlovka_denoize_tiled(&controlled, &actual, 1, 0, 1);
+
+    fails += check("Min gain stops oscillation", options.stopped == PERLOVKA_STOP_LIMIT && controlled.stopped == PERLOVKA_STOP_GAIN && !controlled.converged && controlled.iterations_made < 100 && controlled.gain < 0.01 && controlled.frozen > 0 && controlled.resolved < options.resolved);
+
+    init_test_options(&controlled, whole, 100);
+    controlled.resolver = RESOLVER_MAXIMAL;
+    controlled.min_gain = 0.01;
+    perlovka_denoize(&controlled);
+
+    fails += check("  controlled runs repeat", memcmp(whole, actual, size) == 0 && memcmp(free_run, actual, size) != 0);
+
+    /* A run converging by itself reports so */
+    free(whole);
+    whole = make_disc_image(2);
+    init_test_options(&controlled, whole, 100);
+    controlled.min_gain = 1e-9;
+    perlovka_denoize(&controlled);
+
+    fails += check("  convergence reported", controlled.converged && controlled.stopped == PERLOVKA_STOP_CONVERGED && controlled.iterations_made < 100);
+
+    /* No iteration at all: the image stays and the limit is the reason */
+    free(whole);
+    whole = make_image();
+    controlled.iterations = 0;
+    controlled.data = actual;
+    memcpy(actual, whole, size);
+    perlovka_denoize(&controlled);
+
+    fails += check("  no iterations", memcmp(whole, actual, size) == 0 && controlled.iterations_made == 0 && controlled.resolved == 0 && controlled.stopped == PERLOVKA_STOP_LIMIT);
+
+    free(free_run);
+    free(actual);
+    free(whole);
+
+    return fails;
+}
+
+int test_probe_budget()
+{
+    PerlovkaOptions options;
+    PerlovkaOptions budgeted;
+    size_t size = sizeof(int) * TEST_WIDTH * TEST_HEIGHT;
+    int *expected = make_image();
+    int *actual = make_image();
+    int fails = 0;
+
+    init_test_options(&options, expected, 6);
+    options.radius = 5;
+    perlovka_denoize(&options);
+
+    init_test_options(&budgeted, actual, 6);
+    budgeted.radius = 5;
+    budgeted.probe_budget = 1000;
+    perlovka_denoize(&budgeted);
+
+    fails += check("Probe budget above the plan", memcmp(expected, actual, size) == 0 && budgeted.resolved == options.resolved);
+
+    free(actual);
+    actual = make_image();
+    init_test_options(&budgeted, actual, 6);
+    budgeted.radius = 5;
+    budgeted.probe_budget = 1;
+    perlovka_denoize_tiled(&budgeted, &actual, 1, 0, 1);
+
+    fails += check("  tight budget", budgeted.resolved > 0 && budgeted.resolved < options.resolved && memcmp(expected, actual, size) != 0);
+
+    free(expected);
+    free(actual);
+
+    return fails;
+}
+
+/* Solves one iteration pixel by pixel in the scan order as documented */
+int walk_scan(PSolver solver, int *data, int radius, ScanOrder scan, int iteration)
+{
+    int top = radius;
+    int bottom = TEST_HEIGHT - radius - 1;
+    int left = radius + 1;
+    int right = TEST_WIDTH - radius;
+    bool reverse = scan == SCAN_ALTERNATE && iteration % 2 == 1;
+    bool backwards;
+    int solved = 0;
+    int y;
+
+    if (scan == SCAN_BLOCKS)
+    {
+        for (int pass = 0; pass < 2; ++pass)
+            for (int top_of_block = top; top_of_block < bottom; top_of_block += SCAN_BLOCK)
+                for (int left_of_block = left; left_of_block < right; left_of_block += SCAN_BLOCK)
+                {
+                    if (((top_of_block - top) / SCAN_BLOCK + (left_of_block - left) / SCAN_BLOCK) % 2 != pass)
+                        continue;
+
+                    for (y = top_of_block; y < top_of_block + SCAN_BLOCK && y < bottom; ++y)
+                        for (int x = left_of_block; x < left_of_block + SCAN_BLOCK && x < right; ++x)
+                            solved += apply_solver(solver, data, y * TEST_WIDTH + x);
+                }
+
+        return solved;
+    }
+
+    for (int row = 0; top + row < bottom; ++row)
+    {
+        y = reverse ? bottom - 1 - row : top + row;
+        backwards = reverse || (scan == SCAN_SERPENTINE && row % 2 == 1);
+
+        for (int step = 0; step < right - left; ++step)
+            solved += apply_solver(solver, data, y * TEST_WIDTH + (backwards ? right - 1 - step : left + step));
+    }
+
+    return solved;
+}
+
+int test_scan()
+{
+    size_t size = TEST_WIDTH * TEST_HEIGHT;
+    int *expected = make_image();
+    int *actual = make_image();
+    int *raster = make_image();
+    int expected_solved = 0;
+    int actual_solved = 0;
+    int radius = 3;
+    PerlovkaOptions options;
+    PerlovkaOptions scanned;
+    PSolver solver;
+    PSolverIndex index;
+    int fails = 0;
+
+    diff_horizontal(expected, size);
+    diff_vertical(expected, size, TEST_WIDTH);
+    memcpy(actual, expected, sizeof(int) * size);
+
+    solver = build_solver(TEST_WIDTH, radius, GRID_BOTH, MATCHING_SOFT, RESOLVER_MINIMAL, true);
+    index = build_solver_index(solver, actual, TEST_WIDTH, TEST_HEIGHT);
+
+    for (int y = TEST_HEIGHT - radius - 2; y >= radius; --y)
+    {
+        for (int x = TEST_WIDTH - radius - 1; x > radius; --x)
+            expected_solved += apply_solver(solver, expected, y * TEST_WIDTH + x);
+
+        actual_solved += apply_indexed_solver_span(solver, index, actual, y * TEST_WIDTH + radius + 1, y * TEST_WIDTH + TEST_WIDTH - radius, true);
+    }
+
+    clean_solver_index(index);
+    clean_solver(solver);
+
+    fails += check("Reversed solver spans", memcmp(expected, actual, sizeof(int) * size) == 0 && expected_solved == actual_solved && actual_solved > 0);
+
+    init_test_options(&options, raster, 6);
+    perlovka_denoize(&options);
+
+    solver = build_solver(TEST_WIDTH, options.radius, options.grid, options.matching, options.resolver, options.field_matching);
+
+    for (ScanOrder scan = SCAN_RASTER; scan <= SCAN_BLOCKS; ++scan)
+    {
+        free(expected);
+        free(actual);
+        expected = make_image();
+        actual = make_image();
+
+        diff_horizontal(expected, size);
+        diff_vertical(expected, size, TEST_WIDTH);
+        expected_solved = 0;
+
+        for (int iteration = 0; iteration < 6; ++iteration)
+        {
+            actual_solved = walk_scan(solver, expected, options.radius, scan, iteration);
+            expected_solved += actual_solved;
+
+            if (actual_solved == 0)
+                break;
+        }
+
+        undiff_vertical(expected, size, TEST_WIDTH);
+        undiff_horizontal(expected, size);
+
+        init_test_options(&scanned, actual, 6);
+        scanned.scan = scan;
+        perlovka_denoize(&scanned);
+
+        printf("  scan order %d", scan);
+        fails += check("", memcmp(expected, actual, sizeof(int) * size) == 0 && scanned.resolved == (size_t)expected_solved && expected_solved > 0
+                               && (scan == SCAN_RASTER) == (memcmp(raster, actual, sizeof(int) * size) == 0));
+    }
+
+    clean_solver(solver);
+
+    free(expected);
+    free(actual);
+    free(raster);
+
+    return fails;
+}
+
+/* Variants of the sweep test: two configurations, two snapshots each */
+static int *sweep_results[2][2];
+static PerlovkaOptions sweep_stats[2][2];
+
+static void keep_variant(void *context, int config, int snapshot, int *const *planes, PerlovkaOptions const *stats)
+{
+    size_t size = sizeof(int) * TEST_WIDTH * TEST_HEIGHT;
+
+    (void)context;
+    sweep_results[config][snapshot] = malloc(size);
+    memcpy(sweep_results[config][snapshot], planes[0], size);
+    sweep_stats[config][snapshot] = *stats;
+}
+
+int test_sweep()
+{
+    PerlovkaSweepConfig configs[2];
+    PerlovkaOptions options;
+    size_t size = sizeof(int) * TEST_WIDTH * TEST_HEIGHT;
+    int *input = make_image();
+    int *original = make_image();
+    int *five[5] = { input, input, input, input, input };
+    int *expected;
+    bool same = true;
+    int fails = 0;
+
+    memset(configs, 0, sizeof(configs));
+    init_test_options(&configs[0].options, NULL, 0);
+    configs[0].n_snapshots = 2;
+    configs[0].snapshots[0] = 2;
+    configs[0].snapshots[1] = 5;
+    init_test_options(&configs[1].options, NULL, 0);
+    configs[1].options.resolver = RESOLVER_MINIMAL;
+    configs[1].options.matching = MATCHING_STRICT;
+    configs[1].options.scan = SCAN_SERPENTINE;
+    configs[1].n_snapshots = 2;
+    configs[1].snapshots[0] = 1;
+    configs[1].snapshots[1] = 4;
+
+    fails += check("Sweep", perlovka_sweep(configs, 2, &input, 1, TEST_WIDTH, TEST_HEIGHT, 2, keep_variant, NULL));
+
+    for (int config = 0; config < 2; ++config)
+        for (int snapshot = 0; snapshot < 2; ++snapshot)
+        {
+            expected = make_image();
+            options = configs[config].options;
+            options.data = expected;
+            options.iterations = configs[config].snapshots[snapshot];
+            perlovka_denoize(&options);
+
+            same = same && sweep_results[config][snapshot] && memcmp(expected, sweep_results[config][snapshot], size) == 0 && sweep_stats[config][snapshot].resolved == options.resolved && sweep_stats[config][snapshot].iterations_made == options.iterations_made && sweep_stats[config][snapshot].converged == options.converged;
+
+            free(expected);
+            free(sweep_results[config][snapshot]);
+            sweep_results[config][snapshot] = NULL;
+        }
+
+    fails += check("  sweep variants", same);
+    fails += check("  input intact", memcmp(input, original, size) == 0);
+
+    /* Nothing is emitted for too many planes or unordered snapshots */
+    fails += check("  five planes refused", !perlovka_sweep(configs, 2, five, 5, TEST_WIDTH, TEST_HEIGHT, 2, keep_variant, NULL));
+
+    configs[1].snapshots[0] = 4;
+    configs[1].snapshots[1] = 1;
+    fails += check("  unordered snapshots refused", !perlovka_sweep(configs, 2, &input, 1, TEST_WIDTH, TEST_HEIGHT, 2, keep_variant, NULL) && sweep_results[0][0] == NULL && sweep_results[1][0] == NULL);
+
+    free(input);
+    free(original);
+
+    return fails;
+}
+
+int test_perlovka()
+{
+    int fails = 0;
+
+    printf("Perlovka\n");
+
+    fails += test_resume();
+    fails += test_stream();
+    fails += test_context();
+    fails += test_daemon();
+    fails += test_farm();
+    fails += test_out_of_core();
+    fails += test_checkpoint();
+    fails += test_task();
+    fails += test_step();
+    fails += test_pyramid();
+    fails += test_indexed_solver();
+    fails += test_prune();
+    fails += test_pack_signs();
+    fails += test_adaptive();
+    fails += test_min_gain();
+    fails += test_probe_budget();
+    fails += test_scan();
+    fails += test_sweep();
+
+    printf("\n");
+
+    return fails;
+}
@@ -0,0 +1,6 @@
+#ifndef PERLOVKA_TEST_H
+#define PERLOVKA_TEST_H
+
+int test_perlovka();
+
+#endif
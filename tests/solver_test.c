@@ -11,12 +11,23 @@ typedef struct Pair
     ArmPosition first;
     ArmPosition second;
     PPair skip_to;
+    int ring;
+    bool in_ring;
+    bool odd;
 } Pair;
 
 typedef struct
 {
     bool (*match)(PCValue lhs, PCValue rhs);
     int (*get_delta)(PCValue lhs, PCValue rhs);
+    int radius;
+    bool field_matching;
+    bool soft;
+    int n_heads;
+    PPair heads[2];
+    int n_corners;
+    int corners[8];
+    int head_corners[2][4];
     int n_pairs;
     Pair pairs[];
 } Solvers;
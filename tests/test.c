@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include "balance_test.h"
+#include "perlovka_test.h"
 #include "solver_test.h"
 
 int main()
@@ -12,6 +13,7 @@ int main()
     // test_result += test_signs();
     // test_result += test_complement();
     test_result += test_solvers_build();
+    test_result += test_perlovka();
     
     if (test_result)
     {